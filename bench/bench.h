@@ -0,0 +1,147 @@
+/*
+ * @file bench.h
+ * @brief 微基准测试的公共框架（计时、重复、输出）
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <thread>
+
+/*
+ * 每个用例先预热一轮，再重复 runs 轮（默认 5），报告每轮 ns/op 的中位数、最小值、最大值
+ * 命令行参数：
+ *   --json         每个用例输出一行 JSON（JSON Lines），第一行是运行环境，方便脚本比较两次结果
+ *   --runs=N       重复轮数
+ *   --quick        操作次数缩小 10 倍，用于快速冒烟
+ *   其他参数       用例名过滤，名字里包含任意一个参数的用例才运行
+ *
+ * 用例有两种写法：
+ *   Run(name, ops, fn)        fn(ops) 执行 ops 次操作，整体计时
+ *   RunTimed(name, ops, fn)   fn(ops) 自己准备数据、只对关心的部分计时，返回耗时纳秒
+ * 操作次数里的随机数据都用固定种子生成，两次运行做的是同样的事
+ */
+class BenchRunner {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    BenchRunner(const char* suite, int argc, char* argv[]): suite_(suite), json_(false), quick_(false), runs_(5) {
+        for(int i = 1; i < argc; i++) {
+            if(strcmp(argv[i], "--json") == 0) { json_ = true; }
+            else if(strcmp(argv[i], "--quick") == 0) { quick_ = true; }
+            else if(strncmp(argv[i], "--runs=", 7) == 0) { runs_ = std::max(1, atoi(argv[i] + 7)); }
+            else { filters_.push_back(argv[i]); }
+        }
+        PrintContext_();
+    }
+
+    bool Quick() const { return quick_; }
+    // quick 模式下缩小操作次数，至少保留 1 次
+    size_t Scale(size_t ops) const { return quick_ ? std::max<size_t>(ops / 10, 1) : ops; }
+
+    bool Match(const std::string& name) const {
+        if(filters_.empty()) { return true; }
+        for(auto& f: filters_) {
+            if(name.find(f) != std::string::npos) { return true; }
+        }
+        return false;
+    }
+
+    void Run(const std::string& name, size_t ops, const std::function<void(size_t)>& fn) {
+        RunTimed(name, ops, [&fn](size_t n) {
+            auto start = Clock::now();
+            fn(n);
+            return NsSince(start);
+        });
+    }
+
+    void RunTimed(const std::string& name, size_t ops, const std::function<int64_t(size_t)>& fn) {
+        if(!Match(name) || ops == 0) { return; }
+        fn(ops);
+        std::vector<double> nsPerOp;
+        for(int i = 0; i < runs_; i++) {
+            nsPerOp.push_back(static_cast<double>(fn(ops)) / ops);
+        }
+        std::sort(nsPerOp.begin(), nsPerOp.end());
+        Report_(name, ops, nsPerOp[nsPerOp.size() / 2], nsPerOp.front(), nsPerOp.back());
+    }
+
+    static int64_t NsSince(Clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+private:
+    void PrintContext_() const {
+        char host[64] = "unknown";
+        gethostname(host, sizeof(host) - 1);
+        time_t now = time(nullptr);
+        char date[32];
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+        std::string cpu = CpuModel_();
+        unsigned ncpu = std::thread::hardware_concurrency();
+        if(json_) {
+            printf("{\"type\":\"context\",\"suite\":\"%s\",\"date\":\"%s\",\"host\":\"%s\",\"cpu\":\"%s\","
+                   "\"nproc\":%u,\"compiler\":\"%s\",\"runs\":%d,\"quick\":%s}\n",
+                   suite_, date, host, cpu.c_str(), ncpu, __VERSION__, runs_, quick_ ? "true" : "false");
+        } else {
+            printf("# %s  %s  %s  cpu=%s x%u  cc=%s  runs=%d%s\n",
+                   suite_, date, host, cpu.c_str(), ncpu, __VERSION__, runs_, quick_ ? "  (quick)" : "");
+            printf("%-40s %10s %12s %12s %12s %14s\n", "name", "ops", "median ns/op", "min", "max", "ops/s");
+        }
+        fflush(stdout);
+    }
+
+    void Report_(const std::string& name, size_t ops, double median, double lo, double hi) const {
+        double opsPerSec = median > 0 ? 1e9 / median : 0;
+        if(json_) {
+            printf("{\"type\":\"result\",\"suite\":\"%s\",\"name\":\"%s\",\"ops\":%zu,\"ns_per_op\":%.2f,"
+                   "\"min_ns_per_op\":%.2f,\"max_ns_per_op\":%.2f,\"ops_per_sec\":%.0f}\n",
+                   suite_, name.c_str(), ops, median, lo, hi, opsPerSec);
+        } else {
+            printf("%-40s %10zu %12.1f %12.1f %12.1f %14.0f\n", name.c_str(), ops, median, lo, hi, opsPerSec);
+        }
+        fflush(stdout);
+    }
+
+    // /proc/cpuinfo 的 model name，去掉会破坏 JSON 的字符
+    static std::string CpuModel_() {
+        std::string model = "unknown";
+        FILE* fp = fopen("/proc/cpuinfo", "r");
+        if(!fp) { return model; }
+        char line[256];
+        while(fgets(line, sizeof(line), fp)) {
+            if(strncmp(line, "model name", 10) == 0) {
+                const char* colon = strchr(line, ':');
+                if(colon) {
+                    model.clear();
+                    for(const char* p = colon + 1; *p && *p != '\n'; p++) {
+                        if(*p == '"' || *p == '\\') { continue; }
+                        if(model.empty() && *p == ' ') { continue; }
+                        model += *p;
+                    }
+                }
+                break;
+            }
+        }
+        fclose(fp);
+        return model;
+    }
+
+    const char* suite_;
+    bool json_;
+    bool quick_;
+    int runs_;
+    std::vector<std::string> filters_;
+};
+
+#endif // BENCH_H
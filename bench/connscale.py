@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""
+连接规模测试：在回环地址上打开大量空闲 keep-alive 连接（源地址轮流使用 127.0.0.x，突破单个地址的临时端口数），
+对每个规模报告
+  - 每个空闲连接占用的服务器内存：建好全部连接后服务器 VmRSS 的增量 / 连接数
+  - 内核内存：/proc/meminfo 的 Slab 与 /proc/net/sockstat 的 TCP 缓冲区页数的增量 / 连接数，
+    回环上客户端和服务器两端的 socket 都算在里面，是“一对”连接的开销
+  - accept 速率：服务器 tws_accepts_total 的平均增长速率和最快一秒的速率
+  - 空闲连接都建好之后，少量活跃连接以固定速率（开环）请求时的延迟 p50/p99/p999
+
+用法：
+  python3 bench/connscale.py                        默认规模 10000,100000,1000000
+  --levels 10000,50000                              指定规模
+  --rate N / --active N / --duration N              活跃请求的速率（总 req/s）、活跃连接数、统计时长
+  --no-build / --make-args "..." / --json FILE      同 bench/e2e.py
+
+进程的文件描述符上限不够时，规模按上限缩小并给出提示；百万连接通常需要：
+  ulimit -n 1100000（以及 fs.nr_open）、net.ipv4.tcp_mem / net.core.somaxconn 足够大、几 GB 空闲内存
+服务器用 -I 0 关闭空闲超时，免得建连接期间早建好的连接先被踢掉
+"""
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+from e2e import LOADGEN, Server, build, free_port, log, machine, prepare_workdir, raise_nofile
+
+ACTIVE_PATH = "/index.html"
+
+
+def meminfo_kb(field):
+    with open("/proc/meminfo") as f:
+        for line in f:
+            if line.startswith(field + ":"):
+                return int(line.split()[1])
+    return 0
+
+
+def tcp_mem_pages():
+    with open("/proc/net/sockstat") as f:
+        for line in f:
+            if line.startswith("TCP:"):
+                parts = line.split()
+                return int(parts[parts.index("mem") + 1])
+    return 0
+
+
+def run_level(level, work, opts):
+    server = Server(work, free_port(), ["-I", "0"])
+    try:
+        # 先让服务器把页面、指标、日志这些一次性的内存分配做完，再取基线
+        for _ in range(50):
+            server.request("GET", ACTIVE_PATH)
+        limit = int(server.metric("tws_connections_limit"))
+        if level + opts.active + 16 > limit:
+            log("  !! server connection limit is %d (RLIMIT_NOFILE): level %d scaled down" % (limit, level))
+            level = limit - opts.active - 16
+        time.sleep(0.5)
+        rss0 = server.status_kb("VmRSS")
+        slab0, tcp0 = meminfo_kb("Slab"), tcp_mem_pages()
+        accepts0 = server.metric("tws_accepts_total")
+
+        cmd = [LOADGEN, "-p", str(server.port), "-t", str(opts.threads), "-c", str(opts.active),
+               "-R", str(opts.rate), "-d", str(opts.duration), "-w", "1", "-T", "10000",
+               "-m", ACTIVE_PATH, "-I", str(level), "-j"]
+        gen = subprocess.Popen(cmd, stdout=subprocess.PIPE)
+        start = time.time()
+        samples = []            # (时刻, accepts)
+        ramp_s = None
+        rss_idle = slab1 = tcp1 = None
+        target = level + opts.active
+        last_progress, last_active = start, -1
+        while gen.poll() is None:
+            now = time.time()
+            accepts = server.metric("tws_accepts_total") - accepts0
+            active = int(server.metric("tws_connections_active"))
+            samples.append((now, accepts))
+            if ramp_s is None:
+                if active != last_active:
+                    last_active, last_progress = active, now
+                if active >= target or now - last_progress > 15:
+                    # 全部建好（或者停滞），稍等一下让服务器处理完最后一批 accept 再量内存
+                    ramp_s = now - start
+                    time.sleep(0.5)
+                    rss_idle = server.status_kb("VmRSS")
+                    slab1, tcp1 = meminfo_kb("Slab"), tcp_mem_pages()
+            time.sleep(0.1)
+        out, _ = gen.communicate()
+        if gen.returncode != 0:
+            raise RuntimeError("loadgen exited with %d" % gen.returncode)
+        report = json.loads(out)
+        peak = server.peak_rss_kb()
+    finally:
+        server.stop()
+
+    established = report["idle"]["established"]
+    if rss_idle is None or established == 0:
+        raise RuntimeError("idle connections never came up")
+    # 最快一秒：相隔至少一秒的两个采样之间的 accept 速率的最大值
+    peak_rate, j = 0.0, 0
+    for i in range(len(samples)):
+        while j < i and samples[i][0] - samples[j + 1][0] >= 1.0:
+            j += 1
+        dt = samples[i][0] - samples[j][0]
+        if dt >= 1.0:
+            peak_rate = max(peak_rate, (samples[i][1] - samples[j][1]) / dt)
+    avg_rate = established / ramp_s if ramp_s else 0.0
+    if ramp_s < 1.0:
+        # 不到一秒就建完了，没有完整的一秒窗口
+        peak_rate = avg_rate
+    lat = report["latency_us"]
+    return {
+        "level": level,
+        "established": established,
+        "lost": report["idle"]["lost"],
+        "sources": report["idle"]["sources"],
+        "ramp_s": round(ramp_s, 2),
+        "accept_rate": round(avg_rate),
+        "accept_rate_peak": round(peak_rate),
+        "rss_base_kb": rss0,
+        "rss_idle_kb": rss_idle,
+        "rss_peak_kb": peak,
+        "bytes_per_conn": round((rss_idle - rss0) * 1024.0 / established),
+        "kernel_slab_bytes_per_pair": round((slab1 - slab0) * 1024.0 / established),
+        "kernel_tcp_buf_bytes_per_pair": round((tcp1 - tcp0) * os.sysconf("SC_PAGE_SIZE") / established),
+        "rps": report["rps"],
+        "p50_us": lat["p50"],
+        "p99_us": lat["p99"],
+        "p999_us": lat["p999"],
+        "errors": report["errors"]["total"],
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="tinyWebServer idle connection scaling harness")
+    parser.add_argument("--levels", default="10000,100000,1000000")
+    parser.add_argument("--rate", type=float, default=200, help="active request rate, req/s (open loop)")
+    parser.add_argument("--active", type=int, default=8, help="active connections")
+    parser.add_argument("--duration", type=float, default=10)
+    parser.add_argument("--threads", type=int, default=2, help="loadgen threads")
+    parser.add_argument("--no-build", action="store_true")
+    parser.add_argument("--make-args", default="")
+    parser.add_argument("--json", help="write results to this file")
+    opts = parser.parse_args()
+    levels = [int(x) for x in opts.levels.split(",") if x]
+
+    if not opts.no_build:
+        build(opts.make_args)
+    nofile = raise_nofile()
+    # loadgen 一个进程要持有全部空闲连接
+    usable = nofile - opts.active - 1000
+    if max(levels) > usable:
+        log("!! RLIMIT_NOFILE is %d: levels above %d are scaled down "
+            "(raise ulimit -n / fs.nr_open for larger runs)" % (nofile, usable))
+    plan = []
+    for lv in levels:
+        lv = min(lv, usable)
+        if lv > 0 and lv not in plan:
+            plan.append(lv)
+
+    work = prepare_workdir()
+    results, failures = [], []
+    try:
+        for lv in plan:
+            log("== %d idle connections" % lv)
+            try:
+                res = run_level(lv, work, opts)
+            except (RuntimeError, subprocess.SubprocessError, OSError, ValueError) as e:
+                failures.append("%d: %s" % (lv, e))
+                log("  !! %s" % e)
+                continue
+            results.append(res)
+            log("  %d established in %.1fs (%d/s avg, %d/s peak), server %d B/conn, kernel %d B/pair, "
+                "p99 %dus under idle load"
+                % (res["established"], res["ramp_s"], res["accept_rate"], res["accept_rate_peak"],
+                   res["bytes_per_conn"], res["kernel_slab_bytes_per_pair"] + res["kernel_tcp_buf_bytes_per_pair"],
+                   res["p99_us"]))
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+
+    log("\n%9s %9s %8s %9s %9s %10s %10s %10s %8s %8s %8s %7s"
+        % ("idle", "up", "ramp_s", "acc/s", "acc/s_pk", "rss_MB", "B/conn", "kern_B", "p50_us", "p99_us", "p999_us", "errors"))
+    for r in results:
+        log("%9d %9d %8.1f %9d %9d %10.1f %10d %10d %8d %8d %8d %7d"
+            % (r["level"], r["established"], r["ramp_s"], r["accept_rate"], r["accept_rate_peak"],
+               r["rss_idle_kb"] / 1024.0, r["bytes_per_conn"],
+               r["kernel_slab_bytes_per_pair"] + r["kernel_tcp_buf_bytes_per_pair"],
+               r["p50_us"], r["p99_us"], r["p999_us"], r["errors"]))
+    if opts.json:
+        with open(opts.json, "w") as f:
+            json.dump({"machine": machine(), "nofile": nofile, "rate": opts.rate, "active": opts.active,
+                       "levels": results}, f, indent=2, sort_keys=True)
+    for r in results:
+        if r["established"] < r["level"] or r["lost"] or r["errors"]:
+            failures.append("%d: %d/%d established, %d lost, %d errors"
+                            % (r["level"], r["established"], r["level"], r["lost"], r["errors"]))
+    if failures:
+        for line in failures:
+            print("FAILURE " + line, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,225 @@
+/*
+ * @file corebench.cpp
+ * @brief 热路径组件的微基准：Buffer、请求解析、响应头、线程池、日志
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <random>
+#include "bench.h"
+#include "../code/buffer/buffer.h"
+#include "../code/http/httprequest.h"
+#include "../code/http/httpresponse.h"
+#include "../code/pool/threadpool.h"
+#include "../code/log/log.h"
+
+/*
+ * 在 bench 目录下运行（make bench 会切过去）：请求样本在 ./corpus，静态资源用 ../resources
+ * corpus 里是浏览器/curl/压测工具发出的原始请求，CRLF 原样保存
+ */
+static const char* CORPUS_DIR = "./corpus/";
+static const char* SRC_DIR = "../resources/";
+static const char* CORPUS[] = {
+    "wrk_get.txt", "curl_get.txt", "firefox_get.txt", "chrome_get.txt", "post_login.txt",
+};
+
+static std::string ReadFile(const std::string& path) {
+    std::string res;
+    FILE* fp = fopen(path.c_str(), "rb");
+    if(!fp) {
+        fprintf(stderr, "cannot open %s (run from the bench directory)\n", path.c_str());
+        exit(1);
+    }
+    char buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0) { res.append(buf, n); }
+    fclose(fp);
+    return res;
+}
+
+static void BenchBuffer(BenchRunner& bench) {
+    std::string small(64, 'a');
+    std::string large(16 * 1024, 'b');
+
+    // 小块追加，攒满一批后整体取走：Append 的常规路径，不需要扩容或搬移
+    bench.Run("buffer/append_64B", bench.Scale(5000000), [&](size_t ops) {
+        Buffer buff;
+        for(size_t i = 0; i < ops; i++) {
+            buff.Append(small);
+            if(buff.ReadableBytes() >= 960) { buff.RetrieveAll(); }
+        }
+    });
+    // 每次从 1KB 的新 Buffer 开始追加 16KB：MakeSpace_ 里 resize 扩容的路径
+    bench.Run("buffer/append_16K_grow", bench.Scale(200000), [&](size_t ops) {
+        for(size_t i = 0; i < ops; i++) {
+            Buffer buff;
+            buff.Append(large);
+        }
+    });
+    // 取走大部分数据后再追加，尾部空间不够但前面空出来的够：MakeSpace_ 里把可读数据搬回开头的路径
+    bench.Run("buffer/append_compact", bench.Scale(2000000), [&](size_t ops) {
+        Buffer buff(1024);
+        std::string chunk(600, 'c');
+        for(size_t i = 0; i < ops; i++) {
+            buff.Append(chunk);
+            buff.Retrieve(500);
+            if(buff.ReadableBytes() > 200) { buff.RetrieveAll(); }
+        }
+    });
+
+    // ReadFd：每次往管道里写一块再读出来，计时包含 write 系统调用，两种大小分别走 Buffer 内部和栈上 extrabuf 的路径
+    int fds[2];
+    if(pipe(fds) < 0) { perror("pipe"); return; }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    for(size_t size: { static_cast<size_t>(512), static_cast<size_t>(32 * 1024) }) {
+        std::string payload(size, 'r');
+        bench.Run("buffer/readfd_" + std::to_string(size) + "B", bench.Scale(200000), [&](size_t ops) {
+            Buffer buff(1024);
+            int err = 0;
+            for(size_t i = 0; i < ops; i++) {
+                if(write(fds[1], payload.data(), payload.size()) < 0) { perror("write"); exit(1); }
+                buff.ReadFd(fds[0], &err);
+                buff.RetrieveAll();
+            }
+        });
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void BenchParse(BenchRunner& bench) {
+    for(const char* name: CORPUS) {
+        std::string raw = ReadFile(std::string(CORPUS_DIR) + name);
+        std::string label = name;
+        label = "http/parse/" + label.substr(0, label.find('.'));
+        // 每行都要构造 std::regex，单次解析在几百微秒量级，次数比其他用例少得多
+        bench.Run(label, bench.Scale(5000), [&](size_t ops) {
+            Buffer buff;
+            HttpRequest request;
+            for(size_t i = 0; i < ops; i++) {
+                buff.Append(raw);
+                request.Init();
+                if(!request.parse(buff)) { fprintf(stderr, "%s: parse failed\n", name); exit(1); }
+                buff.RetrieveAll();
+            }
+        });
+    }
+}
+
+static void BenchResponse(BenchRunner& bench) {
+    struct Case { const char* name; const char* path; bool keepAlive; };
+    const Case cases[] = {
+        { "http/response/index_200", "/index.html", true },
+        { "http/response/image_200", "/images/profile-image.jpg", true },
+        { "http/response/missing_404", "/no-such-file.html", false },
+    };
+    std::string srcDir = SRC_DIR;
+    for(const Case& c: cases) {
+        bench.Run(c.name, bench.Scale(50000), [&](size_t ops) {
+            Buffer buff;
+            HttpResponse response;
+            for(size_t i = 0; i < ops; i++) {
+                std::string path = c.path;
+                response.Init(srcDir, path, c.keepAlive, -1);
+                response.MakeResponse(buff);
+                response.UnmapFile();
+                buff.RetrieveAll();
+            }
+        });
+    }
+    // 动态页面（/metrics 之类）：不碰文件系统，只有状态行、头和 body 拼接
+    std::string body(2048, 'm');
+    bench.Run("http/response/dynamic_2K", bench.Scale(500000), [&](size_t ops) {
+        Buffer buff;
+        HttpResponse response;
+        std::string path = "/metrics";
+        for(size_t i = 0; i < ops; i++) {
+            response.Init(srcDir, path, true, 200);
+            response.MakeResponse(buff, "text/plain", body);
+            buff.RetrieveAll();
+        }
+    });
+}
+
+/* producers 个线程同时往 workers 个工作线程的池子里投空任务，计时到全部任务执行完 */
+static void BenchThreadPool(BenchRunner& bench) {
+    const size_t workers = 4;
+    for(size_t producers: { static_cast<size_t>(1), static_cast<size_t>(4), static_cast<size_t>(8) }) {
+        std::string name = "threadpool/addtask/producers=" + std::to_string(producers);
+        bench.RunTimed(name, bench.Scale(400000), [&](size_t ops) {
+            ThreadPool pool(workers);
+            std::atomic<size_t> done(0);
+            size_t perThread = ops / producers;
+            size_t total = perThread * producers;
+            auto start = BenchRunner::Clock::now();
+            std::vector<std::thread> threads;
+            for(size_t p = 0; p < producers; p++) {
+                threads.emplace_back([&] {
+                    for(size_t i = 0; i < perThread; i++) {
+                        pool.AddTask([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+                    }
+                });
+            }
+            for(auto& t: threads) { t.join(); }
+            while(done.load(std::memory_order_relaxed) < total) { std::this_thread::yield(); }
+            return BenchRunner::NsSince(start);
+        });
+    }
+}
+
+/*
+ * Log::write 的调用方开销，同步模式（拿锁 fputs）和异步模式（格式化进本线程的环形缓冲区）各跑 1/4 线程
+ * 异步模式用 FULL_BLOCK，写得比后台线程快时会被反压，测到的是持续吞吐而不是丢日志的速度
+ * 日志写到 /tmp 下的临时目录，按 32MB 翻滚、只保留两个文件，跑完删掉
+ */
+static void BenchLog(BenchRunner& bench) {
+    if(!bench.Match("log/")) { return; }
+    char dir[] = "/tmp/tws_bench_log_XXXXXX";
+    if(!mkdtemp(dir)) { perror("mkdtemp"); return; }
+    Log* log = Log::Instance();
+    log->SetRotatePolicy(32 * 1024 * 1024, 86400);
+    log->SetRetention(false, 2, 0);
+    log->SetFullPolicy(Log::FULL_BLOCK);
+
+    struct Mode { const char* name; int queue; };
+    const Mode modes[] = { { "sync", 0 }, { "async", 1024 } };
+    for(const Mode& mode: modes) {
+        log->init(1, dir, ".log", mode.queue);
+        for(size_t threads: { static_cast<size_t>(1), static_cast<size_t>(4) }) {
+            std::string name = std::string("log/") + mode.name + "/threads=" + std::to_string(threads);
+            bench.RunTimed(name, bench.Scale(400000), [&](size_t ops) {
+                size_t perThread = ops / threads;
+                auto start = BenchRunner::Clock::now();
+                std::vector<std::thread> workers;
+                for(size_t t = 0; t < threads; t++) {
+                    workers.emplace_back([perThread, t] {
+                        for(size_t i = 0; i < perThread; i++) {
+                            LOG_INFO("bench client[%d] request %zu path %s code %d", static_cast<int>(t), i, "/index.html", 200);
+                        }
+                    });
+                }
+                for(auto& w: workers) { w.join(); }
+                return BenchRunner::NsSince(start) * static_cast<int64_t>(ops) / static_cast<int64_t>(perThread * threads);
+            });
+        }
+        log->flush();
+    }
+    std::string cmd = std::string("rm -rf ") + dir;
+    if(system(cmd.c_str()) != 0) { fprintf(stderr, "cannot remove %s\n", dir); }
+}
+
+int main(int argc, char* argv[]) {
+    BenchRunner bench("corebench", argc, argv);
+    BenchBuffer(bench);
+    BenchParse(bench);
+    BenchResponse(bench);
+    BenchThreadPool(bench);
+    BenchLog(bench);
+    return 0;
+}
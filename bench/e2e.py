@@ -0,0 +1,426 @@
+#!/usr/bin/env python3
+"""
+端到端性能回归：构建服务器和 loadgen，在回环地址上用固定配置启动服务器（本地用户存储 -B 1，不需要 MySQL），
+依次跑各个场景，记录吞吐、p50/p99/p999、每个请求的服务器 CPU 时间和 RSS 峰值，与检入的基线（bench/baselines/<机器>.json）比较，
+超出容差的指标逐条标出，最后退出码为 1
+服务器的配置全部在 SERVER_ARGS 里显式给出（访问日志、追踪关闭，日志等级固定），不受默认值变化的影响
+
+用法（在仓库根目录或任意目录下）：
+  python3 bench/e2e.py                           构建并运行全部场景，与基线比较
+  python3 bench/e2e.py static_small 404_flood    只跑指定场景
+  --baseline NAME                                使用 bench/baselines/NAME.json（或给出文件路径），
+                                                 默认选 CPU 型号和核数与本机相同的那一份
+  --update-baseline                              把本次结果写进基线（默认文件名由本机 CPU 型号和核数生成），和代码一起提交
+  --no-build                                     跳过构建，直接用 bin/server 和 bin/loadgen
+  --make-args "CXX=..."                          构建时传给 make 的参数
+  --duration N / --warmup N                      每个场景的统计/预热时长（秒），默认 10 / 2
+  --runs N                                       每个场景跑 N 次，各指标取中位数，默认 3
+  --json FILE                                    把本次结果写到文件
+
+每个场景启动一个新的服务器进程，RSS 取该进程的 VmHWM；CPU 时间取压测前后 /proc/<pid>/stat 的差，
+除以同一段时间内服务器自己统计的响应数（/metrics 里的 tws_http_response_bytes_count），包括预热
+基线与机器强相关，每台参考机器（开发机、CI）检入一份；找不到与本机匹配的基线时检查失败，并列出已有的基线。
+机器身份只比较 CPU 型号和核数，内核版本等其他差异只给出警告。只有 1 个 CPU 时 loadgen 和服务器抢同一个核，
+尾延迟的噪声很大，同样给出警告
+文件描述符上限不够的空闲连接场景整个跳过（不会偷偷减少连接数）
+"""
+import argparse
+import http.client
+import json
+import os
+import platform
+import re
+import resource
+import shlex
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BASELINES = os.path.join(ROOT, "bench", "baselines")
+SERVER = os.path.join(ROOT, "bin", "server")
+LOADGEN = os.path.join(ROOT, "bin", "loadgen")
+
+# 服务器的固定配置：本地用户存储，6 个工作线程，异步日志只记 warn 以上，访问日志和请求追踪关闭，/metrics 打开（取响应数）
+SERVER_ARGS = ["-B", "1", "-t", "6", "-l", "1", "-e", "2", "-q", "1024", "-A", "0", "-N", "0", "-Y", "/metrics"]
+
+# 场景：loadgen 参数，idle 为额外保持的空闲 keep-alive 连接数
+SCENARIOS = [
+    {"name": "static_small", "args": ["-c", "64", "-m", "/index.html"]},
+    {"name": "large_file", "args": ["-c", "8", "-m", "/e2e/large.bin"]},
+    {"name": "404_flood", "args": ["-c", "64", "-m", "/e2e-missing.html"]},
+    {"name": "login_mix", "args": ["-c", "32", "-m", "/index.html=60,login=30,register=10"]},
+    {"name": "idle_50k", "args": ["-c", "16", "-m", "/index.html"], "idle": 50000},
+]
+
+LARGE_FILE_BYTES = 4 << 20
+
+# 指标、方向（越大越好为 1，越小越好为 -1）、默认容差（相对基线的比例），基线文件里的 tolerance 可以覆盖
+METRICS = [
+    ("rps", 1, 0.10),
+    ("p50_us", -1, 0.15),
+    ("p99_us", -1, 0.20),
+    ("p999_us", -1, 0.30),
+    ("cpu_us_per_req", -1, 0.10),
+    ("rss_kb", -1, 0.10),
+]
+
+
+def log(msg):
+    print(msg, flush=True)
+
+
+def machine():
+    cpu = "unknown"
+    try:
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    cpu = line.split(":", 1)[1].strip()
+                    break
+    except OSError:
+        pass
+    return {"cpu": cpu, "nproc": os.cpu_count(), "kernel": platform.release()}
+
+
+def baseline_path(name):
+    if name.endswith(".json") or os.sep in name:
+        return os.path.abspath(name)
+    return os.path.join(BASELINES, name + ".json")
+
+
+def default_baseline_name(mach):
+    cpu = re.sub(r"\((r|tm)\)|\bprocessor\b|\bcpu\b", "", mach["cpu"].lower())
+    return "%s-%dcpu" % (re.sub(r"[^a-z0-9]+", "-", cpu).strip("-") or "unknown", mach["nproc"] or 1)
+
+
+def same_machine(a, b):
+    """只比较 CPU 型号和核数；内核版本、发行版的差异不影响是否可比"""
+    return a.get("cpu") == b.get("cpu") and a.get("nproc") == b.get("nproc")
+
+
+def find_baseline(mach):
+    """在 bench/baselines 里找与本机匹配的基线，返回 (路径, 已有的基线名列表)"""
+    names = sorted(f[:-5] for f in os.listdir(BASELINES) if f.endswith(".json")) if os.path.isdir(BASELINES) else []
+    for name in names:
+        with open(baseline_path(name)) as f:
+            if same_machine(json.load(f).get("machine", {}), mach):
+                return baseline_path(name), names
+    return None, names
+
+
+def build(make_args):
+    args = shlex.split(make_args)
+    os.makedirs(os.path.join(ROOT, "bin"), exist_ok=True)
+    for cmd in (["make", "-C", ROOT] + args, ["make", "-C", os.path.join(ROOT, "tools"), "loadgen"] + args):
+        log("+ " + " ".join(cmd))
+        subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+
+
+def prepare_workdir():
+    """服务器以工作目录下的 resources 为根目录，拷一份站点资源，再放一个大文件"""
+    work = tempfile.mkdtemp(prefix="tws_e2e_")
+    shutil.copytree(os.path.join(ROOT, "resources"), os.path.join(work, "resources"))
+    os.makedirs(os.path.join(work, "resources", "e2e"))
+    block = bytes(range(256)) * 4096
+    with open(os.path.join(work, "resources", "e2e", "large.bin"), "wb") as f:
+        for _ in range(LARGE_FILE_BYTES // len(block)):
+            f.write(block)
+    return work
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def raise_nofile():
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if hard != resource.RLIM_INFINITY and soft < hard:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+    return resource.getrlimit(resource.RLIMIT_NOFILE)[0]
+
+
+class Server:
+    def __init__(self, work, port, extra=()):
+        self.port = port
+        self.proc = subprocess.Popen(
+            [SERVER, "-p", str(port), "-H", os.path.join(work, "users.db")] + SERVER_ARGS + list(extra),
+            cwd=work, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        deadline = time.time() + 10
+        while time.time() < deadline:
+            if self.proc.poll() is not None:
+                raise RuntimeError("server exited with %d during startup" % self.proc.returncode)
+            try:
+                socket.create_connection(("127.0.0.1", port), timeout=0.2).close()
+                return
+            except OSError:
+                time.sleep(0.05)
+        self.stop()
+        raise RuntimeError("server did not start listening on %d" % port)
+
+    def request(self, method, path, body=None):
+        conn = http.client.HTTPConnection("127.0.0.1", self.port, timeout=10)
+        headers = {"Content-Type": "application/x-www-form-urlencoded"} if body else {}
+        conn.request(method, path, body=body, headers=headers)
+        resp = conn.getresponse()
+        data = resp.read()
+        conn.close()
+        return resp.status, data
+
+    def metric(self, name):
+        _, data = self.request("GET", "/metrics")
+        for line in data.decode().splitlines():
+            if line.startswith(name + " "):
+                return float(line.split()[1])
+        raise RuntimeError("%s missing from /metrics" % name)
+
+    def responses(self):
+        return int(self.metric("tws_http_response_bytes_count"))
+
+    def cpu_seconds(self):
+        with open("/proc/%d/stat" % self.proc.pid) as f:
+            fields = f.read().rsplit(")", 1)[1].split()
+        # utime、stime 是 ) 之后的第 12、13 个字段
+        return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+    def status_kb(self, field):
+        with open("/proc/%d/status" % self.proc.pid) as f:
+            for line in f:
+                if line.startswith(field + ":"):
+                    return int(line.split()[1])
+        return 0
+
+    def peak_rss_kb(self):
+        return self.status_kb("VmHWM")
+
+    def stop(self):
+        if self.proc.poll() is None:
+            self.proc.send_signal(signal.SIGTERM)
+            try:
+                self.proc.wait(5)
+            except subprocess.TimeoutExpired:
+                self.proc.kill()
+                self.proc.wait()
+
+
+def run_scenario(sc, work, opts, nofile):
+    args = list(sc["args"])
+    idle = sc.get("idle", 0)
+    if idle:
+        args += ["-I", str(idle)]
+    # 每次都从空的用户文件开始，前一次注册的用户不会拖慢后面的运行
+    users = os.path.join(work, "users.db")
+    if os.path.exists(users):
+        os.remove(users)
+    server = Server(work, free_port())
+    try:
+        status, _ = server.request("POST", "/register", "username=bench&password=bench")
+        if status != 200:
+            raise RuntimeError("seeding the login user failed with HTTP %d" % status)
+        cpu0, resp0 = server.cpu_seconds(), server.responses()
+        cmd = [LOADGEN, "-p", str(server.port), "-t", str(opts.threads), "-d", str(opts.duration),
+               "-w", str(opts.warmup), "-j"] + args
+        out = subprocess.run(cmd, check=True, stdout=subprocess.PIPE, timeout=opts.duration + opts.warmup + 120)
+        report = json.loads(out.stdout)
+        cpu1, resp1 = server.cpu_seconds(), server.responses()
+        if server.proc.poll() is not None:
+            raise RuntimeError("server died during the scenario (exit %d)" % server.proc.returncode)
+        rss = server.peak_rss_kb()
+    finally:
+        server.stop()
+    served = max(1, resp1 - resp0 - 1)
+    lat = report["latency_us"]
+    return {
+        "rps": round(report["rps"], 1),
+        "p50_us": lat["p50"],
+        "p99_us": lat["p99"],
+        "p999_us": lat["p999"],
+        "cpu_us_per_req": round((cpu1 - cpu0) * 1e6 / served, 2),
+        "rss_kb": rss,
+        "requests": report["requests"],
+        "errors": report["errors"]["total"],
+        "codes": report["codes"],
+        "idle": idle,
+        "idle_established": report["idle"]["established"],
+        "idle_lost": report["idle"]["lost"],
+    }
+
+
+def median_result(runs):
+    """多次运行时每个指标各取中位数，单次的偶然抖动不会进基线，也不会单独触发回归"""
+    res = dict(runs[0])
+    for metric, _, _ in METRICS:
+        values = sorted(r[metric] for r in runs)
+        res[metric] = values[len(values) // 2]
+    return res
+
+
+def fd_shortfall(sc, nofile):
+    """服务器和 loadgen 各自要 idle 个以上的描述符，留出余量。返回缺少的个数"""
+    return max(0, sc.get("idle", 0) + 1000 - nofile)
+
+
+def hard_failures(name, res):
+    """与基线无关、本身就算失败的情况"""
+    problems = []
+    if res["requests"] == 0:
+        problems.append("no requests completed")
+    if res["errors"]:
+        problems.append("%d transport errors (connect/timeout/closed)" % res["errors"])
+    if res["idle"] and res["idle_established"] < res["idle"]:
+        problems.append("only %d/%d idle connections established" % (res["idle_established"], res["idle"]))
+    if res["idle_lost"]:
+        problems.append("%d idle connections closed by the server" % res["idle_lost"])
+    return ["%s: %s" % (name, p) for p in problems]
+
+
+def compare(results, baseline):
+    tolerance = dict((m, t) for m, _, t in METRICS)
+    tolerance.update(baseline.get("tolerance", {}))
+    base_sc = baseline.get("scenarios", {})
+    regressions = []
+    log("\n%-14s %-16s %12s %12s %9s %6s  %s" % ("scenario", "metric", "baseline", "current", "delta", "tol", "status"))
+    for name, res in results.items():
+        base = base_sc.get(name)
+        if base is None:
+            log("%-14s (not in the baseline, record it with --update-baseline)" % name)
+            continue
+        if base.get("idle", 0) != res["idle"]:
+            regressions.append("%s: ran with %d idle connections, baseline has %d (re-record the baseline)"
+                               % (name, res["idle"], base.get("idle", 0)))
+            continue
+        for metric, direction, _ in METRICS:
+            b, c, tol = base.get(metric), res[metric], tolerance[metric]
+            if not b:
+                continue
+            delta = (c - b) / b
+            bad = delta < -tol if direction > 0 else delta > tol
+            status = "REGRESSION" if bad else ("improved" if -delta * direction > tol else "ok")
+            log("%-14s %-16s %12s %12s %+8.1f%% %5.0f%%  %s" % (name, metric, b, c, delta * 100, tol * 100, status))
+            if bad:
+                regressions.append("%s %s: %s -> %s (%+.1f%%, tolerance %.0f%%)" % (name, metric, b, c, delta * 100, tol * 100))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="tinyWebServer end-to-end performance regression harness")
+    parser.add_argument("scenarios", nargs="*", help="scenario names (default: all)")
+    parser.add_argument("--baseline", help="baseline name under bench/baselines or a path (default: match this machine)")
+    parser.add_argument("--update-baseline", action="store_true")
+    parser.add_argument("--no-build", action="store_true")
+    parser.add_argument("--make-args", default="")
+    parser.add_argument("--duration", type=float, default=10)
+    parser.add_argument("--warmup", type=float, default=2)
+    parser.add_argument("--threads", type=int, default=2, help="loadgen threads")
+    parser.add_argument("--runs", type=int, default=3, help="runs per scenario, metrics are the median")
+    parser.add_argument("--json", help="write results to this file")
+    opts = parser.parse_args()
+    if opts.runs < 1:
+        parser.error("--runs must be at least 1")
+
+    names = [sc["name"] for sc in SCENARIOS]
+    for n in opts.scenarios:
+        if n not in names:
+            parser.error("unknown scenario %s (have: %s)" % (n, ", ".join(names)))
+    selected = [sc for sc in SCENARIOS if not opts.scenarios or sc["name"] in opts.scenarios]
+
+    if (os.cpu_count() or 1) < 2:
+        log("!! only 1 CPU: loadgen and the server share it, tail latencies are noisy")
+    if not opts.no_build:
+        build(opts.make_args)
+    nofile = raise_nofile()
+    work = prepare_workdir()
+    results = {}
+    failures = []
+    try:
+        for sc in selected:
+            log("== %s" % sc["name"])
+            short = fd_shortfall(sc, nofile)
+            if short:
+                # 不偷偷减少连接数，否则场景名和测的东西对不上
+                log("  !! skipped: RLIMIT_NOFILE is %d, %d idle connections need about %d more (raise ulimit -n)"
+                    % (nofile, sc["idle"], short))
+                continue
+            runs = []
+            try:
+                for _ in range(opts.runs):
+                    res = run_scenario(sc, work, opts, nofile)
+                    log("  %.1f req/s  p50 %dus  p99 %dus  p999 %dus  cpu %.1fus/req  rss %dkB  errors %d"
+                        % (res["rps"], res["p50_us"], res["p99_us"], res["p999_us"], res["cpu_us_per_req"],
+                           res["rss_kb"], res["errors"]))
+                    failures += hard_failures(sc["name"], res)
+                    runs.append(res)
+            except (RuntimeError, subprocess.SubprocessError, OSError, ValueError) as e:
+                failures.append("%s: %s" % (sc["name"], e))
+                log("  !! %s" % e)
+                continue
+            results[sc["name"]] = median_result(runs)
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+
+    current = {"machine": machine(), "duration_s": opts.duration, "warmup_s": opts.warmup, "scenarios": results}
+    if opts.json:
+        with open(opts.json, "w") as f:
+            json.dump(current, f, indent=2, sort_keys=True)
+
+    if opts.baseline:
+        path = baseline_path(opts.baseline)
+    elif opts.update_baseline:
+        path = baseline_path(default_baseline_name(current["machine"]))
+    else:
+        path, names = find_baseline(current["machine"])
+    baseline = {}
+    if path and os.path.exists(path):
+        with open(path) as f:
+            baseline = json.load(f)
+
+    if opts.update_baseline:
+        baseline["machine"] = current["machine"]
+        baseline.setdefault("tolerance", dict((m, t) for m, _, t in METRICS))
+        keep = ("rps", "p50_us", "p99_us", "p999_us", "cpu_us_per_req", "rss_kb", "idle")
+        baseline.setdefault("scenarios", {}).update(
+            (name, dict((k, res[k]) for k in keep)) for name, res in results.items())
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "w") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write("\n")
+        log("\nbaseline written to %s" % path)
+        regressions = []
+    elif not baseline:
+        regressions = []
+        if path:
+            failures.append("no baseline at %s" % path)
+        else:
+            failures.append("no baseline for %s in %s (have: %s); pass --baseline NAME or record one with --update-baseline"
+                            % (json.dumps(current["machine"]), BASELINES, ", ".join(names) or "none"))
+    else:
+        log("\nbaseline %s" % os.path.relpath(path, ROOT))
+        base_mach = baseline.get("machine", {})
+        if not same_machine(base_mach, current["machine"]):
+            log("!! baseline was recorded on %s; this is %s. Numbers may not be comparable."
+                % (json.dumps(base_mach), json.dumps(current["machine"])))
+        elif base_mach.get("kernel") != current["machine"]["kernel"]:
+            log("!! baseline kernel %s, this is %s" % (base_mach.get("kernel"), current["machine"]["kernel"]))
+        regressions = compare(results, baseline)
+
+    if failures or regressions:
+        bar = "!" * 72
+        print("\n%s\nE2E PERFORMANCE CHECK FAILED" % bar, file=sys.stderr)
+        for line in failures:
+            print("  FAILURE     " + line, file=sys.stderr)
+        for line in regressions:
+            print("  REGRESSION  " + line, file=sys.stderr)
+        print(bar, file=sys.stderr)
+        return 1
+    log("\ne2e: all scenarios within tolerance")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
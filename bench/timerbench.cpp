@@ -0,0 +1,119 @@
+/*
+ * @file timerbench.cpp
+ * @brief HeapTimer 与 TimeWheel 的性能对比
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include <random>
+#include "bench.h"
+#include "../code/timer/heaptimer.h"
+#include "../code/timer/timewheel.h"
+
+/* 超时时间：add/adjust 用 1~60s 的随机值，模拟 keep-alive 连接；expire 用 0~50ms，方便等待全部过期 */
+static std::vector<int> RandomTimeouts(size_t n, int lo, int hi, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> dist(lo, hi);
+    std::vector<int> res(n);
+    for(auto& t: res) { t = dist(rng); }
+    return res;
+}
+
+// 空闲 tick：定时器里有 n 个都没到期的连接，epoll 每轮循环都要调用一次
+static const size_t IDLE_TICKS = 100000;
+
+static void BenchHeapTimer(BenchRunner& bench, size_t n) {
+    TimeoutCallBack cb = [] {};
+    std::vector<int> timeouts = RandomTimeouts(n, 1000, 60000, 12345);
+    std::vector<int> refresh = RandomTimeouts(n, 1000, 60000, 54321);
+    std::vector<int> shortTimeouts = RandomTimeouts(n, 0, 50, 12345);
+    std::string suffix = "/n=" + std::to_string(n);
+
+    bench.RunTimed("heaptimer/add" + suffix, n, [&](size_t ops) {
+        HeapTimer timer;
+        auto start = BenchRunner::Clock::now();
+        for(size_t i = 0; i < ops; i++) { timer.add(i, timeouts[i], cb); }
+        return BenchRunner::NsSince(start);
+    });
+    bench.RunTimed("heaptimer/adjust" + suffix, n, [&](size_t ops) {
+        HeapTimer timer;
+        for(size_t i = 0; i < ops; i++) { timer.add(i, timeouts[i], cb); }
+        auto start = BenchRunner::Clock::now();
+        for(size_t i = 0; i < ops; i++) { timer.adjust(i, refresh[i]); }
+        return BenchRunner::NsSince(start);
+    });
+    bench.RunTimed("heaptimer/expire" + suffix, n, [&](size_t ops) {
+        HeapTimer timer;
+        for(size_t i = 0; i < ops; i++) { timer.add(i, shortTimeouts[i], cb); }
+        usleep(60 * 1000);
+        auto start = BenchRunner::Clock::now();
+        timer.tick();
+        return BenchRunner::NsSince(start);
+    });
+    bench.RunTimed("heaptimer/tick_idle" + suffix, bench.Scale(IDLE_TICKS), [&](size_t ops) {
+        HeapTimer timer;
+        for(size_t i = 0; i < n; i++) { timer.add(i, timeouts[i], cb); }
+        auto start = BenchRunner::Clock::now();
+        for(size_t i = 0; i < ops; i++) { timer.tick(); }
+        return BenchRunner::NsSince(start);
+    });
+}
+
+static void BenchTimeWheel(BenchRunner& bench, size_t n) {
+    TimeoutCallBack cb = [] {};
+    std::vector<int> timeouts = RandomTimeouts(n, 1000, 60000, 12345);
+    std::vector<int> refresh = RandomTimeouts(n, 1000, 60000, 54321);
+    std::vector<int> shortTimeouts = RandomTimeouts(n, 0, 50, 12345);
+    std::string suffix = "/n=" + std::to_string(n);
+
+    bench.RunTimed("timewheel/add" + suffix, n, [&](size_t ops) {
+        TimeWheel timer;
+        std::vector<TimeWheelNode> nodes(ops);
+        auto start = BenchRunner::Clock::now();
+        for(size_t i = 0; i < ops; i++) { timer.add(&nodes[i], timeouts[i], cb); }
+        int64_t ns = BenchRunner::NsSince(start);
+        timer.clear();
+        return ns;
+    });
+    bench.RunTimed("timewheel/adjust" + suffix, n, [&](size_t ops) {
+        TimeWheel timer;
+        std::vector<TimeWheelNode> nodes(ops);
+        for(size_t i = 0; i < ops; i++) { timer.add(&nodes[i], timeouts[i], cb); }
+        auto start = BenchRunner::Clock::now();
+        for(size_t i = 0; i < ops; i++) { timer.adjust(&nodes[i], refresh[i]); }
+        int64_t ns = BenchRunner::NsSince(start);
+        timer.clear();
+        return ns;
+    });
+    bench.RunTimed("timewheel/expire" + suffix, n, [&](size_t ops) {
+        TimeWheel timer;
+        std::vector<TimeWheelNode> nodes(ops);
+        for(size_t i = 0; i < ops; i++) { timer.add(&nodes[i], shortTimeouts[i], cb); }
+        usleep(60 * 1000);
+        auto start = BenchRunner::Clock::now();
+        timer.tick();
+        return BenchRunner::NsSince(start);
+    });
+    bench.RunTimed("timewheel/tick_idle" + suffix, bench.Scale(IDLE_TICKS), [&](size_t ops) {
+        TimeWheel timer;
+        std::vector<TimeWheelNode> nodes(n);
+        for(size_t i = 0; i < n; i++) { timer.add(&nodes[i], timeouts[i], cb); }
+        auto start = BenchRunner::Clock::now();
+        for(size_t i = 0; i < ops; i++) { timer.tick(); }
+        int64_t ns = BenchRunner::NsSince(start);
+        timer.clear();
+        return ns;
+    });
+}
+
+int main(int argc, char* argv[]) {
+    BenchRunner bench("timerbench", argc, argv);
+    std::vector<size_t> sizes = { 10000, 100000, 1000000 };
+    if(bench.Quick()) { sizes = { 10000 }; }
+    for(size_t n: sizes) {
+        BenchHeapTimer(bench, n);
+        BenchTimeWheel(bench, n);
+    }
+    return 0;
+}
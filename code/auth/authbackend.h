@@ -0,0 +1,46 @@
+/*
+ * @file authbackend.h
+ * @brief AuthBackend接口（用户数据的存储后端）
+ */
+#ifndef AUTHBACKEND_H
+#define AUTHBACKEND_H
+
+#include <string>
+#include <functional>
+
+/*
+ * 登录/注册用到的用户数据存储，HttpRequest::UserVerify 只通过这个接口查询和写入：
+ *   SqlAuth       MySQL，在工作线程里用 SqlConnPool 阻塞查询
+ *   SqlAsyncAuth  MySQL，交给事件循环里的 SqlAsync 非阻塞查询
+ *   LocalAuth     本地追加写文件 + 内存散列索引，不依赖任何外部服务
+ * CredCache 挡在所有后端前面，后端只处理缓存未命中和注册
+ */
+class AuthBackend {
+public:
+    // 一次查询的结果
+    struct User {
+        bool ok = false;        // 查询成功
+        bool exists = false;    // 用户存在
+        std::string pwd;        // 存在时为密码
+    };
+    // 一次注册的结果
+    enum ADD_RESULT {
+        ADD_OK = 0,
+        ADD_DUPLICATE,      // 用户名已存在
+        ADD_FAILED,         // 存储出错
+    };
+    typedef std::function<void(const User&)> FindCallback;
+    typedef std::function<void(ADD_RESULT)> AddCallback;
+
+    virtual ~AuthBackend() {}
+
+    // 回调是否在事件循环（主线程）里执行。为 false 时回调在调用线程或后端自己的线程里执行，
+    // 调用方（工作线程）可以阻塞等结果
+    virtual bool Async() const = 0;
+    virtual const char* Name() const = 0;
+
+    virtual void FindUser(const std::string& name, FindCallback cb) = 0;
+    virtual void AddUser(const std::string& name, const std::string& pwd, AddCallback cb) = 0;
+};
+
+#endif // AUTHBACKEND_H
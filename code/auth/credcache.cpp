@@ -0,0 +1,180 @@
+/*
+ * @file credcache.cpp
+ * @brief CredCache类（登录凭据缓存）
+ */
+#include "credcache.h"
+#include <assert.h>
+#include <random>
+#include "../timer/coarseclock.h"
+using namespace std;
+
+namespace {
+inline uint64_t Rotl(uint64_t x, int b) { return (x << b) | (x >> (64 - b)); }
+
+inline void SipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+    v0 += v1; v1 = Rotl(v1, 13); v1 ^= v0; v0 = Rotl(v0, 32);
+    v2 += v3; v3 = Rotl(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = Rotl(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = Rotl(v1, 17); v1 ^= v2; v2 = Rotl(v2, 32);
+}
+
+// SipHash-2-4
+uint64_t SipHash(const uint64_t key[2], const unsigned char* in, size_t len) {
+    uint64_t v0 = 0x736f6d6570736575ull ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dull ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ull ^ key[0];
+    uint64_t v3 = 0x7465646279746573ull ^ key[1];
+    const unsigned char* end = in + (len & ~static_cast<size_t>(7));
+    for(; in != end; in += 8) {
+        uint64_t m = 0;
+        for(int i = 0; i < 8; i++) { m |= static_cast<uint64_t>(in[i]) << (8 * i); }
+        v3 ^= m;
+        SipRound(v0, v1, v2, v3);
+        SipRound(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    uint64_t b = static_cast<uint64_t>(len) << 56;
+    for(size_t i = 0; i < (len & 7); i++) { b |= static_cast<uint64_t>(in[i]) << (8 * i); }
+    v3 ^= b;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 ^= b;
+    v2 ^= 0xff;
+    for(int i = 0; i < 4; i++) { SipRound(v0, v1, v2, v3); }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+}
+
+CredCache::CredCache(): shardCapacity_(0), ttlMs_(0), negTtlMs_(0) {
+    random_device rd;
+    key_[0] = (static_cast<uint64_t>(rd()) << 32) | rd();
+    key_[1] = (static_cast<uint64_t>(rd()) << 32) | rd();
+    for(Shard& shard: shards_) {
+        LockName(shard.mtx, "credcache");
+    }
+}
+
+CredCache* CredCache::Instance() {
+    static CredCache cache;
+    return &cache;
+}
+
+void CredCache::Init(size_t capacity, int ttlMs, int negTtlMs) {
+    /* 容量平均分到各分片，不足一片一条时按一条算 */
+    shardCapacity_ = capacity == 0 ? 0 : (capacity + SHARD_NUM - 1) / SHARD_NUM;
+    ttlMs_ = ttlMs > 0 ? ttlMs : 0;
+    negTtlMs_ = negTtlMs > 0 ? negTtlMs : 0;
+    for(Shard& shard: shards_) {
+        lock_guard<Mutex> locker(shard.mtx);
+        shard.lru.clear();
+        shard.index.clear();
+        shard.size = 0;
+    }
+}
+
+uint64_t CredCache::Hash(const std::string& pwd) const {
+    return SipHash(key_, reinterpret_cast<const unsigned char*>(pwd.data()), pwd.size());
+}
+
+void CredCache::Erase_(Shard& shard, std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it) {
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+    shard.size--;
+}
+
+void CredCache::Lookup(const std::string& name, Waiter waiter, const std::function<void()>& load) {
+    Shard& shard = ShardOf_(name);
+    UserInfo info;
+    {
+        unique_lock<Mutex> locker(shard.mtx);
+        auto it = shard.index.find(name);
+        if(it != shard.index.end()) {
+            Entry& entry = *it->second;
+            if(entry.expireMs > CoarseClock::NowMs()) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                info.ok = true;
+                info.exists = entry.exists;
+                info.hash = entry.hash;
+                (entry.exists ? shard.hits : shard.negHits)++;
+            } else {
+                Erase_(shard, it);
+            }
+        }
+        if(!info.ok) {
+            /* 未命中：已经有人在查就排队，否则自己去查 */
+            auto fit = shard.flights.find(name);
+            if(fit != shard.flights.end()) {
+                fit->second.waiters.push_back(std::move(waiter));
+                shard.coalesced++;
+                return;
+            }
+            shard.flights[name].waiters.push_back(std::move(waiter));
+            shard.misses++;
+        }
+    }
+    /* 回调和查库都在锁外执行 */
+    if(info.ok) {
+        waiter(info);
+    } else {
+        load();
+    }
+}
+
+void CredCache::Fill(const std::string& name, bool ok, bool exists, const std::string& pwd) {
+    Shard& shard = ShardOf_(name);
+    UserInfo info;
+    info.ok = ok;
+    info.exists = ok && exists;
+    info.hash = info.exists ? Hash(pwd) : 0;
+    vector<Waiter> waiters;
+    {
+        lock_guard<Mutex> locker(shard.mtx);
+        auto fit = shard.flights.find(name);
+        bool stale = false;
+        if(fit != shard.flights.end()) {
+            waiters.swap(fit->second.waiters);
+            stale = fit->second.stale;
+            shard.flights.erase(fit);
+        }
+        int ttl = info.exists ? ttlMs_ : negTtlMs_;
+        if(ok && !stale && shardCapacity_ > 0 && ttl > 0) {
+            auto it = shard.index.find(name);
+            if(it != shard.index.end()) { Erase_(shard, it); }
+            while(shard.size >= shardCapacity_) {
+                /* 从 LRU 表尾挤掉最久没用的 */
+                Erase_(shard, shard.index.find(shard.lru.back().name));
+                shard.evictions++;
+            }
+            shard.lru.push_front(Entry{name, info.exists, info.hash, CoarseClock::NowMs() + ttl});
+            shard.index[name] = shard.lru.begin();
+            shard.size++;
+        }
+    }
+    for(Waiter& waiter: waiters) {
+        waiter(info);
+    }
+}
+
+void CredCache::Invalidate(const std::string& name) {
+    Shard& shard = ShardOf_(name);
+    lock_guard<Mutex> locker(shard.mtx);
+    auto it = shard.index.find(name);
+    if(it != shard.index.end()) { Erase_(shard, it); }
+    auto fit = shard.flights.find(name);
+    if(fit != shard.flights.end()) { fit->second.stale = true; }
+    shard.invalidations++;
+}
+
+CredCache::Stats CredCache::GetStats() const {
+    Stats stats = {0, 0, 0, 0, 0, 0, 0};
+    for(const Shard& shard: shards_) {
+        stats.hits += shard.hits.load(memory_order_relaxed);
+        stats.negHits += shard.negHits.load(memory_order_relaxed);
+        stats.misses += shard.misses.load(memory_order_relaxed);
+        stats.coalesced += shard.coalesced.load(memory_order_relaxed);
+        stats.evictions += shard.evictions.load(memory_order_relaxed);
+        stats.invalidations += shard.invalidations.load(memory_order_relaxed);
+        stats.size += shard.size.load(memory_order_relaxed);
+    }
+    return stats;
+}
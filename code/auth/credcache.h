@@ -0,0 +1,107 @@
+/*
+ * @file credcache.h
+ * @brief CredCache类（登录凭据缓存）
+ */
+#ifndef CREDCACHE_H
+#define CREDCACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "../metrics/lockprof.h"
+#include <unordered_map>
+
+/*
+ * 查库结果的进程内缓存，挡在 UserVerify 前面：
+ *   用户名 -> 密码散列（存在） / 不存在（负缓存），带过期时间，按用户名分片，每片一把锁、一条 LRU 链
+ *   同一用户名的并发未命中合并成一次查库：第一个调用者负责查，其余的挂在同一个 flight 上等结果
+ *   注册成功后调用 Invalidate，正在进行的查库结果也不再写入缓存
+ * 缓存里只存密码的带密钥散列（SipHash，密钥每个进程随机生成），不存明文
+ */
+class CredCache {
+public:
+    // 一次查询的结果
+    struct UserInfo {
+        bool ok = false;        // 查询成功（缓存命中或查库成功）
+        bool exists = false;    // 用户存在
+        uint64_t hash = 0;      // 存在时为密码散列
+    };
+    typedef std::function<void(const UserInfo&)> Waiter;
+
+    struct Stats {
+        uint64_t hits;          // 命中（用户存在）
+        uint64_t negHits;       // 命中负缓存（用户不存在）
+        uint64_t misses;        // 未命中，由本次调用查库
+        uint64_t coalesced;     // 未命中，但合并到了别人正在进行的查库上
+        uint64_t evictions;     // 容量满了被挤掉的条目
+        uint64_t invalidations;
+        size_t size;
+    };
+
+    static CredCache* Instance();
+
+    // capacity 为 0 时不缓存，只合并并发查库。ttlMs / negTtlMs 为存在 / 不存在条目的有效期
+    void Init(size_t capacity, int ttlMs, int negTtlMs);
+
+    // 查询 name：命中时立即以结果调用 waiter；未命中时 waiter 挂到该用户名的 flight 上，
+    // 只有第一个未命中的调用者会执行 load，load 负责查库并最终调用 Fill
+    void Lookup(const std::string& name, Waiter waiter, const std::function<void()>& load);
+
+    // 查库完成：ok 为 false 表示查询失败，不写缓存。以结果调用该用户名上所有等待者
+    void Fill(const std::string& name, bool ok, bool exists, const std::string& pwd);
+
+    // 用户数据变化（注册）后调用
+    void Invalidate(const std::string& name);
+
+    // 密码与查询结果是否匹配
+    bool Match(const UserInfo& info, const std::string& pwd) const {
+        return info.ok && info.exists && Hash(pwd) == info.hash;
+    }
+    uint64_t Hash(const std::string& pwd) const;
+
+    Stats GetStats() const;
+
+private:
+    CredCache();
+    ~CredCache() = default;
+
+    struct Entry {
+        std::string name;
+        bool exists;
+        uint64_t hash;
+        int64_t expireMs;
+    };
+
+    // 同一用户名上正在进行的一次查库
+    struct Flight {
+        std::vector<Waiter> waiters;
+        bool stale = false;     // 查库期间被 Invalidate，结果只交给等待者，不写缓存
+    };
+
+    struct Shard {
+        Mutex mtx;
+        std::list<Entry> lru;   // 表头最近使用
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        std::unordered_map<std::string, Flight> flights;
+        std::atomic<uint64_t> hits{0}, negHits{0}, misses{0}, coalesced{0}, evictions{0}, invalidations{0};
+        std::atomic<size_t> size{0};
+    };
+
+    static const int SHARD_NUM = 16;
+
+    Shard& ShardOf_(const std::string& name) { return shards_[std::hash<std::string>()(name) % SHARD_NUM]; }
+    // 持有 shard 锁时调用
+    void Erase_(Shard& shard, std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it);
+
+    Shard shards_[SHARD_NUM];
+    size_t shardCapacity_;
+    int ttlMs_;
+    int negTtlMs_;
+    uint64_t key_[2];
+};
+
+#endif // CREDCACHE_H
@@ -0,0 +1,164 @@
+/*
+ * @file localauth.cpp
+ * @brief LocalAuth类（本地文件用户存储）
+ */
+#include "localauth.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <zlib.h>
+#include "../log/log.h"
+using namespace std;
+
+namespace {
+const char MAGIC[8] = {'T', 'W', 'S', 'A', 'U', 'T', 'H', '1'};
+// crc32 + name 长度 + pwd 长度
+const size_t HEADER = 12;
+
+uint32_t Checksum(const char* p, size_t len) {
+    return static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef*>(p), static_cast<uInt>(len)));
+}
+}
+
+LocalAuth::LocalAuth(): fd_(-1), fileSize_(0) {
+    LockName(mtx_, "localauth");
+}
+
+LocalAuth::~LocalAuth() {
+    if(fd_ >= 0) { close(fd_); }
+}
+
+bool LocalAuth::Init(const char* path) {
+    assert(path);
+    lock_guard<Mutex> locker(mtx_);
+    fd_ = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if(fd_ < 0) {
+        LOG_ERROR("LocalAuth open %s error: %s", path, strerror(errno));
+        return false;
+    }
+    string data;
+    char buf[64 * 1024];
+    ssize_t len;
+    while((len = read(fd_, buf, sizeof(buf))) > 0) {
+        data.append(buf, len);
+    }
+    if(len < 0) {
+        LOG_ERROR("LocalAuth read %s error: %s", path, strerror(errno));
+        return false;
+    }
+    if(data.empty()) {
+        /* 新文件，写入魔数 */
+        if(write(fd_, MAGIC, sizeof(MAGIC)) != static_cast<ssize_t>(sizeof(MAGIC))) {
+            LOG_ERROR("LocalAuth write %s error: %s", path, strerror(errno));
+            return false;
+        }
+        fileSize_ = sizeof(MAGIC);
+        return true;
+    }
+    if(data.size() < sizeof(MAGIC) || memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0) {
+        LOG_ERROR("LocalAuth %s is not a user store", path);
+        return false;
+    }
+    size_t end = 0;
+    if(!Replay_(data, &end)) {
+        /* 中间的记录损坏：截掉会连带删除它之后的所有用户，交给人来处理 */
+        LOG_ERROR("LocalAuth %s: corrupted record at offset %zu, refusing to start", path, end);
+        return false;
+    }
+    if(end < data.size()) {
+        /* 最后一条没写完整，截掉，之后的追加从完整记录后面开始 */
+        LOG_WARN("LocalAuth %s: drop %zu bytes of torn record", path, data.size() - end);
+        if(ftruncate(fd_, end) < 0) {
+            LOG_ERROR("LocalAuth truncate %s error: %s", path, strerror(errno));
+            return false;
+        }
+    }
+    fileSize_ = end;
+    LOG_INFO("LocalAuth %s: %zu users", path, users_.size());
+    return true;
+}
+
+bool LocalAuth::Replay_(const std::string& data, size_t* end) {
+    size_t off = sizeof(MAGIC);
+    while(off < data.size()) {
+        /* 剩下的不够一个记录头，或者声明的长度超出文件末尾：写到一半的最后一条 */
+        if(off + HEADER > data.size()) { break; }
+        uint32_t header[3];
+        memcpy(header, data.data() + off, HEADER);
+        uint32_t nameLen = header[1], pwdLen = header[2];
+        /* 长度本身不合法说明记录头坏了，不能拿它判断是不是写到一半：当作中间损坏 */
+        if(nameLen == 0 || nameLen > MAX_FIELD || pwdLen > MAX_FIELD) {
+            *end = off;
+            return false;
+        }
+        size_t next = off + HEADER + nameLen + pwdLen;
+        if(next > data.size()) { break; }
+        /* 校验覆盖长度和内容。校验不过的如果正好是最后一条，同样当作没写完整 */
+        const char* body = data.data() + off + 4;
+        if(Checksum(body, HEADER - 4 + nameLen + pwdLen) != header[0]) {
+            *end = off;
+            return next == data.size();
+        }
+        body += HEADER - 4;
+        users_[string(body, nameLen)] = string(body + nameLen, pwdLen);
+        off = next;
+    }
+    *end = off;
+    return true;
+}
+
+bool LocalAuth::Append_(const std::string& name, const std::string& pwd) {
+    uint32_t header[3] = {0, static_cast<uint32_t>(name.size()), static_cast<uint32_t>(pwd.size())};
+    string record(HEADER, '\0');
+    record += name;
+    record += pwd;
+    memcpy(&record[0], header, HEADER);
+    header[0] = Checksum(record.data() + 4, record.size() - 4);
+    memcpy(&record[0], header, 4);
+    /* 一次 write 追加整条记录，写了一半时截回去，不留下坏记录 */
+    ssize_t len = write(fd_, record.data(), record.size());
+    if(len != static_cast<ssize_t>(record.size())) {
+        LOG_ERROR("LocalAuth append error: %s", len < 0 ? strerror(errno) : "short write");
+        if(len > 0 && ftruncate(fd_, fileSize_) < 0) {
+            LOG_ERROR("LocalAuth truncate error: %s", strerror(errno));
+        }
+        return false;
+    }
+    fileSize_ += record.size();
+    return true;
+}
+
+void LocalAuth::FindUser(const std::string& name, FindCallback cb) {
+    User user;
+    {
+        lock_guard<Mutex> locker(mtx_);
+        user.ok = fd_ >= 0;
+        auto it = users_.find(name);
+        if(it != users_.end()) {
+            user.exists = true;
+            user.pwd = it->second;
+        }
+    }
+    cb(user);
+}
+
+void LocalAuth::AddUser(const std::string& name, const std::string& pwd, AddCallback cb) {
+    ADD_RESULT result = ADD_FAILED;
+    if(!name.empty() && name.size() <= MAX_FIELD && pwd.size() <= MAX_FIELD) {
+        lock_guard<Mutex> locker(mtx_);
+        if(users_.count(name)) {
+            result = ADD_DUPLICATE;
+        } else if(fd_ >= 0 && Append_(name, pwd)) {
+            users_[name] = pwd;
+            result = ADD_OK;
+        }
+    }
+    cb(result);
+}
+
+size_t LocalAuth::Size() {
+    lock_guard<Mutex> locker(mtx_);
+    return users_.size();
+}
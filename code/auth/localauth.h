@@ -0,0 +1,56 @@
+/*
+ * @file localauth.h
+ * @brief LocalAuth类（本地文件用户存储）
+ */
+#ifndef LOCALAUTH_H
+#define LOCALAUTH_H
+
+#include <stdint.h>
+#include <string>
+#include <mutex>
+#include "../metrics/lockprof.h"
+#include <unordered_map>
+#include "authbackend.h"
+
+/*
+ * 嵌入式用户存储：只追加的数据文件 + 内存散列索引，不需要数据库就能登录/注册
+ *   文件开头是 8 字节魔数，之后每条记录为 [crc32][name 长度][pwd 长度][name][pwd]，整数为本机字节序
+ *   启动时顺序重放整个文件建立索引；末尾写了一半（崩溃）的记录截掉，
+ *   中间的记录校验不过时拒绝启动，不会为了一个坏字节删掉它之后的所有用户
+ *   注册时整条记录一次 write 追加（O_APPEND），进程崩溃不会丢已返回成功的注册，
+ *   但没有 fdatasync，掉电可能丢最近的几条
+ * 查询和注册都在调用线程里同步完成
+ */
+class LocalAuth: public AuthBackend {
+public:
+    LocalAuth();
+    ~LocalAuth();
+
+    // 打开（不存在则创建）path 并重放，失败返回 false
+    bool Init(const char* path);
+
+    bool Async() const override { return false; }
+    const char* Name() const override { return "local"; }
+
+    void FindUser(const std::string& name, FindCallback cb) override;
+    void AddUser(const std::string& name, const std::string& pwd, AddCallback cb) override;
+
+    size_t Size();
+
+    // 用户名、密码的最大长度
+    static const uint32_t MAX_FIELD = 4096;
+
+private:
+    // 重放整个文件的内容 data，end 为最后一条完整记录的结尾
+    // 只有最后一条记录写到一半（长度超出文件末尾，或者校验不过且后面没有数据）才算正常，中间的记录损坏返回 false
+    bool Replay_(const std::string& data, size_t* end);
+    // 持有 mtx_ 时调用
+    bool Append_(const std::string& name, const std::string& pwd);
+
+    int fd_;
+    size_t fileSize_;
+    Mutex mtx_;
+    std::unordered_map<std::string, std::string> users_;
+};
+
+#endif // LOCALAUTH_H
@@ -9,6 +9,9 @@ Config::Config(){
     
     // 超时时间，单位是毫秒ms，默认为60000
     timeoutMS_ = 60000;
+
+    // 惰性超时，默认打开
+    lazyTimer_ = true;
     
     // 优雅关闭链接，默认为false
     OptLinger_ = false;
@@ -27,9 +30,34 @@ Config::Config(){
     
     // 数据库连接池数量，默认为12
     sqlNum_ = 12;
+
+    // 数据库连接池最大容量，默认为24
+    sqlMaxNum_ = 24;
+
+    // 取数据库连接最多等待3000ms
+    sqlWaitMs_ = 3000;
+
+    // 默认启动时等数据库连接（并行）建好再监听
+    sqlLazyWarmup_ = false;
     
     // 线程池数量，默认为6
     threadNum_ = 6;
+
+    // 注册写入组提交的窗口，默认为2ms
+    sqlBatchMs_ = 2;
+
+    // 非阻塞查库的连接数，默认为8。客户端库不支持非阻塞接口时自动退回阻塞查询
+    sqlAsyncNum_ = 8;
+
+    // 用户存储后端，默认为 MySQL
+    authBackend_ = WebServer::AUTH_MYSQL;
+
+    // 本地用户存储的文件，默认为 ./users.db
+    authFile_ = "./users.db";
+
+    // 登录凭据缓存，默认10万条，有效期60秒
+    credCacheSize_ = 100000;
+    credCacheTtl_ = 60;
     
     // 日志开关，默认打开
     openLog_ = true;
@@ -39,11 +67,53 @@ Config::Config(){
     
     // 日志队列大小，大于0为异步，小于等于0为同步，默认为1024
     logQueSize_ = 1024;
+
+    // 异步日志环形缓冲区写满时的策略，默认丢弃，请求线程不会被日志阻塞
+    logFullPolicy_ = Log::FULL_DROP;
+
+    // 日志组提交的最长间隔，默认为100ms
+    logFlushMs_ = 100;
+
+    // 日志组提交攒够的字节数，默认为64KB
+    logFlushKB_ = 64;
+
+    // 日志组提交后默认不 fdatasync
+    logDurability_ = Log::DURABLE_OS;
+
+    // 日志格式，默认为文本
+    logFormat_ = Log::FORMAT_TEXT;
+
+    // 模块日志等级，默认全部跟随日志等级
+    logModules_ = "";
+
+    // 单个日志文件默认最大32MB
+    logFileMB_ = 32;
+
+    // 默认按天翻滚
+    logPeriodSec_ = 86400;
+
+    // 默认压缩旧日志
+    logCompress_ = true;
+
+    // 默认不限制文件数，总大小不超过1GB
+    logKeepFiles_ = 0;
+    logKeepMB_ = 1024;
+
+    // 访问日志，默认打开，但只抽样1%的普通请求，主要靠200ms的慢请求阈值触发，热路径上几乎不写日志
+    accessLog_ = true;
+    accessSample_ = 0.01;
+    accessSlowMs_ = 200;
+
+    // 指标导出路径，默认为 /metrics，只对本机（回环地址）的抓取方开放
+    metricsPath_ = "/metrics";
+
+    // 请求追踪，默认关闭。追踪记录里有其他客户端的请求路径和耗时，排查问题时用 -N 4096 打开，SIGUSR2 导出到 ./log/trace
+    traceRing_ = 0;
 }
 
 void Config::parse_arg(int argc, char*argv[]){
     int opt;
-    const char *str = "p:m:o:s:t:l:e:q:"; // 包含正确的参数选项字符串，用于参数的解析，带冒号必须有参数
+    const char *str = "p:m:o:s:t:l:e:q:z:F:f:g:d:b:M:r:P:c:k:K:A:a:S:D:U:T:X:W:L:B:H:G:Y:N:I:"; // 包含正确的参数选项字符串，用于参数的解析，带冒号必须有参数
     while ((opt = getopt(argc, argv, str)) != -1)	// 分析命令行参数
     {
         switch (opt)
@@ -88,6 +158,144 @@ void Config::parse_arg(int argc, char*argv[]){
             logQueSize_ = atoi(optarg);
             break;
         }
+        case 'z':
+        {
+            lazyTimer_ = (atoi(optarg)==1);
+            break;
+        }
+        case 'F':
+        {
+            logFullPolicy_ = (atoi(optarg)==1) ? Log::FULL_BLOCK : Log::FULL_DROP;
+            break;
+        }
+        case 'f':
+        {
+            logFlushMs_ = atoi(optarg);
+            break;
+        }
+        case 'g':
+        {
+            logFlushKB_ = atoi(optarg);
+            break;
+        }
+        case 'd':
+        {
+            logDurability_ = (atoi(optarg)==1) ? Log::DURABLE_FSYNC : Log::DURABLE_OS;
+            break;
+        }
+        case 'b':
+        {
+            logFormat_ = atoi(optarg);
+            if(logFormat_ < Log::FORMAT_TEXT || logFormat_ > Log::FORMAT_DEFERRED) {
+                logFormat_ = Log::FORMAT_TEXT;
+            }
+            break;
+        }
+        case 'M':
+        {
+            logModules_ = optarg;
+            break;
+        }
+        case 'r':
+        {
+            logFileMB_ = atoi(optarg);
+            break;
+        }
+        case 'P':
+        {
+            logPeriodSec_ = atoi(optarg);
+            break;
+        }
+        case 'c':
+        {
+            logCompress_ = (atoi(optarg)==1);
+            break;
+        }
+        case 'k':
+        {
+            logKeepFiles_ = atoi(optarg);
+            break;
+        }
+        case 'K':
+        {
+            logKeepMB_ = atoi(optarg);
+            break;
+        }
+        case 'D':
+        {
+            sqlAsyncNum_ = atoi(optarg);
+            break;
+        }
+        case 'X':
+        {
+            sqlMaxNum_ = atoi(optarg);
+            break;
+        }
+        case 'W':
+        {
+            sqlWaitMs_ = atoi(optarg);
+            break;
+        }
+        case 'L':
+        {
+            sqlLazyWarmup_ = (atoi(optarg)==1);
+            break;
+        }
+        case 'G':
+        {
+            sqlBatchMs_ = atoi(optarg);
+            break;
+        }
+        case 'B':
+        {
+            authBackend_ = atoi(optarg);
+            break;
+        }
+        case 'H':
+        {
+            authFile_ = optarg;
+            break;
+        }
+        case 'Y':
+        {
+            metricsPath_ = optarg;
+            break;
+        }
+        case 'N':
+        {
+            traceRing_ = atoi(optarg);
+            break;
+        }
+        case 'I':
+        {
+            timeoutMS_ = atoi(optarg);
+            break;
+        }
+        case 'U':
+        {
+            credCacheSize_ = atoi(optarg);
+            break;
+        }
+        case 'T':
+        {
+            credCacheTtl_ = atoi(optarg);
+            break;
+        }
+        case 'A':
+        {
+            accessLog_ = (atoi(optarg)==1);
+            break;
+        }
+        case 'a':
+        {
+            accessSample_ = atof(optarg);
+            break;
+        }
+        case 'S':
+        {
+            accessSlowMs_ = atoi(optarg);
+            break;
+        }
         default:
             break;
         }
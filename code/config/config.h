@@ -19,8 +19,11 @@ public:
     // 触发组合模式
     int trigMode_;
     
-    // 超时时间，单位是毫秒ms
+    // 空闲连接超时时间，单位是毫秒ms，0 不超时
     int timeoutMS_;
+
+    // 惰性超时，读写事件只记录活跃时刻，不调整定时器
+    bool lazyTimer_;
     
     // 优雅关闭链接
     bool OptLinger_;
@@ -37,11 +40,38 @@ public:
     // Mysql 数据库名
     const char* dbName_;
     
-    // 数据库连接池数量
+    // 数据库连接池数量（最小容量）
     int sqlNum_;
+
+    // 数据库连接池最大容量，连接不够用时按需增长到这么多
+    int sqlMaxNum_;
+
+    // 取数据库连接的最长等待时间，单位是毫秒ms
+    int sqlWaitMs_;
+
+    // 数据库连接在后台预热，不等连接建好就开始监听。认证请求等第一个建好的连接
+    bool sqlLazyWarmup_;
     
     // 线程池数量
     int threadNum_;
+
+    // 注册写入组提交的窗口，单位是毫秒ms，0 每条注册单独提交
+    int sqlBatchMs_;
+
+    // 非阻塞查库的连接数，0 表示登录/注册在工作线程里阻塞查询
+    int sqlAsyncNum_;
+
+    // 用户存储后端，0 MySQL，1 本地文件（不连接数据库）
+    int authBackend_;
+
+    // 本地用户存储的文件路径
+    const char* authFile_;
+
+    // 登录凭据缓存的条目数，0 不缓存（并发的同名查询仍会合并）
+    int credCacheSize_;
+
+    // 登录凭据缓存的有效期，单位是秒s。“用户不存在”的条目最多保留 5 秒
+    int credCacheTtl_;
     
     // 日志开关
     bool openLog_;
@@ -52,6 +82,54 @@ public:
     // 日志队列大小，大于0为异步，小于等于0为同步
     int logQueSize_;
 
+    // 异步日志环形缓冲区写满时的策略，0 丢弃并计数，1 阻塞等待
+    int logFullPolicy_;
+
+    // 日志组提交的最长间隔，单位是毫秒ms。崩溃时最多丢失大约这么久的日志
+    int logFlushMs_;
+
+    // 日志组提交攒够多少KB就提交一次，不等 logFlushMs_ 到期
+    int logFlushKB_;
+
+    // 日志组提交后是否 fdatasync，0 只写到页缓存，1 落盘
+    int logDurability_;
+
+    // 日志格式，0 文本，1 二进制（用 logdecode 解码），2 后台线程格式化。只在异步日志下生效
+    int logFormat_;
+
+    // 模块日志等级，形如 "http=0,pool=2"，未列出的模块跟随日志等级
+    const char* logModules_;
+
+    // 单个日志文件的大小上限，单位是MB，0 不限制
+    int logFileMB_;
+
+    // 日志翻滚周期，单位是秒，需整除一天
+    int logPeriodSec_;
+
+    // 是否压缩翻滚下来的日志
+    bool logCompress_;
+
+    // 最多保留的日志文件数，0 不限制
+    int logKeepFiles_;
+
+    // 日志文件总大小上限，单位是MB，0 不限制
+    int logKeepMB_;
+
+    // 访问日志开关（./log/access）
+    bool accessLog_;
+
+    // 访问日志抽样率，0~1
+    double accessSample_;
+
+    // 慢请求阈值，单位是毫秒ms，超过的请求不受抽样影响总会记录，0 不单独记录
+    int accessSlowMs_;
+
+    // 指标导出路径（Prometheus 文本格式），与网页共用监听端口但只响应回环地址的客户端，空字符串不导出
+    const char* metricsPath_;
+
+    // 请求追踪环保存的最近请求数，0 关闭追踪
+    int traceRing_;
+
 };
 
 #endif
@@ -0,0 +1,59 @@
+/*
+ * @file accesslog.cpp
+ * @brief AccessLog类（访问日志）
+ */
+#include "accesslog.h"
+#include "../log/log.h"
+#include <pthread.h>
+
+std::atomic<bool> AccessLog::enabled_(false);
+bool AccessLog::configured_ = false;
+double AccessLog::sampleRate_ = 1.0;
+int64_t AccessLog::slowUs_ = 0;
+
+namespace {
+// 每个线程一个 xorshift 生成器，抽样不需要加锁
+double SampleRandom() {
+    static thread_local uint64_t state = 0;
+    if(state == 0) {
+        state = static_cast<uint64_t>(CoarseClock::PreciseUs()) ^
+                (static_cast<uint64_t>(pthread_self()) * 0x9E3779B97F4A7C15ull);
+        if(state == 0) { state = 1; }
+    }
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (state >> 11) * (1.0 / 9007199254740992.0);
+}
+}
+
+void AccessLog::Configure(bool enable, double sampleRate, int slowMs) {
+    configured_ = enable;
+    sampleRate_ = sampleRate < 0 ? 0 : (sampleRate > 1 ? 1 : sampleRate);
+    slowUs_ = slowMs > 0 ? static_cast<int64_t>(slowMs) * 1000 : 0;
+}
+
+void AccessLog::Init() {
+    if(!configured_) { return; }
+    Log::AccessInstance()->init(1, "./log/access", ".log", QUEUE_SIZE);
+    enabled_ = true;
+}
+
+void AccessLog::Record(const char* ip, int port, const std::string& method, const std::string& path,
+                        int status, const AccessTiming& t, int64_t doneUs, bool aborted) {
+    int64_t first = t.firstByteUs ? t.firstByteUs : t.acceptUs;
+    int64_t total = doneUs - first;
+    bool slow = slowUs_ > 0 && total >= slowUs_;
+    if(!aborted && !slow && (sampleRate_ <= 0 || (sampleRate_ < 1 && SampleRandom() >= sampleRate_))) {
+        return;
+    }
+
+    /* 各阶段时刻都相对 accept 输出，未到达的阶段记为 -1 */
+    auto rel = [&t](int64_t us) -> long long { return us ? static_cast<long long>(us - t.acceptUs) : -1; };
+    Log::AccessInstance()->write(1, "%s:%d \"%s %s\" %d %zuB req=%d accept=%lld.%06lld "
+                                    "first=%lldus parse=%lldus ready=%lldus done=%lldus total=%lldus%s%s",
+            ip, port, method.c_str(), path.c_str(), status, t.respBytes, t.reqIndex,
+            static_cast<long long>(t.acceptWallUs / 1000000), static_cast<long long>(t.acceptWallUs % 1000000),
+            rel(t.firstByteUs), rel(t.parseUs), rel(t.readyUs), rel(doneUs),
+            static_cast<long long>(total), slow ? " slow" : "", aborted ? " aborted" : "");
+}
@@ -0,0 +1,60 @@
+/*
+ * @file accesslog.h
+ * @brief AccessLog类（访问日志）
+ */
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <atomic>
+
+// 一个请求在连接上的各个时刻（CoarseClock::PreciseUs，单调微秒），由 HttpConn 填写
+struct AccessTiming {
+    // 连接建立时刻，以及对应的墙上时间（微秒），只在 accept 时记录一次
+    int64_t acceptUs = 0;
+    int64_t acceptWallUs = 0;
+    // 本请求读到第一个字节、解析完成、响应准备好的时刻
+    int64_t firstByteUs = 0;
+    int64_t parseUs = 0;
+    int64_t readyUs = 0;
+    // 同一连接上的第几个请求（keep-alive），从 0 开始
+    int reqIndex = 0;
+    // 响应总字节数（响应头 + 文件）
+    size_t respBytes = 0;
+    // 响应已经准备好、还没写完
+    bool pending = false;
+};
+
+/*
+ * 访问日志：每个请求一行，写到 ./log/access 下，走 Log::AccessInstance() 的异步路径
+ * 一行包含客户端、方法、路径、状态码、字节数、keep-alive 序号，以及相对 accept 的各阶段时刻：
+ *   127.0.0.1:5000 "GET /index.html" 200 3120B req=0 accept=1700000000.123456 first=85us parse=120us ready=310us done=402us total=317us
+ * 抽样率决定普通请求记录的比例，耗时达到慢请求阈值或中途断开的请求总会被记录
+ */
+class AccessLog {
+public:
+    // 在 WebServer 初始化日志之前调用。sampleRate 为 0~1，slowMs 为 0 表示不单独记录慢请求
+    static void Configure(bool enable, double sampleRate, int slowMs);
+
+    // 打开访问日志文件，主日志 init 之后调用。总是异步写入：主日志用 -q 0 同步时，访问日志也不在请求线程上写文件
+    static void Init();
+
+    static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // 请求结束（写完或连接中途关闭）时调用，按抽样率/慢请求阈值决定是否写一行
+    static void Record(const char* ip, int port, const std::string& method, const std::string& path,
+                        int status, const AccessTiming& t, int64_t doneUs, bool aborted);
+
+private:
+    // 访问日志每个线程环形缓冲区的行数，与主日志的队列大小无关
+    static const int QUEUE_SIZE = 1024;
+
+    static std::atomic<bool> enabled_;
+    static bool configured_;
+    static double sampleRate_;
+    static int64_t slowUs_;
+};
+
+#endif // ACCESS_LOG_H
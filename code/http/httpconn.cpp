@@ -2,17 +2,40 @@
  * @file httpconn.cpp
  * @brief HttpConn类
  */ 
+#define LOG_MODULE Log::MOD_HTTP   // 本文件的日志属于 http 模块
 #include "httpconn.h"
+#include "../metrics/metrics.h"
 using namespace std;
 
 const char* HttpConn::srcDir;
 std::atomic<int> HttpConn::userCount;
 bool HttpConn::isET;
+AuthBackend* HttpConn::auth = nullptr;
+unordered_map<string, HttpConn::Page> HttpConn::pages_;
+
+namespace {
+MetricHistogram* const PARSE_US =
+    Metrics::Instance()->Histogram("tws_http_parse_us", "Time spent parsing one request, microseconds");
+MetricHistogram* const RESPONSE_BYTES =
+    Metrics::Instance()->Histogram("tws_http_response_bytes", "Response size including headers, bytes");
+MetricCounter* const BAD_REQUESTS =
+    Metrics::Instance()->Counter("tws_http_bad_requests_total", "Requests that failed to parse");
+}
+
+void HttpConn::AddPage(const string& path, const string& type, function<string()> render) {
+    assert(!path.empty() && render);
+    pages_[path] = Page{type, std::move(render)};
+}
 
 HttpConn::HttpConn() { 
     fd_ = -1;
     addr_ = { 0 };
     isClose_ = true;
+    lastActive_ = 0;
+    acceptMs_ = 0;
+    gen_ = 0;
+    waitingDb_ = false;
+    trace_.Clear();
 };
 
 HttpConn::~HttpConn() { 
@@ -27,14 +50,31 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
     writeBuff_.RetrieveAll();
     readBuff_.RetrieveAll();
     isClose_ = false;
+    gen_++;
+    waitingDb_ = false;
+    request_.Init();
+    acceptMs_ = CoarseClock::CachedMs();
+    timing_ = AccessTiming();
+    trace_.Clear();
+    if(AccessLog::Enabled()) {
+        struct timeval now;
+        gettimeofday(&now, nullptr);
+        timing_.acceptWallUs = static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_usec;
+        timing_.acceptUs = CoarseClock::PreciseUs();
+    }
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
 }
 
 void HttpConn::Close() {
+    if(isClose_ == false && timing_.pending) {
+        /* 响应没写完连接就断了 */
+        FinishRequest_(true);
+    }
     response_.UnmapFile();
     if(isClose_ == false){
         isClose_ = true; 
         userCount--;
+        TWS_PROBE3(close, fd_, timing_.reqIndex, CoarseClock::CachedMs() - acceptMs_);
         close(fd_);
         LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
     }
@@ -58,17 +98,25 @@ int HttpConn::GetPort() const {
 
 ssize_t HttpConn::read(int* saveErrno) {
     ssize_t len = -1;
+    bool traced = TraceRing::Instance()->Enabled();
+    if(traced) { trace_.StampOnce(ReqTrace::DEQUEUE); }
     do {
         len = readBuff_.ReadFd(fd_, saveErrno);
         if (len <= 0) {
             break;
         }
+        if(timing_.firstByteUs == 0 && AccessLog::Enabled()) {
+            timing_.firstByteUs = CoarseClock::PreciseUs();
+        }
     } while (isET);
+    TWS_PROBE3(read, fd_, len, *saveErrno);
     return len;
 }
 
 ssize_t HttpConn::write(int* saveErrno) {
     ssize_t len = -1;
+    bool traced = TraceRing::Instance()->Enabled();
+    size_t written = 0;
     // 在 ET (Edge Triggered) 模式下，epoll 只会在状态变化时通知一次。如果一次 writev 没发完，你必须循环调用 write 直到返回 EAGAIN（表示缓冲区满）或者数据发完，否则该 Socket 可能会“死掉”（再也不触发写事件）
     do {
         // 聚集写
@@ -79,6 +127,8 @@ ssize_t HttpConn::write(int* saveErrno) {
             *saveErrno = errno;
             break;
         }
+        written += len;
+        if(traced) { trace_.Write(len); }
         if(iov_[0].iov_len + iov_[1].iov_len  == 0) { break; } /* 传输结束 */
         else if(static_cast<size_t>(len) > iov_[0].iov_len) {	// 第一部分（Header）已全发完，正在发第二部分（File）
             iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
@@ -95,23 +145,108 @@ ssize_t HttpConn::write(int* saveErrno) {
         }
     } while(isET || ToWriteBytes() > 10240);
     // ToWriteBytes() > 10240：这是一个性能优化。如果剩余待发数据非常多（超过 10KB），即便不是 ET 模式，也尝试在当前循环多发一点，减少回到 epoll_wait 的次数
+    TWS_PROBE3(write, fd_, written, ToWriteBytes());
+    if(ToWriteBytes() == 0 && timing_.pending) {
+        FinishRequest_(false);
+    }
     return len;
 }
 
+void HttpConn::FinishRequest_(bool aborted) {
+    timing_.pending = false;
+    if(AccessLog::Enabled()) {
+        AccessLog::Record(GetIP(), GetPort(), request_.method(), request_.path(), response_.Code(),
+                            timing_, CoarseClock::PreciseUs(), aborted);
+    }
+    TraceRing* ring = TraceRing::Instance();
+    if(ring->Enabled()) {
+        trace_.fd = fd_;
+        trace_.reqIndex = timing_.reqIndex;
+        trace_.respBytes = static_cast<uint32_t>(timing_.respBytes);
+        trace_.code = static_cast<uint16_t>(response_.Code());
+        trace_.aborted = aborted;
+        trace_.SetPath(request_.path());
+        ring->Push(trace_);
+        trace_.Clear();
+    }
+    timing_.reqIndex++;
+    timing_.firstByteUs = timing_.parseUs = timing_.readyUs = 0;
+    timing_.respBytes = 0;
+}
+
 bool HttpConn::process() {
-    request_.Init();
+    if(!request_.BodyPending()) {
+        request_.Init();
+    }
     if(readBuff_.ReadableBytes() <= 0) {
         return false;
     }
-    else if(request_.parse(readBuff_)) {	// 调用 request_.parse(readBuff_) 解析请求
+    bool timed = AccessLog::Enabled();
+    int64_t parseStart = CoarseClock::PreciseUs();
+    if(timed && timing_.firstByteUs == 0) {
+        /* keep-alive 流水线：下一个请求的数据在上一个响应写完之前就已经读进来了 */
+        timing_.firstByteUs = parseStart;
+    }
+    bool traced = TraceRing::Instance()->Enabled();
+    if(traced) { trace_.Stamp(ReqTrace::PARSE_BEGIN); }
+    bool parsed = request_.parse(readBuff_);
+    if(traced) { trace_.Stamp(ReqTrace::PARSE_END); }
+    int64_t parseEnd = CoarseClock::PreciseUs();
+    PARSE_US->Record(parseEnd - parseStart);
+    TWS_PROBE3(parse, fd_, parsed, parseEnd - parseStart);
+    if(timed) { timing_.parseUs = parseEnd; }
+    if(parsed && request_.BodyPending()) {
+        /* 请求体分几次到达：已解析的部分保留在 request_ 里，继续读 */
+        return false;
+    }
+    if(parsed && request_.AuthPending()) {
+        if(auth->Async()) {
+            /* 登录/注册交给事件循环里的非阻塞查询，结果回来后由 ResumeAuth 接着生成响应 */
+            waitingDb_ = true;
+            return false;
+        }
+        request_.Verify(auth);
+    }
+    return MakeResponse_(parsed);
+}
+
+void HttpConn::VerifyAsync(std::function<void(bool)> done) {
+    assert(waitingDb_ && auth);
+    request_.VerifyAsync(auth, std::move(done));
+}
+
+bool HttpConn::ResumeAuth(uint64_t gen, bool ok) {
+    if(isClose_ || gen != gen_ || !waitingDb_) {
+        /* 等待查库期间连接已经关闭（超时），槽位可能已经给了新连接 */
+        return false;
+    }
+    waitingDb_ = false;
+    request_.FinishAuth(ok);
+    return MakeResponse_(true);
+}
+
+bool HttpConn::IsLoopback_() const {
+    return (ntohl(addr_.sin_addr.s_addr) >> 24) == 127;
+}
+
+bool HttpConn::MakeResponse_(bool parsed) {
+    bool timed = AccessLog::Enabled();
+    auto page = pages_.end();
+    if(parsed) {	// 调用 request_.parse(readBuff_) 解析请求
         LOG_DEBUG("%s", request_.path().c_str());
         response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
+        if(!pages_.empty() && IsLoopback_()) { page = pages_.find(request_.path()); }
     } else {
+        BAD_REQUESTS->Add();
         response_.Init(srcDir, request_.path(), false, 400);
     }
 	
     // 如果解析完成，调用 response_.MakeResponse() 准备要发送的数据
-    response_.MakeResponse(writeBuff_);
+    if(page != pages_.end()) {
+        response_.MakeResponse(writeBuff_, page->second.type, page->second.render());
+    } else {
+        response_.MakeResponse(writeBuff_);
+    }
     
     // 初始化 iov_：设置好响应头和文件的指针及长度，为接下来的 write 做准备
     /* 响应头 */
@@ -126,5 +261,11 @@ bool HttpConn::process() {
         iovCnt_ = 2;
     }
     LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen() , iovCnt_, ToWriteBytes());
+    timing_.respBytes = ToWriteBytes();
+    RESPONSE_BYTES->Record(timing_.respBytes);
+    TWS_PROBE3(process, fd_, response_.Code(), timing_.respBytes);
+    if(TraceRing::Instance()->Enabled()) { trace_.Stamp(ReqTrace::RESPONSE); }
+    timing_.pending = true;
+    if(timed) { timing_.readyUs = CoarseClock::PreciseUs(); }
     return true;
 }
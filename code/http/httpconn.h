@@ -11,12 +11,18 @@
 #include <arpa/inet.h>   // sockaddr_in
 #include <stdlib.h>      // atoi()
 #include <errno.h>      
+#include <string>
+#include <unordered_map>
+#include <functional>
 
 #include "../log/log.h"
-#include "../pool/sqlconnRAII.h"
 #include "../buffer/buffer.h"
+#include "../timer/timewheel.h"
 #include "httprequest.h"
 #include "httpresponse.h"
+#include "accesslog.h"
+#include "../trace/reqtrace.h"
+#include "../trace/probes.h"
 
 class HttpConn {
 public:
@@ -47,6 +53,15 @@ public:
     // 初始化 iov_：设置好响应头和文件的指针及长度，为接下来的 write 做准备
     bool process();
 
+    // process() 返回 false 且正在等待登录/注册的查库结果，此时不要再监听这个连接
+    bool IsWaitingDb() const { return waitingDb_; }
+    // 把查询提交给异步的用户存储后端，done 在主线程里以校验结果调用
+    void VerifyAsync(std::function<void(bool)> done);
+    // 查库结果回来后接着生成响应，gen 为提交时的 Generation()。连接已经关闭或换了人返回 false
+    bool ResumeAuth(uint64_t gen, bool ok);
+    // 每次 init 加一，用来识别异步回调回来时槽位是否已经换了连接
+    uint64_t Generation() const { return gen_; }
+
     int ToWriteBytes() { 
         return iov_[0].iov_len + iov_[1].iov_len; 
     }
@@ -54,12 +69,31 @@ public:
     bool IsKeepAlive() const {
         return request_.IsKeepAlive();
     }
+
+    // 嵌在连接里的时间轮结点，由 WebServer 的 timer_ 挂链/摘链
+    TimeWheelNode* TimerNode() { return &timerNode_; }
+
+    // 惰性超时：读写事件只记录最后活跃时刻，定时器到期时再检查。只在主线程读写
+    void Touch(int64_t nowMs) { lastActive_ = nowMs; }
+    int64_t LastActive() const { return lastActive_; }
+
+    // 主线程把读事件交给线程池时调用，记下请求追踪的派发时刻
+    void TraceDispatch() {
+        if(TraceRing::Instance()->Enabled()) { trace_.StampOnce(ReqTrace::DISPATCH); }
+    }
 	
     // 是否启用 Edge Triggered (边缘触发) 模式。这决定了服务器处理 IO 的行为（是读一次还是读到尽头）
     static bool isET;
     static const char* srcDir;
     // 静态原子变量。记录当前服务器总共有多少个活跃的客户端连接。所有 HttpConn 对象共享这一个计数器
     static std::atomic<int> userCount;
+    // 用户存储后端，WebServer 启动时设置
+    static AuthBackend* auth;
+
+    // 动态页面（例如 /metrics）：path 命中时不读文件，以 render() 的返回值作为响应体
+    // 这些页面是运维诊断用的（指标、请求追踪），只对回环地址的客户端生效，其他客户端按普通文件处理（404）
+    // 只能在服务器启动、开始监听之前注册，之后只读，请求路径上不加锁
+    static void AddPage(const std::string& path, const std::string& type, std::function<std::string()> render);
     
 private:
     // 连接对应的文件描述符（Socket）。所有的读写操作都通过这个 fd_ 进行
@@ -82,6 +116,36 @@ private:
     HttpRequest request_;
     // 负责“生成”。根据 request_ 解析出的结果，去磁盘查找对应的文件（如 index.html），并构建响应报文（状态码 200/404 等）
     HttpResponse response_;
+
+    // 侵入式定时器结点，生命周期与连接槽位（users_[fd]）一致
+    TimeWheelNode timerNode_;
+    // 最后一次读写事件的时刻（CoarseClock 毫秒）
+    int64_t lastActive_;
+    // 连接建立的时刻（CoarseClock 毫秒），close 探针用
+    int64_t acceptMs_;
+
+    // 解析完成之后生成响应，初始化 iov_
+    bool MakeResponse_(bool parsed);
+    // 客户端是不是回环地址（127.0.0.0/8）
+    bool IsLoopback_() const;
+
+    // 连接复用计数，见 Generation()
+    uint64_t gen_;
+    // 正在等待查库结果
+    bool waitingDb_;
+
+    // 访问日志：当前请求各阶段的时刻
+    AccessTiming timing_;
+    // 请求追踪：当前请求各阶段的周期计数，请求结束时放进 TraceRing
+    ReqTrace trace_;
+    // 响应写完（或连接在写完之前关闭）时记一行访问日志，并为下一个请求重置计时
+    void FinishRequest_(bool aborted);
+
+    struct Page {
+        std::string type;
+        std::function<std::string()> render;
+    };
+    static std::unordered_map<std::string, Page> pages_;
 };
 
 
@@ -2,6 +2,7 @@
  * @file httprequest.cpp
  * @brief HttpRequest类
  */ 
+#define LOG_MODULE Log::MOD_HTTP   // 本文件的日志属于 http 模块
 #include "httprequest.h"
 using namespace std;
 
@@ -15,6 +16,8 @@ const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG {
 void HttpRequest::Init() {
     method_ = path_ = version_ = body_ = "";
     state_ = REQUEST_LINE;
+    contentLen_ = 0;
+    authTag_ = -1;
     header_.clear();
     post_.clear();
 }
@@ -32,6 +35,14 @@ bool HttpRequest::parse(Buffer& buff) {
         return false;
     }
     while(buff.ReadableBytes() && state_ != FINISH) {
+        if(state_ == BODY) {
+            /* 按 Content-Length 取请求体，不依赖结尾的 CRLF，紧跟在后面的流水线请求原样留在缓冲区里
+               请求体没收齐时停在 BODY，数据留在缓冲区里，等下一次读到数据后接着解析 */
+            if(buff.ReadableBytes() < contentLen_) { break; }
+            ParseBody_(string(buff.Peek(), contentLen_));
+            buff.Retrieve(contentLen_);
+            break;
+        }
         const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
         std::string line(buff.Peek(), lineEnd);		// 问题：即使没找到 \r\n，这里也截取了 line
         switch(state_)
@@ -44,13 +55,18 @@ bool HttpRequest::parse(Buffer& buff) {
             break;    
         case HEADERS:
             ParseHeader_(line);
-            if(buff.ReadableBytes() <= 2) {
-                state_ = FINISH;
+            if(state_ == BODY) {
+                /* 空行，头部结束：Content-Length 只在这里取一次，没有请求体（GET 等）时请求到此结束 */
+                contentLen_ = ContentLength_();
+                if(contentLen_ > MAX_BODY) {
+                    LOG_ERROR("Content-Length %zu too large", contentLen_);
+                    return false;
+                }
+                if(contentLen_ == 0) {
+                    state_ = FINISH;
+                }
             }
             break;
-        case BODY:
-            ParseBody_(line);
-            break;
         default:
             break;
         }
@@ -107,6 +123,12 @@ void HttpRequest::ParseBody_(const string& line) {
     LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
 }
 
+size_t HttpRequest::ContentLength_() const {
+    auto it = header_.find("Content-Length");
+    if(it == header_.end()) { return 0; }
+    return strtoul(it->second.c_str(), nullptr, 10);
+}
+
 int HttpRequest::ConverHex(char ch) {
     if(ch >= 'A' && ch <= 'F') return ch -'A' + 10;
     if(ch >= 'a' && ch <= 'f') return ch -'a' + 10;
@@ -120,13 +142,8 @@ void HttpRequest::ParsePost_() {
             int tag = DEFAULT_HTML_TAG.find(path_)->second;
             LOG_DEBUG("Tag:%d", tag);
             if(tag == 0 || tag == 1) {
-                bool isLogin = (tag == 1);
-                if(UserVerify(post_["username"], post_["password"], isLogin)) {
-                    path_ = "/welcome.html";
-                } 
-                else {
-                    path_ = "/error.html";
-                }
+                /* 查库交给 HttpConn 决定同步还是异步，这里只记下来 */
+                authTag_ = tag;
             }
         }
     }   
@@ -173,64 +190,74 @@ void HttpRequest::ParseFromUrlencoded_() {
     }
 }
 
-bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin) {
-    if(name == "" || pwd == "") { return false; }
-    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
-    MYSQL* sql;
-    SqlConnRAII(&sql,  SqlConnPool::Instance());
-    assert(sql);
-    
-    bool flag = false;
-    // unsigned int j = 0;
-    char order[256] = { 0 };
-    // MYSQL_FIELD *fields = nullptr;
-    MYSQL_RES *res = nullptr;
-    
-    if(!isLogin) { flag = true; }
-    /* 查询用户的密码 */
-    snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", name.c_str());
-    LOG_DEBUG("%s", order);
-
-    if(mysql_query(sql, order)) { 
-        mysql_free_result(res);
-        return false; 
+bool HttpRequest::CheckUser_(const CredCache::UserInfo& info, const string& pwd, bool isLogin, bool* insert) {
+    *insert = false;
+    if(!info.ok) { return false; }
+    if(isLogin) {
+        if(CredCache::Instance()->Match(info, pwd)) { return true; }
+        LOG_DEBUG("pwd error!");
+        return false;
     }
-    res = mysql_store_result(sql);
-    // j = mysql_num_fields(res);
-    // fields = mysql_fetch_fields(res);
-
-    while(MYSQL_ROW row = mysql_fetch_row(res)) {
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        string password(row[1]);
-        /* 注册行为 且 用户名未被使用*/
-        if(isLogin) {
-            if(pwd == password) { flag = true; }
-            else {
-                flag = false;
-                LOG_DEBUG("pwd error!");
-            }
-        } 
-        else { 
-            flag = false; 
-            LOG_DEBUG("user used!");
-        }
+    /* 注册行为 且 用户名已被使用 */
+    if(info.exists) {
+        LOG_DEBUG("user used!");
+        return false;
     }
-    mysql_free_result(res);
+    LOG_DEBUG("regirster!");
+    *insert = true;
+    return true;
+}
 
-    /* 注册行为 且 用户名未被使用*/
-    if(!isLogin && flag == true) {
-        LOG_DEBUG("regirster!");
-        bzero(order, 256);
-        snprintf(order, 256,"INSERT INTO user(username, password) VALUES('%s','%s')", name.c_str(), pwd.c_str());
-        LOG_DEBUG( "%s", order);
-        if(mysql_query(sql, order)) { 
-            LOG_DEBUG( "Insert error!");
-            flag = false; 
-        }
+void HttpRequest::Verify(AuthBackend* auth) {
+    assert(AuthPending() && auth && !auth->Async());
+    /* 同名的并发未命中可能合并到别的工作线程正在进行的查询上，结果由那个线程交过来 */
+    auto promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> future = promise->get_future();
+    UserVerify(auth, GetPost("username"), GetPost("password"), authTag_ == 1,
+               [promise](bool ok) { promise->set_value(ok); });
+    FinishAuth(future.get());
+}
+
+void HttpRequest::VerifyAsync(AuthBackend* auth, std::function<void(bool)> done) const {
+    assert(AuthPending() && auth);
+    UserVerify(auth, GetPost("username"), GetPost("password"), authTag_ == 1, std::move(done));
+}
+
+void HttpRequest::FinishAuth(bool ok) {
+    path_ = ok ? "/welcome.html" : "/error.html";
+    authTag_ = -1;
+}
+
+void HttpRequest::UserVerify(AuthBackend* auth, const string& name, const string& pwd,
+                             bool isLogin, std::function<void(bool)> done) {
+    if(name == "" || pwd == "") {
+        done(false);
+        return;
     }
-    SqlConnPool::Instance()->FreeConn(sql);
-    LOG_DEBUG( "UserVerify success!!");
-    return flag;
+    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
+    /* 先查缓存：命中时在当前线程直接回调；未命中时同名的并发请求只有一个去查，其余的挂在 flight 上等它的结果 */
+    CredCache::Instance()->Lookup(name,
+        [auth, name, pwd, isLogin, done](const CredCache::UserInfo& info) {
+            bool insert;
+            bool flag = CheckUser_(info, pwd, isLogin, &insert);
+            if(!insert) {
+                done(flag);
+                return;
+            }
+            auth->AddUser(name, pwd, [name, done](AuthBackend::ADD_RESULT result) {
+                if(result == AuthBackend::ADD_DUPLICATE) { LOG_DEBUG("user used!"); }
+                else if(result != AuthBackend::ADD_OK) { LOG_DEBUG("Insert error!"); }
+                /* 不管成功与否（失败可能是别人抢先注册了），缓存里的“不存在”都不再可信 */
+                CredCache::Instance()->Invalidate(name);
+                done(result == AuthBackend::ADD_OK);
+            });
+        },
+        [auth, &name] {
+            /* 查询用户的密码 */
+            auth->FindUser(name, [name](const AuthBackend::User& user) {
+                CredCache::Instance()->Fill(name, user.ok, user.exists, user.pwd);
+            });
+        });
 }
 
 std::string HttpRequest::path() const{
@@ -10,12 +10,12 @@
 #include <string>
 #include <regex>
 #include <errno.h>     
-#include <mysql/mysql.h>  //mysql
+#include <future>
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
-#include "../pool/sqlconnpool.h"
-#include "../pool/sqlconnRAII.h"
+#include "../auth/authbackend.h"
+#include "../auth/credcache.h"
 
 class HttpRequest {
 public:
@@ -55,6 +55,17 @@ public:
     std::string GetPost(const char* key) const;
 
     bool IsKeepAlive() const;
+    // 头部已经解析完，请求体还没有收齐：调用方应继续读，不要 Init，下次 parse 接着解析
+    bool BodyPending() const { return state_ == BODY; }
+
+    // 登录/注册表单解析完成后，需要查库确认才能决定返回哪个页面
+    bool AuthPending() const { return authTag_ >= 0; }
+    // 后端是同步的（auth->Async() 为 false）：在当前线程查询，并据此设置 path_
+    void Verify(AuthBackend* auth);
+    // 后端是异步的：done 在主线程里以校验结果调用，之后由调用方调用 FinishAuth
+    void VerifyAsync(AuthBackend* auth, std::function<void(bool)> done) const;
+    // 根据校验结果设置 path_（welcome / error）
+    void FinishAuth(bool ok);
 
     /* 
     todo 
@@ -69,6 +80,8 @@ private:
     void ParseHeader_(const std::string& line);
     // 根据 Content-Length 读取指定长度的字节作为 Body，未实现可以修改补充
     void ParseBody_(const std::string& line);
+    // 请求头里的 Content-Length，没有时为 0
+    size_t ContentLength_() const;
 
     void ParsePath_();
     void ParsePost_();
@@ -76,10 +89,18 @@ private:
     // 当你在网页上填写表单（如登录、注册）并点击提交时，浏览器通常会把数据以 application/x-www-form-urlencoded 格式发送。其格式类似于：username=mark&password=123&email=123%40qq.com
     void ParseFromUrlencoded_();
 	
-    // 连接数据库的桥梁。它会调用 SqlConnPool 里的连接，执行 SQL 语句（查询或插入），实现真正的用户登录校验或注册入库功能
-    static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin);
+    // 连接用户存储的桥梁：先查 CredCache，未命中时向 auth 查询，注册时再写入，实现真正的用户登录校验或注册入库功能
+    // 登录一次查询，注册先查再插，结果通过 done 返回
+    static void UserVerify(AuthBackend* auth, const std::string& name, const std::string& pwd,
+                           bool isLogin, std::function<void(bool)> done);
+    // 根据用户查询结果判断校验是否通过；注册且用户名可用时 *insert 为 true，还需要插入
+    static bool CheckUser_(const CredCache::UserInfo& info, const std::string& pwd, bool isLogin, bool* insert);
 
     PARSE_STATE state_;
+    // 头部结束时取到的 Content-Length
+    size_t contentLen_;
+    // 待校验的表单：-1 无，0 注册，1 登录（对应 DEFAULT_HTML_TAG）
+    int authTag_;
     // 存储 HTTP 请求的四个基本组成部分
     std::string method_, path_, version_, body_;
     // 存储请求头的所有键值对（如 Connection: keep-alive）
@@ -90,6 +111,8 @@ private:
     // 静态常量，定义了项目中哪些页面是合法的，以及登录/注册对应的特定逻辑
     static const std::unordered_set<std::string> DEFAULT_HTML;
     static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
+    // 请求体上限，超过的请求直接按 400 处理，不在读缓冲区里无限攒数据
+    static const size_t MAX_BODY = 1 << 20;
     static int ConverHex(char ch);
 };
 
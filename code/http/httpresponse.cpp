@@ -2,6 +2,7 @@
  * @file httpresponse.cpp
  * @brief HttpResponse类
  */ 
+#define LOG_MODULE Log::MOD_HTTP   // 本文件的日志属于 http 模块
 #include "httpresponse.h"
 
 using namespace std;
@@ -89,11 +90,19 @@ void HttpResponse::MakeResponse(Buffer& buff) {
     // 调用 AddStateLine_（添加状态行）
     AddStateLine_(buff);
     // 调用 AddHeader_（添加响应头）
-    AddHeader_(buff);
+    AddHeader_(buff, GetFileType_());
     // 调用 AddContent_（建立文件映射）
     AddContent_(buff);
 }
 
+void HttpResponse::MakeResponse(Buffer& buff, const string& type, const string& body) {
+    code_ = 200;
+    AddStateLine_(buff);
+    AddHeader_(buff, type);
+    buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n");
+    buff.Append(body);
+}
+
 char* HttpResponse::File() {
     return mmFile_;
 }
@@ -121,7 +130,11 @@ void HttpResponse::AddStateLine_(Buffer& buff) {
     buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n");
 }
 
-void HttpResponse::AddHeader_(Buffer& buff) {
+void HttpResponse::AddHeader_(Buffer& buff, const string& type) {
+    const char* date = CoarseClock::HttpDate();
+    buff.Append("Date: ");
+    buff.Append(date, strlen(date));
+    buff.Append("\r\n");
     buff.Append("Connection: ");
     if(isKeepAlive_) {
         buff.Append("keep-alive\r\n");
@@ -129,7 +142,7 @@ void HttpResponse::AddHeader_(Buffer& buff) {
     } else{
         buff.Append("close\r\n");
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
+    buff.Append("Content-type: " + type + "\r\n");
 }
 
 void HttpResponse::AddContent_(Buffer& buff) {
@@ -13,6 +13,7 @@
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "../timer/coarseclock.h"
 
 class HttpResponse {
 public:
@@ -27,6 +28,8 @@ public:
     
     // 构建响应
     void MakeResponse(Buffer& buff);
+    // 构建动态生成的响应（例如 /metrics），body 直接写在响应头后面，不映射文件
+    void MakeResponse(Buffer& buff, const std::string& type, const std::string& body);
     
     char* File();
     size_t FileLen() const;
@@ -40,8 +43,8 @@ private:
     // 内部填充函数
     // 向 Buffer 写入 HTTP/1.1 200 OK\r\n
     void AddStateLine_(Buffer &buff);
-    // 向 Buffer 写入 Content-Length、Content-Type 和 Connection 等信息
-    void AddHeader_(Buffer &buff);
+    // 向 Buffer 写入 Date、Content-Type 和 Connection 等信息
+    void AddHeader_(Buffer &buff, const std::string& type);
     // 通过 open 打开文件，获取文件描述符。
     // 使用 mmap 系统调用。这允许内核直接将磁盘文件映射到用户空间地址，发送时配合 writev 可以极大减少 CPU 拷贝开销
     void AddContent_(Buffer &buff);
@@ -9,6 +9,8 @@
 #include <deque>
 #include <condition_variable>
 #include <sys/time.h>
+#include <assert.h>
+#include "../metrics/lockprof.h"
 
 template<class T>
 class BlockDeque {
@@ -53,15 +55,15 @@ private:
     size_t capacity_;
 
     // 互斥锁，保证原子性。任何对 deq_ 的读写操作（push, pop, size等）都必须先加锁，确保同一时刻只有一个线程在操作队列，防止数据竞争（Data Race）
-    std::mutex mtx_;
+    Mutex mtx_;
 
     bool isClose_;
 
     // 条件变量，实现阻塞挂起与唤醒
     // 当队列为空时，消费者线程在 condConsumer_ 上等待，不再消耗 CPU。一旦生产者放了东西，就唤醒它
-    std::condition_variable condConsumer_;
+    CondVar condConsumer_;
 	// 当队列满时，生产者线程在 condProducer_ 上等待。一旦消费者拿走了东西，就唤醒它
-    std::condition_variable condProducer_;
+    CondVar condProducer_;
 };
 
 
@@ -69,6 +71,7 @@ template<class T>
 BlockDeque<T>::BlockDeque(size_t MaxCapacity) :capacity_(MaxCapacity) {
     assert(MaxCapacity > 0);
     isClose_ = false;
+    LockName(mtx_, "blockqueue");
 }
 
 template<class T>
@@ -79,7 +82,7 @@ BlockDeque<T>::~BlockDeque() {
 template<class T>
 void BlockDeque<T>::Close() {
     {   
-        std::lock_guard<std::mutex> locker(mtx_);
+        std::lock_guard<Mutex> locker(mtx_);
         deq_.clear();
         isClose_ = true;
     }
@@ -95,37 +98,37 @@ void BlockDeque<T>::flush() {
 
 template<class T>
 void BlockDeque<T>::clear() {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<Mutex> locker(mtx_);
     deq_.clear();
 }
 
 template<class T>
 T BlockDeque<T>::front() {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<Mutex> locker(mtx_);
     return deq_.front();
 }
 
 template<class T>
 T BlockDeque<T>::back() {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<Mutex> locker(mtx_);
     return deq_.back();
 }
 
 template<class T>
 size_t BlockDeque<T>::size() {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<Mutex> locker(mtx_);
     return deq_.size();
 }
 
 template<class T>
 size_t BlockDeque<T>::capacity() {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<Mutex> locker(mtx_);
     return capacity_;
 }
 
 template<class T>
 void BlockDeque<T>::push_back(const T &item) {
-    std::unique_lock<std::mutex> locker(mtx_);
+    std::unique_lock<Mutex> locker(mtx_);
     while(deq_.size() >= capacity_) {
         condProducer_.wait(locker);
         // 唤醒后判断：如果阻塞期间队列被关闭了，立刻停止并退出
@@ -139,7 +142,7 @@ void BlockDeque<T>::push_back(const T &item) {
 
 template<class T>
 void BlockDeque<T>::push_front(const T &item) {
-    std::unique_lock<std::mutex> locker(mtx_);
+    std::unique_lock<Mutex> locker(mtx_);
     while(deq_.size() >= capacity_) {
         condProducer_.wait(locker);
         // 唤醒后判断：如果阻塞期间队列被关闭了，立刻停止并退出
@@ -153,19 +156,19 @@ void BlockDeque<T>::push_front(const T &item) {
 
 template<class T>
 bool BlockDeque<T>::empty() {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<Mutex> locker(mtx_);
     return deq_.empty();
 }
 
 template<class T>
 bool BlockDeque<T>::full(){
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<Mutex> locker(mtx_);
     return deq_.size() >= capacity_;
 }
 
 template<class T>
 bool BlockDeque<T>::pop(T &item) {
-    std::unique_lock<std::mutex> locker(mtx_);
+    std::unique_lock<Mutex> locker(mtx_);
     while(deq_.empty()){
         condConsumer_.wait(locker);
         if(isClose_){
@@ -180,7 +183,7 @@ bool BlockDeque<T>::pop(T &item) {
 
 template<class T>
 bool BlockDeque<T>::pop(T &item, int timeout) {
-    std::unique_lock<std::mutex> locker(mtx_);
+    std::unique_lock<Mutex> locker(mtx_);
     while(deq_.empty()){
         if(condConsumer_.wait_for(locker, std::chrono::seconds(timeout)) 
                 == std::cv_status::timeout){
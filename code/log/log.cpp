@@ -3,142 +3,182 @@
  * @brief Log类
  */ 
 #include "log.h"
+#include "../trace/probes.h"
 
 using namespace std;
 
-Log::Log() {
-    lineCount_ = 0;
+namespace {
+// 线程私有的环形缓冲区句柄。线程退出时把环标记为退役，由后台线程写完剩余数据后回收
+// 与 Log 共同持有（shared_ptr），进程退出时无论 Log 和线程谁先析构都不会访问已释放的环
+struct LocalRingHolder {
+    std::shared_ptr<LogRing> ring;
+    ~LocalRingHolder() {
+        if(ring) { ring->Retire(); }
+    }
+};
+}
+
+Log::Log(int id) : id_(id) {
+    assert(id >= 0 && id < LOG_INSTANCES);
+    isOpen_ = false;
+    level_ = 1;
+    for(int i = 0; i < MOD_COUNT; i++) {
+        moduleLevel_[i] = -1;
+    }
     isAsync_ = false;
     writeThread_ = nullptr;
-    deque_ = nullptr;
-    toDay_ = 0;
+    LockName(mtx_, id == 0 ? "log" : "log_access");
+    LockName(ringMtx_, id == 0 ? "log_ring" : "log_access_ring");
+    LockName(condMtx_, id == 0 ? "log_cond" : "log_access_cond");
+    ringCapacity_ = 1024 * LOG_LINE_AVG;
+    fullPolicy_ = FULL_DROP;
+    dropped_ = 0;
+    flushBytes_ = 64 * 1024;
+    flushIntervalMs_ = 100;
+    durability_ = DURABLE_OS;
+    urgent_ = false;
+    dirtySince_ = 0;
+    format_ = FORMAT_TEXT;
+    deferred_ = false;
+    // 0 号格式串留给 write 在二进制模式下写入的已格式化文本
+    sites_.push_back("%s");
+    fileGen_ = 0;
+    defsGen_ = 0;
+    defsWritten_ = 0;
+    isClose_ = false;
+    maxFileBytes_ = 32 * 1024 * 1024;
+    periodSec_ = 86400;
+    periodKey_ = -1;
+    fileIndex_ = 0;
+    fileBytes_ = 0;
     fp_ = nullptr;
 }
 
 Log::~Log() {
     if(writeThread_ && writeThread_->joinable()) {
-        while(!deque_->empty()) {
-            deque_->flush();
-        };
-        deque_->Close();
+        // 后台线程退出前会把所有环形缓冲区写空，并做最后一次提交
+        isClose_ = true;
+        cond_.notify_all();
         writeThread_->join();
     }
     if(fp_) {
-        lock_guard<mutex> locker(mtx_);
-        flush();
+        lock_guard<Mutex> locker(mtx_);
+        fflush(fp_);
+        if(durability_ == DURABLE_FSYNC) { fdatasync(fileno(fp_)); }
         fclose(fp_);
     }
 }
 
-int Log::GetLevel() {
-    lock_guard<mutex> locker(mtx_);
-    return level_;
+LogSite::LogSite(const char* fmt) : format(fmt), id(Log::Instance()->RegisterSite(fmt)) {}
+
+uint32_t Log::RegisterSite(const char* format) {
+    lock_guard<mutex> locker(siteMtx_);
+    sites_.push_back(format);
+    return static_cast<uint32_t>(sites_.size() - 1);
 }
 
-void Log::SetLevel(int level) {
-    lock_guard<mutex> locker(mtx_);
-    level_ = level;
+void Log::SetModuleLevel(int module, int level) {
+    assert(module >= 0 && module < MOD_COUNT);
+    moduleLevel_[module].store(level, std::memory_order_relaxed);
+}
+
+bool Log::SetModuleLevels(const char* spec) {
+    static const char* names[MOD_COUNT] = {"core", "server", "http", "pool"};
+    bool ok = true;
+    std::string s(spec);
+    size_t pos = 0;
+    while(pos < s.size()) {
+        size_t end = s.find(',', pos);
+        if(end == std::string::npos) { end = s.size(); }
+        std::string item = s.substr(pos, end - pos);
+        pos = end + 1;
+        size_t eq = item.find('=');
+        if(eq == std::string::npos) { ok = false; continue; }
+        std::string name = item.substr(0, eq);
+        int module = 0;
+        while(module < MOD_COUNT && name != names[module]) { module++; }
+        if(module == MOD_COUNT) { ok = false; continue; }
+        SetModuleLevel(module, atoi(item.c_str() + eq + 1));
+    }
+    return ok;
+}
+
+void Log::SetFlushPolicy(size_t bytes, int intervalMs, int durability) {
+    flushBytes_ = bytes > 0 ? bytes : 1;
+    flushIntervalMs_ = intervalMs > 0 ? intervalMs : 1;
+    durability_ = durability;
 }
 
 void Log::init(int level = 1, const char* path, const char* suffix, int maxQueueSize) {
+    // 重新 init 时先把环里的旧日志按旧的格式提交到旧文件
+    if(fp_) { WaitDrained_(); }
     isOpen_ = true;
     level_ = level;
     if(maxQueueSize > 0) {	// maxQueueSize 大于 0 为异步
         isAsync_ = true;
-        if(!deque_) {
-            unique_ptr<BlockDeque<std::string>> newDeque(new BlockDeque<std::string>);
-            deque_ = move(newDeque);
-            
-            std::unique_ptr<std::thread> NewThread(new thread(FlushLogThread));
-            writeThread_ = move(NewThread);
-        }
+        // 已经创建的环形缓冲区不再改变大小，这里只影响之后新登记的线程
+        ringCapacity_ = static_cast<size_t>(maxQueueSize) * LOG_LINE_AVG;
     } else {
         isAsync_ = false;
     }
+    deferred_ = isAsync_ && format_ != FORMAT_TEXT;
+    // 同步/异步都有后台线程：异步模式下负责写盘，同步模式下负责按时间间隔提交 stdio 缓冲区
+    if(!writeThread_) {
+        std::unique_ptr<std::thread> NewThread(new thread([this] { AsyncWrite_(); }));
+        writeThread_ = move(NewThread);
+    }
 
-    lineCount_ = 0;
-
-    // 获取当前的 Unix 时间戳
-    // time_t：一个长整型（通常是 long long），表示从“Unix 元年”（1970年1月1日 00:00:00 UTC）到现在的总秒数
-    // time(nullptr)：调用系统函数，返回当前时间。传入 nullptr 表示我们不需要将结果存储在额外的变量中，直接取返回值即可
-    time_t timer = time(nullptr);
-    // 将“总秒数”转换为本地时间（考虑到时区），并拆分成具体的年、月、日等字段
-    // struct tm：这是一个结构体，里面包含了 tm_year (年), tm_mon (月), tm_mday (日), tm_hour (时), tm_min (分), tm_sec (秒) 等字段
-    // localtime(&timer)：它把那堆巨大的“秒数”换算成我们人类能看懂的日期
-    // localtime 返回的是一个指针，指向一个静态内部缓冲区，这意味着这个函数是不可重入的（线程不安全）。如果有两个线程同时调用 localtime，后一个线程的结果会覆盖前一个线程的结果
-    struct tm *sysTime = localtime(&timer);
-    // 将指针指向的结构体内容深拷贝到局部变量 t 中
-    struct tm t = *sysTime;
     path_ = path;
-    suffix_ = suffix;
-    char fileName[LOG_NAME_LEN] = {0};
-    snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", 
-            path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
-    toDay_ = t.tm_mday;
+    // 二进制文件不能直接阅读，换一个后缀以免和文本日志混淆
+    suffix_ = (deferred_ && format_ == FORMAT_BINARY) ? ".blog" : suffix;
 
     {
-        lock_guard<mutex> locker(mtx_);
+        lock_guard<Mutex> locker(mtx_);
         buff_.RetrieveAll();
         if(fp_) { 
-            flush();
+            fflush(fp_);
             fclose(fp_); 
+            fp_ = nullptr;
         }
-
-        fp_ = fopen(fileName, "a");
-        // 如果打开失败（通常是因为存放日志的文件夹 ./log 不存在），则尝试创建该目录。提升了程序的鲁棒性（Robustness）。用户不需要手动创建文件夹，程序第一次运行会自动搞定。0777 是 Linux 下的权限设置（读/写/执行）
-        if(fp_ == nullptr) {
-            mkdir(path_, 0777);
-            fp_ = fopen(fileName, "a");
-        } 
+        dirtySince_ = 0;
+        // 获取当前的 Unix 时间戳
+        // time_t：一个长整型（通常是 long long），表示从“Unix 元年”（1970年1月1日 00:00:00 UTC）到现在的总秒数
+        OpenLogFile_(time(nullptr), false);
         assert(fp_ != nullptr);
     }
+    // 顺便清理上次运行留下的旧日志
+    archiver_.Submit(path_, suffix_);
 }
 
 void Log::write(int level, const char *format, ...) {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr);
-    time_t tSec = now.tv_sec;
-    struct tm *sysTime = localtime(&tSec);
-    struct tm t = *sysTime;
     va_list vaList;
+    if(IsDeferred()) {
+        /* 二进制模式下直接调用 write（没有经过 LOG_BASE）的日志，格式化后作为一个字符串参数记录 */
+        char text[LOG_LINE_MAX];
+        va_start(vaList, format);
+        vsnprintf(text, sizeof(text), format, vaList);
+        va_end(vaList);
+        WriteDeferred(level, LogFormat::SITE_TEXT, static_cast<const char*>(text));
+        return;
+    }
 
-    // 判断日期和行数，决定是否切分新文件
-    /* 日志日期 日志行数 */
-    if (toDay_ != t.tm_mday || (lineCount_ && (lineCount_  %  MAX_LINES == 0)))
-    {
-        unique_lock<mutex> locker(mtx_);
-        locker.unlock();
-        
-        char newFile[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
-
-        if (toDay_ != t.tm_mday)
-        {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
-            toDay_ = t.tm_mday;
-            lineCount_ = 0;
-        }
-        else {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (lineCount_  / MAX_LINES), suffix_);
-        }
-        
-        locker.lock();
-        flush();
-        fclose(fp_);
-        fp_ = fopen(newFile, "a");
-        assert(fp_ != nullptr);
+    // 粗粒度墙上时间 + 按秒缓存的本地时间，每行日志不再调用 gettimeofday 和 localtime
+    struct timeval now = {0, 0};
+    CoarseClock::WallTime(&now);
+    struct tm t = CoarseClock::LocalTime(now.tv_sec);
+
+    // 异步：不拿锁，直接格式化进本线程的环形缓冲区
+    if(isAsync_) {
+        va_start(vaList, format);
+        WriteRing_(now, t, level, format, vaList);
+        va_end(vaList);
+        return;
     }
 
     {
-        unique_lock<mutex> locker(mtx_);
-        lineCount_++;
-        int n = snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
-                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-                    t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-                    
+        unique_lock<Mutex> locker(mtx_);
+        int n = LogCodec::FormatPrefix(buff_.BeginWrite(), buff_.WritableBytes(), now, t, level);
         buff_.HasWritten(n);
-        AppendLogLevelTitle_(level);
 
         // 利用 va_start / va_end 处理变长参数（类似 printf）
         va_start(vaList, format);
@@ -148,56 +188,431 @@ void Log::write(int level, const char *format, ...) {
         buff_.HasWritten(m);
         buff_.Append("\n\0", 2);
 
-        // 如果是异步，塞入队列；如果是同步，直接写文件
-        if(isAsync_ && deque_ && !deque_->full()) {
-            deque_->push_back(buff_.RetrieveAllToStr());
+        // 同步，写入 fp_ 的 stdio 缓冲区（大小为 flushBytes_，写满时由 stdio 自动提交）。写入以空字符终止的字符序列
+        fputs(buff_.Peek(), fp_);
+        buff_.RetrieveAll();
+        if(level >= LOG_LEVEL_ERROR) {
+            Commit_();
+        } else if(dirtySince_ == 0) {
+            // 记录最早一条未提交日志的时刻，后台线程保证它在 flushIntervalMs_ 内被提交
+            dirtySince_ = CoarseClock::NowMs();
+        }
+    }
+}
+
+void Log::SetRotatePolicy(size_t maxFileBytes, int periodSec) {
+    lock_guard<Mutex> locker(mtx_);
+    maxFileBytes_ = maxFileBytes;
+    // 周期只支持能整除一天的长度，这样文件名里的时刻总是对齐的
+    periodSec_ = (periodSec > 0 && 86400 % periodSec == 0) ? periodSec : 86400;
+}
+
+void Log::SetRetention(bool compress, int maxFiles, size_t maxTotalBytes) {
+    archiver_.SetPolicy(compress, maxFiles, maxTotalBytes);
+}
+
+int64_t Log::PeriodKey_(time_t now) const {
+    // 按本地时间对齐：日切发生在本地零点
+    struct tm t = CoarseClock::LocalTime(now);
+    return (static_cast<int64_t>(now) + t.tm_gmtoff) / periodSec_;
+}
+
+void Log::OpenLogFile_(time_t now, bool nextIndex) {
+    // 调用方持有 mtx_
+    int64_t key = PeriodKey_(now);
+    if(key != periodKey_ || !nextIndex) {
+        periodKey_ = key;
+        fileIndex_ = 0;
+    } else {
+        fileIndex_++;
+    }
+
+    // 文件名使用周期起点：按天 2024_01_01.log，按小时 2024_01_01_13.log，更短的周期再加上分钟
+    // localtime 返回的是一个指针，指向一个静态内部缓冲区，这意味着这个函数是不可重入的（线程不安全）。CoarseClock::LocalTime 内部用 localtime_r，并按线程缓存
+    struct tm t = CoarseClock::LocalTime(now);
+    char tail[64] = {0};
+    if(periodSec_ >= 86400) {
+        snprintf(tail, sizeof(tail), "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+    } else if(periodSec_ >= 3600) {
+        snprintf(tail, sizeof(tail), "%04d_%02d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+                    t.tm_hour / (periodSec_ / 3600) * (periodSec_ / 3600));
+    } else {
+        int minutes = t.tm_hour * 60 + t.tm_min;
+        int step = periodSec_ >= 60 ? periodSec_ / 60 : 1;
+        minutes = minutes / step * step;
+        snprintf(tail, sizeof(tail), "%04d_%02d_%02d_%02d%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+                    minutes / 60, minutes % 60);
+    }
+
+    char fileName[LOG_NAME_LEN];
+    while(true) {
+        if(fileIndex_ == 0) {
+            snprintf(fileName, LOG_NAME_LEN, "%s/%s%s", path_, tail, suffix_);
         } else {
-            // 写入以空字符终止的字符序列
-            fputs(buff_.Peek(), fp_);
+            snprintf(fileName, LOG_NAME_LEN, "%s/%s-%d%s", path_, tail, fileIndex_, suffix_);
         }
-        buff_.RetrieveAll();
+        /* 按大小翻滚时跳过已经存在（或已被压缩）的编号，避免追加到旧文件里 */
+        if(!nextIndex) { break; }
+        std::string gz = std::string(fileName) + ".gz";
+        if(access(fileName, F_OK) != 0 && access(gz.c_str(), F_OK) != 0) { break; }
+        fileIndex_++;
+    }
+
+    // 先告诉归档线程新的当前文件，再创建它，保证它不会被当成旧文件压缩
+    archiver_.SetActive(fileName);
+    fp_ = OpenFile_(fileName);
+    // 如果打开失败（通常是因为存放日志的文件夹 ./log 不存在），则尝试创建该目录。提升了程序的鲁棒性（Robustness）。用户不需要手动创建文件夹，程序第一次运行会自动搞定。0777 是 Linux 下的权限设置（读/写/执行）
+    if(fp_ == nullptr) {
+        mkdir(path_, 0777);
+        fp_ = OpenFile_(fileName);
+    }
+    fileBytes_ = 0;
+    struct stat st;
+    if(fp_ && fstat(fileno(fp_), &st) == 0) {
+        fileBytes_ = static_cast<size_t>(st.st_size);
+    }
+}
+
+void Log::CheckRotate_() {
+    // 只在后台线程调用，请求线程永远不做文件管理
+    time_t now = time(nullptr);
+    {
+        lock_guard<Mutex> locker(mtx_);
+        if(fp_ == nullptr) { return; }
+        if(!isAsync_) {
+            /* 同步模式下由请求线程写 stdio，用文件位置估算大小 */
+            long pos = ftell(fp_);
+            if(pos > 0) { fileBytes_ = static_cast<size_t>(pos); }
+        }
+        bool newPeriod = PeriodKey_(now) != periodKey_;
+        bool full = maxFileBytes_ > 0 && fileBytes_ >= maxFileBytes_;
+        if(!newPeriod && !full) { return; }
+
+        fflush(fp_);
+        if(durability_ == DURABLE_FSYNC) { fdatasync(fileno(fp_)); }
+        fclose(fp_);
+        fp_ = nullptr;
+        dirtySince_ = 0;
+        OpenLogFile_(now, true);
+        assert(fp_ != nullptr);
+    }
+    archiver_.Submit(path_, suffix_);
+}
+
+FILE* Log::OpenFile_(const char* fileName) {
+    FILE* fp = fopen(fileName, "a");
+    if(fp) {
+        // stdio 缓冲区设为组提交的字节阈值，攒满后一次 write
+        setvbuf(fp, nullptr, _IOFBF, flushBytes_);
+        fileGen_++;
+    }
+    return fp;
+}
+
+void Log::Commit_() {
+    // 调用方持有 mtx_
+    fflush(fp_);
+    if(durability_ == DURABLE_FSYNC) { fdatasync(fileno(fp_)); }
+    dirtySince_ = 0;
+}
+
+LogRing* Log::LocalRing_() {
+    // 每个 Log 实例在每个线程上各有一个环
+    thread_local LocalRingHolder holders[LOG_INSTANCES];
+    LocalRingHolder& holder = holders[id_];
+    if(!holder.ring) {
+        holder.ring = std::make_shared<LogRing>(ringCapacity_);
+        lock_guard<Mutex> locker(ringMtx_);
+        rings_.push_back(holder.ring);
     }
+    return holder.ring.get();
+}
+
+void Log::WriteRing_(const struct timeval& now, const struct tm& t, int level, const char* format, va_list vaList) {
+    LogRing* ring = LocalRing_();
+    size_t contiguous = 0;
+    char* dst = ring->BeginWrite(&contiguous);
+    bool direct = contiguous >= static_cast<size_t>(LOG_LINE_MAX);
+    /* 连续空间放得下最长的一行时直接格式化进环里，否则（接近环尾或快满了）先格式化到栈上再拷贝 */
+    char line[LOG_LINE_MAX];
+    char* buf = direct ? dst : line;
+
+    int n = LogCodec::FormatPrefix(buf, LOG_LINE_MAX, now, t, level);
+    // 预留 1 字节给行尾的 '\n'
+    int avail = LOG_LINE_MAX - n - 1;
+    int m = vsnprintf(buf + n, avail, format, vaList);
+    if(m < 0) { m = 0; }
+    if(m >= avail) { m = avail - 1; }
+    buf[n + m] = '\n';
+    CommitRing_(ring, direct, line, n + m + 1, level);
 }
 
-void Log::AppendLogLevelTitle_(int level) {
-    switch(level) {
-    case 0:
-        buff_.Append("[debug]: ", 9);
-        break;
-    case 1:
-        buff_.Append("[info] : ", 9);
-        break;
-    case 2:
-        buff_.Append("[warn] : ", 9);
-        break;
-    case 3:
-        buff_.Append("[error]: ", 9);
-        break;
-    default:
-        buff_.Append("[info] : ", 9);
-        break;
+void Log::CommitRing_(LogRing* ring, bool direct, const char* line, size_t len, int level) {
+    size_t before = ring->ReadableBytes();
+    if(direct) {
+        ring->Commit(len);
+    } else {
+        PushRing_(ring, line, len);
+    }
+    if(level >= LOG_LEVEL_ERROR) {
+        // ERROR 级别立即提交，其余的交给后台线程按字节数/时间间隔成组提交
+        flush();
+        return;
+    }
+    /* 本线程攒够一批就叫醒后台线程（不超过环容量的一半，保证来得及腾出空间）
+       只在越过阈值的那一次 notify，后台线程忙不过来时不会每行都进一次内核 */
+    size_t threshold = std::min(flushBytes_, ring->Capacity() / 2);
+    if(before < threshold && ring->ReadableBytes() >= threshold) {
+        cond_.notify_one();
     }
 }
 
+bool Log::PushRing_(LogRing* ring, const char* line, size_t len) {
+    while(!ring->Write(line, len)) {
+        if(fullPolicy_ == FULL_DROP || isClose_) {
+            uint64_t dropped = dropped_.fetch_add(1, std::memory_order_relaxed) + 1;
+            TWS_PROBE1(log_drop, dropped);
+            return false;
+        }
+        /* FULL_BLOCK：催后台线程写盘，稍等再试 */
+        cond_.notify_one();
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    return true;
+}
+
 void Log::flush() {
     if(isAsync_) { 
-        deque_->flush(); 
+        // 标记为紧急并唤醒后台线程，不等待写盘
+        urgent_ = true;
+        cond_.notify_one();
+        return;
     }
     // 将应用层（用户态）的缓冲区数据强制刷新到操作系统（内核态）的缓冲区（Page Cache）
-    fflush(fp_);
+    lock_guard<Mutex> locker(mtx_);
+    if(fp_) { Commit_(); }
+}
+
+void Log::WaitDrained_() {
+    urgent_ = true;
+    cond_.notify_one();
+    while(true) {
+        size_t pending = 0;
+        {
+            lock_guard<Mutex> locker(ringMtx_);
+            for(auto& ring: rings_) {
+                pending += ring->ReadableBytes();
+            }
+        }
+        if(pending == 0) { break; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        cond_.notify_one();
+    }
+}
+
+size_t Log::PendingBytes_() {
+    {
+        lock_guard<Mutex> locker(ringMtx_);
+        drainRings_.clear();
+        for(auto it = rings_.begin(); it != rings_.end();) {
+            /* 回收已退出线程留下的空环 */
+            if((*it)->IsRetired() && (*it)->ReadableBytes() == 0) {
+                it = rings_.erase(it);
+                continue;
+            }
+            drainRings_.push_back(it->get());
+            ++it;
+        }
+    }
+    size_t pending = 0;
+    for(LogRing* ring: drainRings_) {
+        pending += ring->ReadableBytes();
+    }
+    return pending;
+}
+
+size_t Log::DrainRings_() {
+    if(format_ == FORMAT_DEFERRED) { return DrainDeferred_(); }
+    bool binary = (format_ == FORMAT_BINARY);
+
+    /* 每个环最多贡献两段（跨越环尾时），一次 writev 写出所有线程的日志。二进制模式预留第 0 段给文件头和格式串定义 */
+    struct iovec iov[LOG_IOV_MAX];
+    std::vector<size_t> lens(drainRings_.size(), 0);
+    int first = binary ? 1 : 0;
+    int cnt = first;
+    size_t total = 0;
+    for(size_t i = 0; i < drainRings_.size() && cnt + 2 <= LOG_IOV_MAX; i++) {
+        int k = drainRings_[i]->Peek(&iov[cnt]);
+        for(int j = 0; j < k; j++) {
+            lens[i] += iov[cnt + j].iov_len;
+        }
+        cnt += k;
+        total += lens[i];
+    }
+    if(total == 0) { return 0; }
+
+    {
+        lock_guard<Mutex> locker(mtx_);
+        if(fp_ == nullptr) { return 0; }
+        if(binary) {
+            scratch_.clear();
+            BinaryPreamble_(&scratch_);
+            iov[0].iov_base = &scratch_[0];
+            iov[0].iov_len = scratch_.size();
+        }
+        WriteAll_(fileno(fp_), iov, cnt);
+        if(durability_ == DURABLE_FSYNC) { fdatasync(fileno(fp_)); }
+        fileBytes_ += total + (binary ? scratch_.size() : 0);
+    }
+    for(size_t i = 0; i < drainRings_.size(); i++) {
+        if(lens[i]) { drainRings_[i]->Consume(lens[i]); }
+    }
+    return total;
+}
+
+void Log::BinaryPreamble_(std::string* out) {
+    if(defsGen_ != fileGen_) {
+        /* 换了新文件：每个文件都要能单独解码，所有格式串定义重写一遍 */
+        defsGen_ = fileGen_;
+        defsWritten_ = 0;
+        struct stat st;
+        if(fstat(fileno(fp_), &st) == 0 && st.st_size == 0) {
+            out->append(LogFormat::MAGIC, LogFormat::MAGIC_LEN);
+        }
+    }
+    /* 记录在环里发布之前格式串就已经登记，这里一定能看到所有被引用的定义 */
+    lock_guard<mutex> locker(siteMtx_);
+    for(; defsWritten_ < sites_.size(); defsWritten_++) {
+        LogCodec::EncodeSiteDef(static_cast<uint32_t>(defsWritten_), sites_[defsWritten_], out);
+    }
+}
+
+size_t Log::DrainDeferred_() {
+    {
+        lock_guard<mutex> locker(siteMtx_);
+        for(size_t i = siteFmts_.size(); i < sites_.size(); i++) {
+            siteFmts_.push_back(sites_[i]);
+        }
+    }
+    textBuf_.clear();
+    std::vector<size_t> lens(drainRings_.size(), 0);
+    size_t total = 0;
+    for(size_t i = 0; i < drainRings_.size(); i++) {
+        struct iovec seg[2];
+        int k = drainRings_[i]->Peek(seg);
+        if(k == 0) { continue; }
+        const char* data = static_cast<const char*>(seg[0].iov_base);
+        size_t readable = seg[0].iov_len;
+        if(k == 2) {
+            /* 记录可能跨越环尾，拼成连续的一段再解析 */
+            scratch_.assign(data, readable);
+            scratch_.append(static_cast<const char*>(seg[1].iov_base), seg[1].iov_len);
+            data = scratch_.data();
+            readable = scratch_.size();
+        }
+        size_t off = 0;
+        while(off < readable) {
+            size_t len = LogCodec::RecordLen(data + off, readable - off);
+            if(len == 0 || len > readable - off) {
+                /* 环里只会有完整的记录，走到这里说明数据损坏，整段丢弃 */
+                off = readable;
+                break;
+            }
+            LogCodec::DecodeRecord(data + off, len, &siteFmts_, &textBuf_);
+            off += len;
+        }
+        lens[i] = off;
+        total += off;
+    }
+    if(total == 0) { return 0; }
+
+    {
+        lock_guard<Mutex> locker(mtx_);
+        if(fp_ == nullptr) { return 0; }
+        struct iovec iov;
+        iov.iov_base = &textBuf_[0];
+        iov.iov_len = textBuf_.size();
+        WriteAll_(fileno(fp_), &iov, 1);
+        if(durability_ == DURABLE_FSYNC) { fdatasync(fileno(fp_)); }
+        fileBytes_ += textBuf_.size();
+    }
+    for(size_t i = 0; i < drainRings_.size(); i++) {
+        if(lens[i]) { drainRings_[i]->Consume(lens[i]); }
+    }
+    return total;
+}
+
+void Log::WriteAll_(int fd, struct iovec* iov, int cnt) {
+    int idx = 0;
+    while(idx < cnt) {
+        ssize_t len = writev(fd, iov + idx, cnt - idx);
+        if(len < 0) {
+            if(errno == EINTR) { continue; }
+            return;
+        }
+        /* 部分写：跳过已经写完的 iovec，调整写了一半的那个 */
+        while(idx < cnt && static_cast<size_t>(len) >= iov[idx].iov_len) {
+            len -= iov[idx].iov_len;
+            idx++;
+        }
+        if(idx < cnt) {
+            iov[idx].iov_base = static_cast<char*>(iov[idx].iov_base) + len;
+            iov[idx].iov_len -= len;
+        }
+    }
 }
 
 void Log::AsyncWrite_() {
-    string str = "";
-    while(deque_->pop(str)) {
-        lock_guard<mutex> locker(mtx_);
-        fputs(str.c_str(), fp_);
+    /*
+     * 组提交：满足任一条件才写盘
+     *   1. 未写盘的字节数达到 flushBytes_
+     *   2. 最早一条未写盘的日志已等待 flushIntervalMs_
+     *   3. 有 ERROR 日志或显式 flush（urgent_）
+     *   4. 日志系统关闭
+     * 每隔 flushIntervalMs_ / 4 检查一次，所以进程崩溃时最多丢失约 1.25 * flushIntervalMs_ 内的日志
+     */
+    int64_t pendingSince = 0;
+    while(true) {
+        // 翻滚放在写盘之前，一个文件最多超出上限一批数据
+        CheckRotate_();
+        bool closing = isClose_;
+        bool urgent = urgent_.exchange(false);
+        int64_t now = CoarseClock::NowMs();
+
+        size_t pending = PendingBytes_();
+        if(pending > 0 && pendingSince == 0) { pendingSince = now; }
+        if(pending > 0 && (closing || urgent || pending >= flushBytes_ ||
+                            now - pendingSince >= flushIntervalMs_)) {
+            DrainRings_();
+            pendingSince = 0;
+            continue;
+        }
+
+        /* 同步模式：按时间间隔提交 stdio 缓冲区 */
+        {
+            lock_guard<Mutex> locker(mtx_);
+            if(fp_ && dirtySince_ != 0 &&
+                    (closing || urgent || now - dirtySince_ >= flushIntervalMs_)) {
+                Commit_();
+            }
+        }
+        if(closing) { break; }
+
+        // 生产者 notify 时不拿 condMtx_，可能错过一次唤醒，所以用带超时的等待兜底
+        int waitMs = std::max(1, flushIntervalMs_ / 4);
+        unique_lock<Mutex> locker(condMtx_);
+        cond_.wait_for(locker, std::chrono::milliseconds(waitMs));
     }
 }
 
 // C++11以后,使用局部变量懒汉不用加锁
 Log* Log::Instance() {
-    static Log inst;
+    static Log inst(0);
+    return &inst;
+}
+
+Log* Log::AccessInstance() {
+    static Log inst(1);
     return &inst;
 }
 
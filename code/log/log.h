@@ -1,52 +1,185 @@
 /*
  * @file log.h
  * @brief Log类
- */ 
+ */
 #ifndef LOG_H
 #define LOG_H
 
 #include <mutex>
 #include <string>
 #include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <condition_variable>
 #include <sys/time.h>
 #include <string.h>
 #include <stdarg.h>           // vastart va_end
 #include <assert.h>
 #include <sys/stat.h>         //mkdir
+#include <unistd.h>           // fdatasync
+#include <algorithm>
 #include "blockqueue.h"
+#include "../metrics/lockprof.h"
+#include "logring.h"
+#include "logcodec.h"
+#include "logarchiver.h"
 #include "../buffer/buffer.h"
+#include "../timer/coarseclock.h"
+
+// 编译期最低日志等级，低于它的 LOG_XXX 调用在编译时整段消除（参数也不会求值）
+// 例如 make CFLAGS+=-DLOG_MIN_LEVEL=1 去掉所有 LOG_DEBUG
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// 一个日志调用点：格式串和它在二进制日志里的 ID。由 LOG_BASE 在每个调用点定义为局部静态变量，第一次执行时登记
+struct LogSite {
+    explicit LogSite(const char* fmt);
+    const char* format;
+    uint32_t id;
+};
 
 class Log {
 public:
+    // 环形缓冲区写满时的处理策略
+    enum FULL_POLICY {
+        FULL_DROP = 0,      // 丢弃这一行并计数，请求线程永不阻塞
+        FULL_BLOCK,         // 等待后台线程腾出空间，不丢日志
+    };
+
+    // 日志提交的持久化程度
+    enum DURABILITY {
+        DURABLE_OS = 0,     // 写入内核页缓存即可，进程崩溃不丢，掉电可能丢
+        DURABLE_FSYNC,      // 每次组提交后 fdatasync，掉电也只丢最后一个提交窗口
+    };
+
+    // 日志格式。二进制和延迟格式化只在异步模式下生效，同步模式总是文本
+    enum LOG_FORMAT {
+        FORMAT_TEXT = 0,    // 调用点格式化成文本
+        FORMAT_BINARY,      // 调用点只记录格式串 ID 和参数，写入 .blog 文件，用 logdecode 离线解码
+        FORMAT_DEFERRED,    // 同上，但由后台线程格式化成文本写入 .log 文件
+    };
+
+    // 日志模块，每个模块可以单独设置等级。源文件在包含任何头文件之前 #define LOG_MODULE 选择模块
+    enum LOG_MODULE_ID {
+        MOD_CORE = 0,
+        MOD_SERVER,
+        MOD_HTTP,
+        MOD_POOL,
+        MOD_COUNT,
+    };
+
     // 初始化日志系统。决定是异步还是同步（取决于 maxQueueSize 是否大于 0），并创建后台线程
-    void init(int level, const char* path = "./log", 
+    // 异步模式下 maxQueueCapacity 表示每个线程的环形缓冲区大约能容纳多少行
+    void init(int level, const char* path = "./log",
                 const char* suffix =".log",
                 int maxQueueCapacity = 1024);
 
     // 单例模式 (Singleton)，确保整个程序运行期间只有一个 Log 实例，全局共享一个日志文件句柄，避免多个实例同时写文件
     static Log* Instance();
+    // 访问日志：独立的文件和后台线程，与主日志共用同一套异步写入路径。只通过 write 直接写入
+    static Log* AccessInstance();
     static void FlushLogThread();
 
     void write(int level, const char *format,...);
     void flush();
 
-    int GetLevel();
-    void SetLevel(int level);
-    bool IsOpen() { return isOpen_; }
-    
+    // 二进制/延迟格式化模式下的写入：只编码参数，不调用 vsnprintf
+    template<typename... Args>
+    void WriteDeferred(int level, uint32_t site, Args... args);
+    bool IsDeferred() const { return deferred_.load(std::memory_order_relaxed); }
+    // 设置日志格式，在 init 之前调用
+    void SetFormat(int format) { format_ = format; }
+    // 登记一个格式串，返回它的 ID
+    uint32_t RegisterSite(const char* format);
+
+    // 等级是原子变量，过滤日志不需要拿锁
+    int GetLevel() const { return level_.load(std::memory_order_relaxed); }
+    void SetLevel(int level) { level_.store(level, std::memory_order_relaxed); }
+    bool IsOpen() const { return isOpen_.load(std::memory_order_relaxed); }
+
+    // 模块等级，-1 表示跟随全局等级
+    void SetModuleLevel(int module, int level);
+    // 解析 "http=0,pool=2" 形式的模块等级配置，有无法识别的模块名时返回 false
+    bool SetModuleLevels(const char* spec);
+    // LOG_BASE 的运行期过滤：两次 relaxed load，没有锁
+    bool IsEnabled(int module, int level) const {
+        if(!IsOpen()) { return false; }
+        int m = moduleLevel_[module].load(std::memory_order_relaxed);
+        return level >= (m >= 0 ? m : GetLevel());
+    }
+
+    // 设置环形缓冲区写满时的策略，可以在 init 之前调用
+    void SetFullPolicy(int policy) { fullPolicy_ = policy; }
+    // 因为环形缓冲区写满而丢弃的日志行数
+    uint64_t GetDropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // 翻滚策略：单个文件超过 maxFileBytes 字节（0 不限制）或进入新的周期（periodSec 秒，需整除一天，默认按天）时换新文件
+    // 翻滚由后台线程完成，请求线程不做 fclose/fopen
+    void SetRotatePolicy(size_t maxFileBytes, int periodSec);
+    // 归档策略：翻滚下来的文件是否 gzip 压缩，最多保留多少个文件、总共多少字节（0 不限制）
+    void SetRetention(bool compress, int maxFiles, size_t maxTotalBytes);
+
+    // 组提交策略：攒够 bytes 字节或最早一条日志等待了 intervalMs 毫秒时提交一次，ERROR 日志和关闭时立即提交
+    // 可以在 init 之前调用
+    void SetFlushPolicy(size_t bytes, int intervalMs, int durability);
+
 private:
-    // 单例模式 (Singleton)，确保整个程序运行期间只有一个 Log 实例，全局共享一个日志文件句柄，避免多个实例同时写文件冲突
-    Log();
-    
-    void AppendLogLevelTitle_(int level);
+    // 单例模式 (Singleton)，每个日志文件只有一个 Log 实例（主日志和访问日志），避免多个实例同时写一个文件冲突
+    explicit Log(int id);
+
     virtual ~Log();
-    // 后台线程执行的函数，死循环调用 deque_->pop() 并写入 fp_
+    // 后台线程执行的函数，循环收集各线程环形缓冲区里的数据，批量 writev 到 fp_
     void AsyncWrite_();
 
+    // 当前线程的环形缓冲区，第一次调用时创建并登记
+    LogRing* LocalRing_();
+    // 异步模式：直接格式化进本线程的环形缓冲区
+    void WriteRing_(const struct timeval& now, const struct tm& t, int level, const char* format, va_list vaList);
+    // 把一行完整日志放进环形缓冲区，空间不足时按 fullPolicy_ 丢弃或等待
+    bool PushRing_(LogRing* ring, const char* line, size_t len);
+    // 发布写好的一行/一条记录：direct 表示已经写在环里，否则从 line 拷贝
+    void CommitRing_(LogRing* ring, bool direct, const char* line, size_t len, int level);
+    // 后台线程：进入新周期或文件超过大小上限时切换到新文件，并通知归档线程
+    void CheckRotate_();
+    // 打开当前周期的日志文件。nextIndex 为 true 表示同一周期内按大小翻滚，使用下一个编号。调用方持有 mtx_
+    void OpenLogFile_(time_t now, bool nextIndex);
+    // 时刻 now 所在的翻滚周期编号
+    int64_t PeriodKey_(time_t now) const;
+    // 等待后台线程把所有环形缓冲区写空
+    void WaitDrained_();
+    // 后台线程：刷新环形缓冲区快照，返回尚未写盘的字节数
+    size_t PendingBytes_();
+    // 后台线程：把快照里所有环形缓冲区的数据写到文件，返回写出的字节数
+    size_t DrainRings_();
+    // 后台线程（延迟格式化模式）：解码快照里的记录，格式化成文本写到文件
+    size_t DrainDeferred_();
+    // 后台线程（二进制模式）：新文件先写文件头，再补上还没写进这个文件的格式串定义。调用方持有 mtx_
+    void BinaryPreamble_(std::string* out);
+    // 打开日志文件，并把 stdio 缓冲区设为 flushBytes_
+    FILE* OpenFile_(const char* fileName);
+    // 提交 stdio 缓冲区（同步模式），按 durability_ 决定是否 fdatasync。调用方持有 mtx_
+    void Commit_();
+    // writev 直到全部写完，处理部分写
+    static void WriteAll_(int fd, struct iovec* iov, int cnt);
+
 private:
+    // Log 实例个数（主日志、访问日志），决定每个线程的环形缓冲区槽位数
+    static const int LOG_INSTANCES = 2;
     static const int LOG_PATH_LEN = 256;
     static const int LOG_NAME_LEN = 256;
-    static const int MAX_LINES = 50000;
+    // 一行日志的最大长度，超出部分截断
+    static const int LOG_LINE_MAX = 2048;
+    // 估算环形缓冲区大小时每行按 256 字节计
+    static const int LOG_LINE_AVG = 256;
+    // 后台线程一次 writev 的最大段数
+    static const int LOG_IOV_MAX = 256;
+    // 达到该等级（ERROR）的日志立即提交
+    static const int LOG_LEVEL_ERROR = 3;
+
+    // 实例编号，用来在线程私有的环形缓冲区槽位里找到本实例的环
+    const int id_;
 
     // 文件与路径管理
     // 当前打开的日志文件指针
@@ -54,45 +187,156 @@ private:
     // 日志存放目录（如 ./log）和后缀名（如 .log）
     const char* path_;
     const char* suffix_;
-    // 单个日志文件的最大行数（默认 50,000）
-    int MAX_LINES_;
-    // 记录当前文件的行数和日期。用于实现日志自动翻滚（Rotation）：如果日期变了或者行数满了，就新建一个日志文件
-    int lineCount_;
-    int toDay_;
+    // 日志翻滚（Rotation）：周期变了或者文件写满了，就新建一个日志文件。以下由 mtx_ 保护
+    size_t maxFileBytes_;
+    int periodSec_;
+    int64_t periodKey_;
+    // 同一周期内按大小翻滚的编号，0 号文件不带编号
+    int fileIndex_;
+    // 当前文件已写入的字节数
+    size_t fileBytes_;
+    // 压缩和清理翻滚下来的旧文件
+    LogArchiver archiver_;
 
     // 标记日志系统当前是否处于运行状态
-    bool isOpen_;
- 
+    std::atomic<bool> isOpen_;
+
     // 缓冲区与级别
-    // 日志内容暂存区。在格式化字符串（使用 snprintf）时使用
+    // 日志内容暂存区。同步模式下在格式化字符串（使用 snprintf）时使用
     Buffer buff_;
     // 日志过滤等级（DEBUG, INFO, WARN, ERROR）。只有高于或等于该等级的日志才会被记录
-    int level_;
-    
+    std::atomic<int> level_;
+    std::atomic<int> moduleLevel_[MOD_COUNT];
+
     bool isAsync_;
 
-    std::unique_ptr<BlockDeque<std::string>> deque_; 
+    // 异步模式
+    // 每个写日志的线程一个环形缓冲区，由后台线程统一收集。登记/回收时才需要 ringMtx_
+    std::vector<std::shared_ptr<LogRing>> rings_;
+    Mutex ringMtx_;
+    // 后台线程每轮收集时使用的快照，避免写盘时还拿着 ringMtx_
+    std::vector<LogRing*> drainRings_;
+    std::atomic<size_t> ringCapacity_;
+    int fullPolicy_;
+    std::atomic<uint64_t> dropped_;
     std::unique_ptr<std::thread> writeThread_;
-    
+    // 唤醒后台线程。生产者只在攒够一批或 flush 时 notify，不拿锁
+    Mutex condMtx_;
+    CondVar cond_;
+    std::atomic<bool> isClose_;
+
+    // 组提交
+    size_t flushBytes_;
+    int flushIntervalMs_;
+    int durability_;
+    // 有 ERROR 日志或显式 flush，后台线程应立即提交
+    std::atomic<bool> urgent_;
+    // 同步模式下最早一条未提交日志的时刻（毫秒），0 表示没有。由 mtx_ 保护
+    int64_t dirtySince_;
+
+    // 二进制日志
+    std::atomic<int> format_;
+    std::atomic<bool> deferred_;
+    // 所有登记过的格式串，下标即 ID
+    std::vector<const char*> sites_;
+    std::mutex siteMtx_;
+    // 后台线程私有：解码用的格式串表、文本输出缓冲和跨越环尾时的拼接缓冲
+    std::vector<std::string> siteFmts_;
+    std::string textBuf_;
+    std::string scratch_;
+    // 每打开一个新文件加一；后台线程据此判断要不要重写文件头和格式串定义。由 mtx_ 保护
+    uint64_t fileGen_;
+    uint64_t defsGen_;
+    size_t defsWritten_;
+
     // 并发控制
-    // 保护 fp_ 和内部计数器（如 lineCount_）的互斥锁。注意，队列 deque_ 内部自带锁
-    std::mutex mtx_;
+    // 保护 fp_ 和同步模式下的 buff_。异步模式下请求线程只在翻滚文件时拿这把锁
+    Mutex mtx_;
 };
 
 // do { ... } while(0)：C++ 宏的经典技巧，确保宏在 if-else 等各种语法结构中能被当成一个独立语句，且必须以分号结尾
 // ##__VA_ARGS__：处理变长参数。前面的 ## 可以在参数为空时自动消去逗号，避免编译错误
+// 不再每行 flush：提交由 Log 的组提交策略决定（字节数/时间间隔/ERROR 级别）
+// 二进制模式下每个调用点的格式串只登记一次（局部静态变量），之后每次调用只编码参数
+#ifndef LOG_MODULE
+#define LOG_MODULE Log::MOD_CORE
+#endif
+
+// 编译期等级判断放在最外层，低于 LOG_MIN_LEVEL 的调用连 Log::Instance() 都不会生成
 #define LOG_BASE(level, format, ...) \
     do {\
-        Log* log = Log::Instance();\
-        if (log->IsOpen() && log->GetLevel() <= level) {\
-            log->write(level, format, ##__VA_ARGS__); \
-            log->flush();\
+        if ((level) >= LOG_MIN_LEVEL) {\
+            Log* log = Log::Instance();\
+            if (log->IsEnabled(LOG_MODULE, level)) {\
+                if (log->IsDeferred()) {\
+                    static const LogSite logSite(format);\
+                    log->WriteDeferred(level, logSite.id, ##__VA_ARGS__); \
+                } else {\
+                    log->write(level, format, ##__VA_ARGS__); \
+                }\
+            }\
         }\
     } while(0);
 
+template<typename... Args>
+void Log::WriteDeferred(int level, uint32_t site, Args... args) {
+    struct timeval now = {0, 0};
+    CoarseClock::WallTime(&now);
+
+    LogRing* ring = LocalRing_();
+    size_t contiguous = 0;
+    char* dst = ring->BeginWrite(&contiguous);
+    bool direct = contiguous >= static_cast<size_t>(LOG_LINE_MAX);
+    char rec[LOG_LINE_MAX];
+    LogEncoder enc(direct ? dst : rec, LOG_LINE_MAX, site,
+                    static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_usec, level);
+    // 按顺序编码每个参数（C++14 没有折叠表达式）
+    int expand[] = {0, (enc.Arg(args), 0)...};
+    (void)expand;
+    CommitRing_(ring, direct, rec, enc.Finish(), level);
+}
+
 #define LOG_DEBUG(format, ...) do {LOG_BASE(0, format, ##__VA_ARGS__)} while(0);
 #define LOG_INFO(format, ...) do {LOG_BASE(1, format, ##__VA_ARGS__)} while(0);
 #define LOG_WARN(format, ...) do {LOG_BASE(2, format, ##__VA_ARGS__)} while(0);
 #define LOG_ERROR(format, ...) do {LOG_BASE(3, format, ##__VA_ARGS__)} while(0);
 
+// 限速日志：同一个调用点每 intervalMs 毫秒最多输出一次，期间被压掉的条数在下一次输出前补一行
+// 用于压力下会刷屏的告警（连接池忙、连接数满等）
+class LogRateLimit {
+public:
+    explicit LogRateLimit(int intervalMs) : intervalMs_(intervalMs), next_(0), suppressed_(0) {}
+
+    // 允许输出时返回 true，并通过 suppressed 带回上次输出以来被压掉的条数
+    bool Allow(uint32_t* suppressed) {
+        int64_t now = CoarseClock::NowMs();
+        int64_t next = next_.load(std::memory_order_relaxed);
+        if(now < next || !next_.compare_exchange_strong(next, now + intervalMs_, std::memory_order_relaxed)) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        *suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    const int intervalMs_;
+    std::atomic<int64_t> next_;
+    std::atomic<uint32_t> suppressed_;
+};
+
+#define LOG_RATELIMIT(level, intervalMs, format, ...) \
+    do {\
+        if ((level) >= LOG_MIN_LEVEL && Log::Instance()->IsEnabled(LOG_MODULE, level)) {\
+            static LogRateLimit logLimit(intervalMs);\
+            uint32_t logSuppressed = 0;\
+            if (logLimit.Allow(&logSuppressed)) {\
+                if (logSuppressed > 0) { LOG_BASE(level, "(%u similar messages suppressed)", logSuppressed) }\
+                LOG_BASE(level, format, ##__VA_ARGS__)\
+            }\
+        }\
+    } while(0);
+
+#define LOG_WARN_RATELIMIT(intervalMs, format, ...) do {LOG_RATELIMIT(2, intervalMs, format, ##__VA_ARGS__)} while(0);
+
 #endif //LOG_H
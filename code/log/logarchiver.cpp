@@ -0,0 +1,173 @@
+/*
+ * @file logarchiver.cpp
+ * @brief LogArchiver类（日志压缩与保留策略）
+ */
+#include "logarchiver.h"
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <zlib.h>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+bool EndsWith(const string& s, const string& tail) {
+    return s.size() >= tail.size() && s.compare(s.size() - tail.size(), tail.size(), tail) == 0;
+}
+
+struct LogFile {
+    string path;
+    struct timespec mtime;
+    size_t size;
+};
+}
+
+LogArchiver::LogArchiver() : tasks_(64), compress_(true), maxFiles_(0), maxBytes_(0) {}
+
+LogArchiver::~LogArchiver() {
+    tasks_.Close();
+    if(thread_ && thread_->joinable()) {
+        thread_->join();
+    }
+}
+
+void LogArchiver::SetPolicy(bool compress, int maxFiles, size_t maxBytes) {
+    lock_guard<mutex> locker(mtx_);
+    compress_ = compress;
+    maxFiles_ = maxFiles > 0 ? maxFiles : 0;
+    maxBytes_ = maxBytes;
+}
+
+void LogArchiver::SetActive(const std::string& file) {
+    lock_guard<mutex> locker(mtx_);
+    active_ = file;
+}
+
+bool LogArchiver::IsActive_(const std::string& file) {
+    lock_guard<mutex> locker(mtx_);
+    return file == active_;
+}
+
+void LogArchiver::Submit(const std::string& dir, const std::string& suffix) {
+    // 只由写线程调用，第一次提交时才创建归档线程
+    if(!thread_) {
+        thread_.reset(new thread([this] { Run_(); }));
+    }
+    /* 队列满说明归档线程远远落后，每次扫描都是全量的，丢掉这次也没关系 */
+    if(!tasks_.full()) {
+        tasks_.push_back(Task{dir, suffix});
+    }
+}
+
+void LogArchiver::Run_() {
+    // 压缩是纯后台工作，降低本线程的调度优先级（Linux 下 nice 值按线程生效）
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+    Task task;
+    while(tasks_.pop(task)) {
+        RunOnce(task.dir, task.suffix);
+    }
+}
+
+void LogArchiver::RunOnce(const std::string& dir, const std::string& suffix) {
+    bool compress;
+    int maxFiles;
+    size_t maxBytes;
+    {
+        lock_guard<mutex> locker(mtx_);
+        compress = compress_;
+        maxFiles = maxFiles_;
+        maxBytes = maxBytes_;
+    }
+    string gzSuffix = suffix + ".gz";
+
+    /* 压缩：先列出文件，逐个判断是不是当前文件。新文件在创建之前就已经 SetActive，不会被误压缩 */
+    DIR* d = opendir(dir.c_str());
+    if(!d) { return; }
+    vector<string> names;
+    struct dirent* ent;
+    while((ent = readdir(d)) != nullptr) {
+        names.push_back(ent->d_name);
+    }
+    closedir(d);
+
+    vector<LogFile> files;
+    for(const string& name: names) {
+        bool plain = EndsWith(name, suffix);
+        if(!plain && !EndsWith(name, gzSuffix)) {
+            /* 上次压缩到一半留下的临时文件 */
+            if(EndsWith(name, gzSuffix + ".tmp")) { unlink((dir + "/" + name).c_str()); }
+            continue;
+        }
+        string path = dir + "/" + name;
+        if(plain && compress && !IsActive_(path) && Compress_(path)) {
+            path += ".gz";
+        }
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) { continue; }
+        files.push_back(LogFile{path, st.st_mtim, static_cast<size_t>(st.st_size)});
+    }
+
+    /* 保留策略：从最旧的开始删，直到文件数和总字节数都满足要求。当前文件永远保留 */
+    if(maxFiles == 0 && maxBytes == 0) { return; }
+    sort(files.begin(), files.end(), [](const LogFile& a, const LogFile& b) {
+        if(a.mtime.tv_sec != b.mtime.tv_sec) { return a.mtime.tv_sec < b.mtime.tv_sec; }
+        return a.mtime.tv_nsec < b.mtime.tv_nsec;
+    });
+    size_t total = 0;
+    for(const LogFile& f: files) { total += f.size; }
+    size_t count = files.size();
+    for(const LogFile& f: files) {
+        bool overCount = maxFiles > 0 && count > static_cast<size_t>(maxFiles);
+        bool overBytes = maxBytes > 0 && total > maxBytes;
+        if(!overCount && !overBytes) { break; }
+        if(IsActive_(f.path)) { continue; }
+        if(unlink(f.path.c_str()) == 0) {
+            count--;
+            total -= f.size;
+        }
+    }
+}
+
+bool LogArchiver::Compress_(const std::string& file) {
+    FILE* in = fopen(file.c_str(), "rb");
+    if(!in) { return false; }
+    string tmp = file + ".gz.tmp";
+    // 压缩级别 1：日志文本压缩率已经很高，优先省 CPU
+    gzFile out = gzopen(tmp.c_str(), "wb1");
+    if(!out) {
+        fclose(in);
+        return false;
+    }
+    char buf[64 * 1024];
+    size_t n;
+    bool ok = true;
+    while((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if(gzwrite(out, buf, static_cast<unsigned>(n)) != static_cast<int>(n)) {
+            ok = false;
+            break;
+        }
+    }
+    ok = ok && !ferror(in);
+    struct stat st;
+    ok = ok && fstat(fileno(in), &st) == 0;
+    fclose(in);
+    ok = (gzclose(out) == Z_OK) && ok;
+    if(ok) {
+        /* 保留原文件的修改时间，保留策略按它判断新旧 */
+        struct timespec times[2] = {st.st_atim, st.st_mtim};
+        utimensat(AT_FDCWD, tmp.c_str(), times, 0);
+    }
+    if(!ok || rename(tmp.c_str(), (file + ".gz").c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    unlink(file.c_str());
+    return true;
+}
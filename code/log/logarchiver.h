@@ -0,0 +1,58 @@
+/*
+ * @file logarchiver.h
+ * @brief LogArchiver类（日志压缩与保留策略）
+ */
+#ifndef LOGARCHIVER_H
+#define LOGARCHIVER_H
+
+#include <string>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include "blockqueue.h"
+
+/*
+ * 后台归档线程：日志翻滚后由写线程提交一次扫描任务，归档线程
+ *   1. 把目录下除当前文件以外、还没压缩的日志 gzip 压缩（xxx.log -> xxx.log.gz）
+ *   2. 按文件数和总字节数删除最旧的日志
+ * 每次都扫描整个目录，所以进程退出时没来得及压缩的文件会在下一次翻滚时补上
+ * 压缩先写 .gz.tmp，完成后 rename，中途崩溃不会留下半截的 .gz
+ */
+class LogArchiver {
+public:
+    LogArchiver();
+    ~LogArchiver();
+
+    // maxFiles / maxBytes 为 0 表示不限制
+    void SetPolicy(bool compress, int maxFiles, size_t maxBytes);
+
+    // 设置当前正在写的文件（完整路径），归档时跳过它。写线程在打开新文件之前调用
+    void SetActive(const std::string& file);
+
+    // 提交一次扫描任务，不等待
+    void Submit(const std::string& dir, const std::string& suffix);
+
+    // 同步执行一次扫描，测试用
+    void RunOnce(const std::string& dir, const std::string& suffix);
+
+private:
+    struct Task {
+        std::string dir;
+        std::string suffix;
+    };
+
+    void Run_();
+    bool IsActive_(const std::string& file);
+    // gzip 压缩 file，成功后删除原文件
+    static bool Compress_(const std::string& file);
+
+    BlockDeque<Task> tasks_;
+    std::unique_ptr<std::thread> thread_;
+    std::mutex mtx_;
+    std::string active_;
+    bool compress_;
+    int maxFiles_;
+    size_t maxBytes_;
+};
+
+#endif // LOGARCHIVER_H
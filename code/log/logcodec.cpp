@@ -0,0 +1,243 @@
+/*
+ * @file logcodec.cpp
+ * @brief LogCodec类（二进制日志的解码）
+ */
+#include "logcodec.h"
+#include <stdio.h>
+
+using namespace std;
+
+namespace {
+const char* LevelTitle(int level) {
+    switch(level) {
+    case 0:
+        return "[debug]: ";
+    case 1:
+        return "[info] : ";
+    case 2:
+        return "[warn] : ";
+    case 3:
+        return "[error]: ";
+    default:
+        return "[info] : ";
+    }
+}
+
+// 顺序读取编码后的参数
+struct ArgReader {
+    const char* cur;
+    const char* end;
+
+    bool Next(uint8_t* tag, uint64_t* bits, const char** str, size_t* strLen) {
+        if(cur >= end) { return false; }
+        *tag = static_cast<uint8_t>(*cur++);
+        if(*tag == LogFormat::ARG_STR) {
+            if(end - cur < 2) { return false; }
+            uint16_t n;
+            memcpy(&n, cur, 2);
+            cur += 2;
+            if(static_cast<size_t>(end - cur) < n) { return false; }
+            *str = cur;
+            *strLen = n;
+            cur += n;
+            return true;
+        }
+        if(end - cur < 8) { return false; }
+        memcpy(bits, cur, 8);
+        cur += 8;
+        return true;
+    }
+};
+
+// snprintf 到 out 尾部
+template<typename V>
+void AppendFormat(std::string* out, const std::string& spec, V v) {
+    char buf[256];
+    int n = snprintf(buf, sizeof(buf), spec.c_str(), v);
+    if(n < 0) { return; }
+    if(static_cast<size_t>(n) < sizeof(buf)) {
+        out->append(buf, n);
+        return;
+    }
+    std::vector<char> big(n + 1);
+    snprintf(big.data(), big.size(), spec.c_str(), v);
+    out->append(big.data(), n);
+}
+}
+
+int LogCodec::FormatPrefix(char* buf, size_t len, const struct timeval& now, const struct tm& t, int level) {
+    int n = snprintf(buf, len, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s",
+                t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+                t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec, LevelTitle(level));
+    return n < 0 ? 0 : (static_cast<size_t>(n) >= len ? len - 1 : n);
+}
+
+size_t LogCodec::RecordLen(const char* data, size_t len) {
+    if(len < LogFormat::RECORD_HEADER) { return 0; }
+    uint32_t n;
+    memcpy(&n, data, 4);
+    if(n < LogFormat::RECORD_HEADER) { return 0; }
+    return n;
+}
+
+void LogCodec::EncodeSiteDef(uint32_t id, const char* fmt, std::string* out) {
+    uint32_t fmtLen = static_cast<uint32_t>(strlen(fmt));
+    char head[LogFormat::RECORD_HEADER + 8] = {0};
+    uint32_t len = sizeof(head) + fmtLen;
+    uint32_t site = LogFormat::SITE_DEF;
+    memcpy(head, &len, 4);
+    memcpy(head + 4, &site, 4);
+    memcpy(head + LogFormat::RECORD_HEADER, &id, 4);
+    memcpy(head + LogFormat::RECORD_HEADER + 4, &fmtLen, 4);
+    out->append(head, sizeof(head));
+    out->append(fmt, fmtLen);
+}
+
+bool LogCodec::DecodeRecord(const char* rec, size_t len, std::vector<std::string>* fmts, std::string* out) {
+    if(len < LogFormat::RECORD_HEADER) { return false; }
+    uint32_t site;
+    int64_t usec;
+    memcpy(&site, rec + 4, 4);
+    memcpy(&usec, rec + 8, 8);
+    int level = static_cast<unsigned char>(rec[16]);
+    const char* body = rec + LogFormat::RECORD_HEADER;
+    size_t bodyLen = len - LogFormat::RECORD_HEADER;
+
+    if(site == LogFormat::SITE_DEF) {
+        uint32_t id, fmtLen;
+        if(bodyLen < 8) { return false; }
+        memcpy(&id, body, 4);
+        memcpy(&fmtLen, body + 4, 4);
+        if(bodyLen - 8 < fmtLen) { return false; }
+        if(fmts->size() <= id) { fmts->resize(id + 1); }
+        (*fmts)[id].assign(body + 8, fmtLen);
+        return true;
+    }
+    if(site >= fmts->size()) { return false; }
+
+    struct timeval tv;
+    tv.tv_sec = static_cast<time_t>(usec / 1000000);
+    tv.tv_usec = static_cast<suseconds_t>(usec % 1000000);
+    /* 同一秒内的记录复用上一次 localtime_r 的结果 */
+    static thread_local time_t cachedSec = -1;
+    static thread_local struct tm t;
+    if(tv.tv_sec != cachedSec) {
+        localtime_r(&tv.tv_sec, &t);
+        cachedSec = tv.tv_sec;
+    }
+    char prefix[128];
+    int n = FormatPrefix(prefix, sizeof(prefix), tv, t, level);
+    out->append(prefix, n);
+    FormatMessage((*fmts)[site].c_str(), body, bodyLen, out);
+    out->push_back('\n');
+    return true;
+}
+
+void LogCodec::FormatMessage(const char* fmt, const char* args, size_t argLen, std::string* out) {
+    ArgReader reader = {args, args + argLen};
+    uint8_t tag = 0;
+    uint64_t bits = 0;
+    const char* str = nullptr;
+    size_t strLen = 0;
+
+    while(*fmt) {
+        if(*fmt != '%') {
+            const char* next = strchr(fmt, '%');
+            if(!next) { next = fmt + strlen(fmt); }
+            out->append(fmt, next - fmt);
+            fmt = next;
+            continue;
+        }
+        if(fmt[1] == '%') {
+            out->push_back('%');
+            fmt += 2;
+            continue;
+        }
+
+        /*
+         * 解析一个转换说明：%[flags][width][.precision][length]conv
+         * 编码时整数都扩展成了 64 位，这里和文本模式的 printf 一样按长度修饰符取宽度：
+         * 没有修饰符或 h/hh 时只看低 32 位（%x 输出负的 int 是 8 位十六进制，%d 输出大于 INT_MAX 的 unsigned 是负数）
+         */
+        std::string spec = "%";
+        fmt++;
+        while(*fmt && strchr("-+ #0'", *fmt)) { spec.push_back(*fmt++); }
+        for(int part = 0; part < 2; part++) {
+            if(part == 1) {
+                if(*fmt != '.') { break; }
+                spec.push_back(*fmt++);
+            }
+            if(*fmt == '*') {
+                /* 宽度/精度由参数给出 */
+                fmt++;
+                if(reader.Next(&tag, &bits, &str, &strLen) && tag != LogFormat::ARG_STR) {
+                    spec += to_string(static_cast<int>(static_cast<int64_t>(bits)));
+                }
+            }
+            while(*fmt >= '0' && *fmt <= '9') { spec.push_back(*fmt++); }
+        }
+        std::string length;
+        while(*fmt && strchr("hlLqjzt", *fmt)) { length.push_back(*fmt++); }
+        bool narrow = length.empty() || length[0] == 'h';
+        char conv = *fmt;
+        if(conv == '\0') { break; }
+        fmt++;
+        if(conv == 'n') { continue; }
+
+        if(!reader.Next(&tag, &bits, &str, &strLen)) {
+            out->append("<missing>");
+            continue;
+        }
+        if(tag == LogFormat::ARG_STR) {
+            std::string s(str, strLen);
+            if(conv == 's') {
+                AppendFormat(out, spec + 's', s.c_str());
+            } else {
+                out->append(s);
+            }
+            continue;
+        }
+
+        int64_t i64;
+        uint64_t u64 = bits;
+        double d;
+        memcpy(&i64, &bits, 8);
+        memcpy(&d, &bits, 8);
+        if(tag == LogFormat::ARG_DOUBLE) {
+            i64 = static_cast<int64_t>(d);
+            u64 = static_cast<uint64_t>(i64);
+        } else {
+            d = (tag == LogFormat::ARG_INT) ? static_cast<double>(i64) : static_cast<double>(u64);
+        }
+
+        switch(conv) {
+        case 'd': case 'i':
+            if(narrow) { AppendFormat(out, spec + length + conv, static_cast<int>(static_cast<int32_t>(u64))); }
+            else { AppendFormat(out, spec + "lld", static_cast<long long>(i64)); }
+            break;
+        case 'u': case 'o': case 'x': case 'X':
+            if(narrow) { AppendFormat(out, spec + length + conv, static_cast<unsigned>(static_cast<uint32_t>(u64))); }
+            else { AppendFormat(out, spec + "ll" + conv, static_cast<unsigned long long>(u64)); }
+            break;
+        case 'c':
+            AppendFormat(out, spec + 'c', static_cast<int>(i64));
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            AppendFormat(out, spec + conv, d);
+            break;
+        case 'p':
+            AppendFormat(out, spec + 'p', reinterpret_cast<void*>(static_cast<uintptr_t>(u64)));
+            break;
+        case 's':
+            /* 格式串要字符串但记录的是数值，按数值输出 */
+            if(tag == LogFormat::ARG_INT) { AppendFormat(out, std::string("%lld"), static_cast<long long>(i64)); }
+            else if(tag == LogFormat::ARG_DOUBLE) { AppendFormat(out, std::string("%g"), d); }
+            else { AppendFormat(out, std::string("%llu"), static_cast<unsigned long long>(u64)); }
+            break;
+        default:
+            out->push_back('%');
+            out->push_back(conv);
+            break;
+        }
+    }
+}
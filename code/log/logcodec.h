@@ -0,0 +1,140 @@
+/*
+ * @file logcodec.h
+ * @brief LogEncoder / LogCodec类（二进制日志的编码与解码）
+ */
+#ifndef LOGCODEC_H
+#define LOGCODEC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <sys/time.h>
+#include <time.h>
+
+/*
+ * 二进制日志：调用点只记录 格式串 ID + 时间戳 + 参数的原始字节，格式化推迟到后台线程或离线解码工具
+ *
+ * 文件格式（.blog）
+ *   文件头： 8 字节魔数 "TWSBLOG1"
+ *   记录：   [u32 len][u32 site][i64 usec][u8 level][参数...]     len 为整条记录的字节数（含记录头）
+ *   参数：   [u8 tag][payload]   整数/指针/浮点 8 字节，字符串为 [u16 len][bytes]
+ *   site 为 LOG_SITE_DEF 的记录是格式串定义：[u32 id][u32 len][bytes]，每个文件在引用之前都会先写一遍定义
+ * 所有整数按本机字节序存放，解码工具只需要在同一种机器上运行
+ */
+namespace LogFormat {
+    const char MAGIC[] = "TWSBLOG1";
+    const size_t MAGIC_LEN = 8;
+    const size_t RECORD_HEADER = 17;
+    // 格式串定义记录
+    const uint32_t SITE_DEF = 0xffffffffu;
+    // 已经格式化好的文本（Log::write 在二进制模式下使用），格式串固定为 "%s"
+    const uint32_t SITE_TEXT = 0;
+
+    enum ARG_TAG {
+        ARG_INT = 1,
+        ARG_UINT,
+        ARG_DOUBLE,
+        ARG_STR,
+        ARG_PTR,
+    };
+}
+
+/*
+ * 把一条记录编码进调用方提供的缓冲区（可以直接是环形缓冲区里的连续空间）
+ * 空间不足时字符串会被截断，放不下的定长参数被丢弃，保证记录总是完整的
+ */
+class LogEncoder {
+public:
+    LogEncoder(char* buf, size_t cap, uint32_t site, int64_t usec, int level)
+        : begin_(buf), cur_(buf + LogFormat::RECORD_HEADER), end_(buf + cap) {
+        memcpy(begin_ + 4, &site, 4);
+        memcpy(begin_ + 8, &usec, 8);
+        begin_[16] = static_cast<char>(level);
+    }
+
+    // 整数和枚举统一扩展成 64 位
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+    Arg(T v) {
+        if(std::is_signed<T>::value || std::is_enum<T>::value) {
+            Put_(LogFormat::ARG_INT, static_cast<int64_t>(v));
+        } else {
+            Put_(LogFormat::ARG_UINT, static_cast<uint64_t>(v));
+        }
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type
+    Arg(T v) {
+        Put_(LogFormat::ARG_DOUBLE, static_cast<double>(v));
+    }
+
+    // 字符串必须拷贝：调用返回后指针可能已经失效
+    void Arg(const char* s) { Str_(s ? s : "(null)", s ? strlen(s) : 6); }
+    void Arg(char* s) { Arg(static_cast<const char*>(s)); }
+    void Arg(const std::string& s) { Str_(s.data(), s.size()); }
+
+    template<typename T>
+    void Arg(const T* p) {
+        Put_(LogFormat::ARG_PTR, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p)));
+    }
+
+    // 写入记录长度，返回整条记录的字节数
+    size_t Finish() {
+        uint32_t len = static_cast<uint32_t>(cur_ - begin_);
+        memcpy(begin_, &len, 4);
+        return len;
+    }
+
+private:
+    template<typename V>
+    void Put_(uint8_t tag, V v) {
+        if(static_cast<size_t>(end_ - cur_) < 1 + sizeof(V)) { return; }
+        *cur_++ = static_cast<char>(tag);
+        memcpy(cur_, &v, sizeof(V));
+        cur_ += sizeof(V);
+    }
+
+    void Str_(const char* s, size_t len) {
+        size_t avail = end_ - cur_;
+        if(avail < 3) { return; }
+        if(len > avail - 3) { len = avail - 3; }
+        if(len > 0xffff) { len = 0xffff; }
+        uint16_t n = static_cast<uint16_t>(len);
+        *cur_++ = static_cast<char>(LogFormat::ARG_STR);
+        memcpy(cur_, &n, 2);
+        memcpy(cur_ + 2, s, len);
+        cur_ += 2 + len;
+    }
+
+    char* begin_;
+    char* cur_;
+    char* end_;
+};
+
+/*
+ * 解码：后台线程（延迟格式化模式）和离线工具 logdecode 共用
+ * 参数类型与格式串匹配时（-Wformat 不报警），输出与文本模式逐字节相同
+ */
+class LogCodec {
+public:
+    // 格式化行首的时间戳和等级标题，返回写入的字节数
+    static int FormatPrefix(char* buf, size_t len, const struct timeval& now, const struct tm& t, int level);
+
+    // 读取一条记录的长度，数据不足一个记录头或长度非法时返回 0
+    static size_t RecordLen(const char* data, size_t len);
+
+    // 把一条记录格式化成一行文本追加到 out。格式串定义记录会更新 fmts，不产生输出
+    // 返回 false 表示记录损坏或引用了未定义的格式串
+    static bool DecodeRecord(const char* rec, size_t len, std::vector<std::string>* fmts, std::string* out);
+
+    // 按 printf 的格式串展开编码后的参数：整数的宽度由格式串的长度修饰符决定，有无符号、整数还是浮点以 tag 为准
+    static void FormatMessage(const char* fmt, const char* args, size_t argLen, std::string* out);
+
+    // 生成一条格式串定义记录
+    static void EncodeSiteDef(uint32_t id, const char* fmt, std::string* out);
+};
+
+#endif // LOGCODEC_H
@@ -0,0 +1,113 @@
+/*
+ * @file logring.h
+ * @brief LogRing类（单生产者单消费者字节环）
+ */
+#ifndef LOGRING_H
+#define LOGRING_H
+
+#include <atomic>
+#include <vector>
+#include <string.h>
+#include <assert.h>
+#include <sys/uio.h> // iovec
+
+/*
+ * 每个写日志的线程独占一个 LogRing（生产者），后台写线程是唯一的消费者
+ * head_ 只由生产者写，tail_ 只由消费者写，双方用 acquire/release 交换进度，全程无锁
+ * 一行日志写完整之后才推进 head_，所以消费者看到的 [tail_, head_) 总是完整的若干行，可以直接交给 writev
+ */
+class LogRing {
+public:
+    // capacity 会向上取整为 2 的幂，下标用位与代替取模
+    explicit LogRing(size_t capacity) : head_(0), tail_(0), retired_(false) {
+        size_t cap = 1024;
+        while(cap < capacity) { cap <<= 1; }
+        buffer_.resize(cap);
+        mask_ = cap - 1;
+    }
+
+    size_t Capacity() const { return buffer_.size(); }
+
+    /* ---------- 生产者 ---------- */
+
+    // 当前可写字节数
+    size_t WritableBytes() const {
+        return buffer_.size() - (head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire));
+    }
+
+    // 返回写位置指针，*contiguous 为从该位置到环尾（或到已占用区域）之间的连续可写字节数
+    // 日志可以直接 snprintf 进这块空间，写完后调用 Commit 发布
+    char* BeginWrite(size_t* contiguous) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t writable = WritableBytes();
+        size_t toEnd = buffer_.size() - (head & mask_);
+        *contiguous = writable < toEnd ? writable : toEnd;
+        return &buffer_[head & mask_];
+    }
+
+    void Commit(size_t len) {
+        assert(len <= WritableBytes());
+        head_.store(head_.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    // 拷贝写入（可跨越环尾），空间不足返回 false，不写入任何字节
+    bool Write(const char* data, size_t len) {
+        if(WritableBytes() < len) { return false; }
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t pos = head & mask_;
+        size_t first = buffer_.size() - pos;
+        if(first > len) { first = len; }
+        memcpy(&buffer_[pos], data, first);
+        memcpy(&buffer_[0], data + first, len - first);
+        head_.store(head + len, std::memory_order_release);
+        return true;
+    }
+
+    // 线程退出时标记，后台线程把剩余数据写完后回收这个环
+    void Retire() { retired_.store(true, std::memory_order_release); }
+    bool IsRetired() const { return retired_.load(std::memory_order_acquire); }
+
+    /* ---------- 消费者 ---------- */
+
+    size_t ReadableBytes() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+    }
+
+    // 把 [tail_, head_) 填进最多两个 iovec（跨越环尾时分成两段），返回 iovec 个数
+    int Peek(struct iovec* iov) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t readable = ReadableBytes();
+        if(readable == 0) { return 0; }
+        size_t pos = tail & mask_;
+        size_t first = buffer_.size() - pos;
+        if(first >= readable) {
+            iov[0].iov_base = &buffer_[pos];
+            iov[0].iov_len = readable;
+            return 1;
+        }
+        iov[0].iov_base = &buffer_[pos];
+        iov[0].iov_len = first;
+        iov[1].iov_base = &buffer_[0];
+        iov[1].iov_len = readable - first;
+        return 2;
+    }
+
+    void Consume(size_t len) {
+        assert(len <= ReadableBytes());
+        tail_.store(tail_.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+private:
+    std::vector<char> buffer_;
+    size_t mask_;
+    // head_ 和 tail_ 分别被两个线程频繁写，用填充把它们隔到不同的缓存行上，避免伪共享
+    // （C++14 的 new 不保证 alignas(64)，所以用填充而不是对齐）
+    char pad0_[64];
+    std::atomic<size_t> head_;
+    char pad1_[64];
+    std::atomic<size_t> tail_;
+    char pad2_[64];
+    std::atomic<bool> retired_;
+};
+
+#endif // LOGRING_H
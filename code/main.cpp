@@ -7,14 +7,34 @@
 #include "signal.h"
 
 int main(int argc, char *argv[]) {
-    // signal(SIGPIPE, SIG_IGN);
+    // 客户端在响应写到一半时断开，writev 会触发 SIGPIPE，默认动作是结束进程；忽略后 writev 返回 EPIPE，按出错关闭连接
+    signal(SIGPIPE, SIG_IGN);
     //命令行解析
     Config config;
     config.parse_arg(argc, argv);
+    /* 访问日志（./log/access）和主日志用同一套写满、组提交、翻滚和归档策略 */
+    for(Log* log: {Log::Instance(), Log::AccessInstance()}) {
+        log->SetFullPolicy(config.logFullPolicy_);
+        log->SetFlushPolicy(static_cast<size_t>(config.logFlushKB_) << 10, config.logFlushMs_, config.logDurability_);
+        log->SetRotatePolicy(static_cast<size_t>(config.logFileMB_) << 20, config.logPeriodSec_);
+        log->SetRetention(config.logCompress_, config.logKeepFiles_,
+                          static_cast<size_t>(config.logKeepMB_) << 20);
+    }
+    Log::Instance()->SetFormat(config.logFormat_);
+    Log::Instance()->SetModuleLevels(config.logModules_);
+    SqlConnPool::Instance()->SetPolicy(config.sqlMaxNum_, config.sqlWaitMs_, config.sqlLazyWarmup_);
+    /* 用户不存在的条目有效期较短，别的节点上注册的用户很快就能登录 */
+    CredCache::Instance()->Init(config.credCacheSize_ > 0 ? config.credCacheSize_ : 0,
+                                config.credCacheTtl_ * 1000, std::min(config.credCacheTtl_, 5) * 1000);
+    AccessLog::Configure(config.accessLog_, config.accessSample_, config.accessSlowMs_);
+    TraceRing::Instance()->Init(config.traceRing_ > 0 ? config.traceRing_ : 0);
 
     WebServer server(
         config.port_, config.trigMode_, config.timeoutMS_, config.OptLinger_,
         config.sqlPort_, config.sqlUser_, config.sqlPwd_, config.dbName_,
-        config.sqlNum_, config.threadNum_, config.openLog_, config.logLevel_, config.logQueSize_);
+        config.sqlNum_, config.threadNum_, config.openLog_, config.logLevel_, config.logQueSize_,
+        config.lazyTimer_, config.sqlAsyncNum_, config.sqlLazyWarmup_,
+        config.authBackend_, config.authFile_, config.sqlBatchMs_,
+        config.metricsPath_);
     server.Start();
 } 
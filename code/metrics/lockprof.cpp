@@ -0,0 +1,78 @@
+/*
+ * @file lockprof.cpp
+ * @brief 锁竞争剖析（带统计的互斥锁与条件变量）
+ */
+#include "lockprof.h"
+
+#ifdef TWS_LOCK_PROFILE
+#include <time.h>
+#include <string>
+#include <unordered_map>
+#include "metrics.h"
+using namespace std;
+
+namespace {
+int64_t NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+}
+
+LockSite* LockSite::Get(const char* name) {
+    /* 注册表本身用普通的 std::mutex，不剖析自己；LockSite 不释放，退出时还在加锁的线程不会用到已经析构的统计 */
+    static std::mutex mtx;
+    static unordered_map<string, LockSite*>* sites = new unordered_map<string, LockSite*>();
+    lock_guard<std::mutex> locker(mtx);
+    LockSite*& site = (*sites)[name];
+    if(!site) {
+        string label = string("{lock=\"") + name + "\"}";
+        Metrics* metrics = Metrics::Instance();
+        site = new LockSite();
+        site->acquires = metrics->Counter("tws_lock_acquires_total" + label, "Lock acquisitions");
+        site->contended = metrics->Counter("tws_lock_contended_total" + label, "Lock acquisitions that had to wait");
+        site->waitNs = metrics->Histogram("tws_lock_wait_ns" + label, "Time spent waiting for a contended lock, nanoseconds");
+        site->holdNs = metrics->Histogram("tws_lock_hold_ns" + label, "Time a lock is held, nanoseconds");
+        site->condWaitUs = metrics->Histogram("tws_cond_wait_us" + label, "Time spent in condition variable waits, microseconds");
+    }
+    return site;
+}
+
+ProfiledMutex::ProfiledMutex(): site_(LockSite::Get("unnamed")), lockedNs_(0) {}
+
+void ProfiledMutex::lock() {
+    if(!mtx_.try_lock()) {
+        int64_t start = NowNs();
+        mtx_.lock();
+        lockedNs_ = NowNs();
+        site_->contended->Add();
+        site_->waitNs->Record(lockedNs_ - start);
+    } else {
+        lockedNs_ = NowNs();
+    }
+    site_->acquires->Add();
+}
+
+bool ProfiledMutex::try_lock() {
+    if(!mtx_.try_lock()) { return false; }
+    lockedNs_ = NowNs();
+    site_->acquires->Add();
+    return true;
+}
+
+void ProfiledMutex::unlock() {
+    int64_t held = NowNs() - lockedNs_;
+    LockSite* site = site_;
+    mtx_.unlock();
+    site->holdNs->Record(held);
+}
+
+int64_t ProfiledCondVar::Begin_() {
+    return NowNs();
+}
+
+void ProfiledCondVar::End_(Lock& lock, int64_t start) {
+    lock.mutex()->Site()->condWaitUs->Record((NowNs() - start) / 1000);
+}
+
+#endif // TWS_LOCK_PROFILE
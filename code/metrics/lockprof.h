@@ -0,0 +1,123 @@
+/*
+ * @file lockprof.h
+ * @brief 锁竞争剖析（带统计的互斥锁与条件变量）
+ */
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include <mutex>
+#include <condition_variable>
+
+/*
+ * 服务器里的互斥锁和条件变量统一写成 Mutex / CondVar，构造时用 LockName 起名，例如：
+ *   Mutex mtx_;  CondVar cond_;  ...  LockName(mtx_, "sqlpool");
+ *   std::unique_lock<Mutex> locker(mtx_);  cond_.wait(locker);
+ *
+ * 默认构建下它们就是 std::mutex / std::condition_variable，LockName 是空函数，没有任何开销
+ * make LOCK_PROFILE=1（定义 TWS_LOCK_PROFILE）时换成带统计的版本，按名字汇总到指标里：
+ *   tws_lock_acquires_total{lock="..."}    加锁次数
+ *   tws_lock_contended_total{lock="..."}   其中 try_lock 失败、需要等待的次数
+ *   tws_lock_wait_ns{lock="..."}           等锁时间（只统计需要等待的那些）
+ *   tws_lock_hold_ns{lock="..."}           持锁时间
+ *   tws_cond_wait_us{lock="..."}           在这把锁的条件变量上等待的时间
+ * 同名的多把锁（例如 CredCache 的各个分片）合在一起统计。剖析版本每次加锁多两次取时钟，只用于定位问题
+ */
+#ifndef TWS_LOCK_PROFILE
+
+typedef std::mutex Mutex;
+typedef std::condition_variable CondVar;
+inline void LockName(Mutex&, const char*) {}
+
+#else
+
+#include <stdint.h>
+#include <chrono>
+
+class MetricCounter;
+class MetricHistogram;
+
+// 一个名字下的全部统计，第一次用到这个名字时注册，之后一直有效
+struct LockSite {
+    MetricCounter* acquires;
+    MetricCounter* contended;
+    MetricHistogram* waitNs;
+    MetricHistogram* holdNs;
+    MetricHistogram* condWaitUs;
+
+    static LockSite* Get(const char* name);
+};
+
+class ProfiledMutex {
+public:
+    ProfiledMutex();
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+    void SetName(const char* name) { site_ = LockSite::Get(name); }
+    LockSite* Site() const { return site_; }
+
+private:
+    std::mutex mtx_;
+    LockSite* site_;
+    // 加锁成功的时刻，只有持锁线程读写
+    int64_t lockedNs_;
+};
+
+// condition_variable_any 加上等待时间统计，等待前后对锁的解锁/加锁照常计入 ProfiledMutex
+class ProfiledCondVar {
+public:
+    typedef std::unique_lock<ProfiledMutex> Lock;
+
+    void notify_one() noexcept { cond_.notify_one(); }
+    void notify_all() noexcept { cond_.notify_all(); }
+
+    void wait(Lock& lock) {
+        int64_t start = Begin_();
+        cond_.wait(lock);
+        End_(lock, start);
+    }
+    template<class Pred>
+    void wait(Lock& lock, Pred pred) {
+        while(!pred()) { wait(lock); }
+    }
+    template<class Clock, class Duration>
+    std::cv_status wait_until(Lock& lock, const std::chrono::time_point<Clock, Duration>& deadline) {
+        int64_t start = Begin_();
+        std::cv_status status = cond_.wait_until(lock, deadline);
+        End_(lock, start);
+        return status;
+    }
+    template<class Clock, class Duration, class Pred>
+    bool wait_until(Lock& lock, const std::chrono::time_point<Clock, Duration>& deadline, Pred pred) {
+        while(!pred()) {
+            if(wait_until(lock, deadline) == std::cv_status::timeout) { return pred(); }
+        }
+        return true;
+    }
+    template<class Rep, class Period>
+    std::cv_status wait_for(Lock& lock, const std::chrono::duration<Rep, Period>& rel) {
+        return wait_until(lock, std::chrono::steady_clock::now() + rel);
+    }
+    template<class Rep, class Period, class Pred>
+    bool wait_for(Lock& lock, const std::chrono::duration<Rep, Period>& rel, Pred pred) {
+        return wait_until(lock, std::chrono::steady_clock::now() + rel, std::move(pred));
+    }
+
+private:
+    static int64_t Begin_();
+    static void End_(Lock& lock, int64_t start);
+
+    std::condition_variable_any cond_;
+};
+
+typedef ProfiledMutex Mutex;
+typedef ProfiledCondVar CondVar;
+inline void LockName(Mutex& mtx, const char* name) { mtx.SetName(name); }
+
+#endif // TWS_LOCK_PROFILE
+
+#endif // LOCKPROF_H
@@ -0,0 +1,227 @@
+/*
+ * @file metrics.cpp
+ * @brief Metrics类（计数器、直方图与 Prometheus 导出）
+ */
+#include "metrics.h"
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+#include <unordered_map>
+using namespace std;
+
+namespace {
+const int SHARDS = 16;
+// 导出的最大 le 边界 4^20，更大的值只计入 +Inf
+const uint64_t EXPORT_MAX = 1ull << 40;
+
+// 当前线程的分片，第一次用到时轮流分配
+int ShardIndex() {
+    static atomic<int> next(0);
+    thread_local int index = next.fetch_add(1, memory_order_relaxed) % SHARDS;
+    return index;
+}
+
+// 名字里标签之前的部分
+string BaseName(const string& name) {
+    return name.substr(0, name.find('{'));
+}
+
+// 在名字上加一个标签：name{a="b"} + c="d" -> name{a="b",c="d"}
+string WithLabel(const string& name, const string& suffix, const string& label) {
+    string::size_type brace = name.find('{');
+    if(brace == string::npos) {
+        return label.empty() ? name + suffix : name + suffix + "{" + label + "}";
+    }
+    string labels = name.substr(brace + 1, name.size() - brace - 2);
+    if(!label.empty()) { labels += "," + label; }
+    return name.substr(0, brace) + suffix + "{" + labels + "}";
+}
+
+void AppendLine(string* out, const string& name, double value) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), " %.17g\n", value);
+    *out += name;
+    *out += buf;
+}
+
+void AppendLine(string* out, const string& name, uint64_t value) {
+    *out += name;
+    *out += " ";
+    *out += to_string(value);
+    *out += "\n";
+}
+}
+
+MetricCounter::MetricCounter() {
+    for(Cell& cell: cells_) {
+        cell.value.store(0, memory_order_relaxed);
+    }
+}
+
+void MetricCounter::Add(uint64_t n) {
+    cells_[ShardIndex()].value.fetch_add(n, memory_order_relaxed);
+}
+
+uint64_t MetricCounter::Value() const {
+    uint64_t sum = 0;
+    for(const Cell& cell: cells_) {
+        sum += cell.value.load(memory_order_relaxed);
+    }
+    return sum;
+}
+
+MetricHistogram::MetricHistogram(): shards_(new Shard[SHARDS]()) {}
+
+int MetricHistogram::BucketOf(uint64_t value) {
+    if(value < static_cast<uint64_t>(SUB_COUNT)) { return static_cast<int>(value); }
+    int exp = 63 - __builtin_clzll(value);
+    if(exp > MAX_EXP) { return BUCKETS - 1; }
+    /* 最高位之后的 SUB_BITS 位决定段内的桶 */
+    return (exp - SUB_BITS + 1) * SUB_COUNT + static_cast<int>((value >> (exp - SUB_BITS)) & (SUB_COUNT - 1));
+}
+
+uint64_t MetricHistogram::BucketLow(int bucket) {
+    if(bucket < SUB_COUNT) { return bucket; }
+    int exp = bucket / SUB_COUNT + SUB_BITS - 1;
+    return static_cast<uint64_t>(SUB_COUNT + bucket % SUB_COUNT) << (exp - SUB_BITS);
+}
+
+uint64_t MetricHistogram::BucketWidth(int bucket) {
+    if(bucket < SUB_COUNT) { return 1; }
+    return 1ull << (bucket / SUB_COUNT - 1);
+}
+
+void MetricHistogram::Record(uint64_t value) {
+    Shard& shard = shards_[ShardIndex()];
+    shard.buckets[BucketOf(value)].fetch_add(1, memory_order_relaxed);
+    shard.count.fetch_add(1, memory_order_relaxed);
+    shard.sum.fetch_add(value, memory_order_relaxed);
+}
+
+MetricHistogram::Snapshot MetricHistogram::Snap() const {
+    Snapshot snap;
+    snap.count = snap.sum = 0;
+    snap.buckets.assign(BUCKETS, 0);
+    for(int i = 0; i < SHARDS; i++) {
+        const Shard& shard = shards_[i];
+        snap.sum += shard.sum.load(memory_order_relaxed);
+        for(int b = 0; b < BUCKETS; b++) {
+            snap.buckets[b] += shard.buckets[b].load(memory_order_relaxed);
+        }
+    }
+    /* 总数取各桶之和，和分位数的计算保持一致 */
+    for(uint64_t n: snap.buckets) {
+        snap.count += n;
+    }
+    return snap;
+}
+
+uint64_t MetricHistogram::Snapshot::Quantile(double q) const {
+    if(count == 0) { return 0; }
+    uint64_t rank = static_cast<uint64_t>(q * count);
+    if(rank >= count) { rank = count - 1; }
+    uint64_t seen = 0;
+    for(int b = 0; b < BUCKETS; b++) {
+        seen += buckets[b];
+        if(seen > rank) {
+            return BucketLow(b) + BucketWidth(b) / 2;
+        }
+    }
+    return BucketLow(BUCKETS - 1);
+}
+
+Metrics* Metrics::Instance() {
+    /* 不析构：退出时还在运行的线程（线程池、日志线程）可能仍在记录 */
+    static Metrics* metrics = new Metrics();
+    return metrics;
+}
+
+Metrics::Entry& Metrics::Add_(const std::string& name, const std::string& help, TYPE type) {
+    lock_guard<mutex> locker(mtx_);
+    entries_.emplace_back(new Entry());
+    Entry& entry = *entries_.back();
+    entry.name = name;
+    entry.help = help;
+    entry.type = type;
+    return entry;
+}
+
+MetricCounter* Metrics::Counter(const std::string& name, const std::string& help) {
+    Entry& entry = Add_(name, help, COUNTER);
+    entry.counter.reset(new MetricCounter());
+    return entry.counter.get();
+}
+
+MetricHistogram* Metrics::Histogram(const std::string& name, const std::string& help) {
+    Entry& entry = Add_(name, help, HISTOGRAM);
+    entry.histogram.reset(new MetricHistogram());
+    return entry.histogram.get();
+}
+
+MetricGauge* Metrics::Gauge(const std::string& name, const std::string& help) {
+    Entry& entry = Add_(name, help, GAUGE);
+    entry.gauge.reset(new MetricGauge());
+    return entry.gauge.get();
+}
+
+void Metrics::GaugeFunc(const std::string& name, const std::string& help, std::function<double()> read) {
+    assert(read);
+    Add_(name, help, GAUGE).read = std::move(read);
+}
+
+void Metrics::CounterFunc(const std::string& name, const std::string& help, std::function<uint64_t()> read) {
+    assert(read);
+    Add_(name, help, COUNTER).read = [read] { return static_cast<double>(read()); };
+}
+
+std::string Metrics::Render() {
+    static const char* TYPE_NAME[] = {"counter", "gauge", "histogram"};
+    string out;
+    lock_guard<mutex> locker(mtx_);
+    /* 同名（标签不同）的指标可能不是连续注册的，按名字第一次出现的顺序归到一起输出 */
+    vector<string> bases;
+    unordered_map<string, vector<const Entry*>> groups;
+    for(const unique_ptr<Entry>& p: entries_) {
+        string base = BaseName(p->name);
+        vector<const Entry*>& group = groups[base];
+        if(group.empty()) { bases.push_back(base); }
+        group.push_back(p.get());
+    }
+    for(const string& base: bases) {
+        const vector<const Entry*>& group = groups[base];
+        out += "# HELP " + base + " " + group[0]->help + "\n";
+        out += "# TYPE " + base + " " + TYPE_NAME[group[0]->type] + "\n";
+        for(const Entry* entry: group) {
+            RenderEntry_(*entry, &out);
+        }
+    }
+    return out;
+}
+
+void Metrics::RenderEntry_(const Entry& entry, std::string* out) {
+    if(entry.read) {
+        AppendLine(out, entry.name, entry.read());
+    } else if(entry.counter) {
+        AppendLine(out, entry.name, entry.counter->Value());
+    } else if(entry.gauge) {
+        AppendLine(out, entry.name, static_cast<double>(entry.gauge->Value()));
+    } else {
+        /*
+         * 按 Prometheus histogram 输出累积计数，可以跨实例求和、按时间窗口求 rate
+         * 细的对数-线性桶只在进程内算分位数用；导出时合并成固定的 4 的幂边界（le = 0, 3, 15, 63, ... 4^20-1），
+         * 每个直方图固定 21 条 _bucket 加 +Inf，不随记录到的最大值增长
+         */
+        MetricHistogram::Snapshot snap = entry.histogram->Snap();
+        uint64_t cumulative = 0;
+        for(int b = 0; b < MetricHistogram::BUCKETS - 1; b++) {
+            cumulative += snap.buckets[b];
+            uint64_t upper = MetricHistogram::BucketLow(b) + MetricHistogram::BucketWidth(b);
+            if((upper & (upper - 1)) != 0 || __builtin_ctzll(upper) % 2 != 0) { continue; }
+            if(upper > EXPORT_MAX) { break; }
+            AppendLine(out, WithLabel(entry.name, "_bucket", "le=\"" + to_string(upper - 1) + "\""), cumulative);
+        }
+        AppendLine(out, WithLabel(entry.name, "_bucket", "le=\"+Inf\""), snap.count);
+        AppendLine(out, WithLabel(entry.name, "_sum", ""), snap.sum);
+        AppendLine(out, WithLabel(entry.name, "_count", ""), snap.count);
+    }
+}
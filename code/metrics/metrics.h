@@ -0,0 +1,125 @@
+/*
+ * @file metrics.h
+ * @brief Metrics类（计数器、直方图与 Prometheus 导出）
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+/*
+ * 计数器和直方图都按线程分片：每个线程第一次记录时分到一个分片，之后只对自己分片上的原子变量做
+ * relaxed 加法，不同线程之间没有锁，也基本没有缓存行争用。抓取时把各分片加起来，读到的是近似快照
+ */
+class MetricCounter {
+public:
+    MetricCounter();
+    void Add(uint64_t n = 1);
+    uint64_t Value() const;
+
+private:
+    friend class Metrics;
+    // 一个分片占满一个缓存行
+    struct Cell {
+        std::atomic<uint64_t> value;
+        char pad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    Cell cells_[16];
+};
+
+/*
+ * HDR 风格的对数-线性直方图：值按 2 的幂分段，每段再等分 16 个桶，相对误差不超过 1/16
+ * 0~15 每个值一个桶，最大记录到 2^40（微秒约 12 天，字节 1TB），更大的值记在最后一个桶
+ */
+class MetricHistogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_EXP = 40;
+    static const int BUCKETS = (MAX_EXP - SUB_BITS + 2) * SUB_COUNT;
+
+    MetricHistogram();
+    void Record(uint64_t value);
+
+    // 抓取时用：各分片合并后的结果
+    struct Snapshot {
+        uint64_t count;
+        uint64_t sum;
+        std::vector<uint64_t> buckets;
+        // q 分位数（0~1），取所在桶的中点
+        uint64_t Quantile(double q) const;
+    };
+    Snapshot Snap() const;
+
+    static int BucketOf(uint64_t value);
+    static uint64_t BucketLow(int bucket);
+    static uint64_t BucketWidth(int bucket);
+
+private:
+    struct Shard {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> buckets[BUCKETS];
+    };
+    std::unique_ptr<Shard[]> shards_;
+};
+
+// 可以由某一个线程直接设置的量（例如主线程每轮发布一次定时器个数）
+class MetricGauge {
+public:
+    MetricGauge(): value_(0) {}
+    void Set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_;
+};
+
+/*
+ * 指标注册表：
+ *   各模块在启动时（静态初始化或服务器构造时）注册指标，拿到的指针一直有效，记录时直接用指针，不经过注册表
+ *   Render() 按 Prometheus 文本格式输出全部指标；只有注册和抓取会拿注册表的锁，请求路径上不会
+ * 名字可以带标签，例如 tws_log_dropped_total{log="access"}，同名指标归在一起输出，HELP/TYPE 只输出一次
+ * 回调型指标（GaugeFunc / CounterFunc）在抓取线程里调用，不能去拿请求路径上的锁，捕获的对象要比抓取活得久
+ */
+class Metrics {
+public:
+    static Metrics* Instance();
+
+    MetricCounter* Counter(const std::string& name, const std::string& help);
+    MetricHistogram* Histogram(const std::string& name, const std::string& help);
+    MetricGauge* Gauge(const std::string& name, const std::string& help);
+    void GaugeFunc(const std::string& name, const std::string& help, std::function<double()> read);
+    void CounterFunc(const std::string& name, const std::string& help, std::function<uint64_t()> read);
+
+    std::string Render();
+
+private:
+    Metrics() = default;
+    ~Metrics() = default;
+
+    enum TYPE { COUNTER, GAUGE, HISTOGRAM };
+    struct Entry {
+        std::string name;       // 含标签
+        std::string help;
+        TYPE type;
+        std::unique_ptr<MetricCounter> counter;
+        std::unique_ptr<MetricHistogram> histogram;
+        std::unique_ptr<MetricGauge> gauge;
+        std::function<double()> read;
+    };
+    Entry& Add_(const std::string& name, const std::string& help, TYPE type);
+    static void RenderEntry_(const Entry& entry, std::string* out);
+
+    std::mutex mtx_;
+    // 注册顺序
+    std::vector<std::unique_ptr<Entry>> entries_;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,494 @@
+/*
+ * @file sqlasync.cpp
+ * @brief SqlAsync类（事件循环驱动的非阻塞 MySQL 查询）
+ */
+#define LOG_MODULE Log::MOD_POOL   // 本文件的日志属于 pool 模块
+#include "sqlasync.h"
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+using namespace std;
+
+namespace {
+// 连接层错误（errmsg.h 里的 CR_SERVER_GONE_ERROR / CR_SERVER_LOST），出现后这个连接不再可用
+const unsigned int SERVER_GONE = 2006;
+const unsigned int SERVER_LOST = 2013;
+
+bool ServerGone(unsigned int no) {
+    return no == SERVER_GONE || no == SERVER_LOST;
+}
+
+// 最多同时建立的连接数
+const int WARMUP_THREADS = 8;
+// 建连超时（秒），数据库不可达时预热不会一直卡住
+const unsigned int CONNECT_TIMEOUT_S = 3;
+// 查询从提交到完成的最长时间，与阻塞连接池的读写超时一致，数据库卡住时请求不会一直挂着
+const int QUERY_TIMEOUT_MS = 10000;
+// 重连失败后的退避时间，从 100ms 开始翻倍，最长 5s
+const int RECONNECT_MIN_MS = 100;
+const int RECONNECT_MAX_MS = 5000;
+}
+
+SqlAsync::SqlAsync(Epoller* epoller): epoller_(epoller), eventFd_(-1), timerFd_(-1), port_(0), opening_(0),
+    lost_(0), closing_(false), alive_(0), warming_(false) {
+    assert(epoller_);
+}
+
+SqlAsync::~SqlAsync() {
+    /* 预热、重连线程要写 eventfd，先等它们结束 */
+    if(warmup_.joinable()) { warmup_.join(); }
+    {
+        lock_guard<mutex> locker(mtx_);
+        closing_ = true;
+    }
+    reconnectCond_.notify_all();
+    if(reconnect_.joinable()) { reconnect_.join(); }
+    for(MYSQL* sql: connected_) {
+        mysql_close(sql);
+    }
+    for(auto& item: conns_) {
+        epoller_->DelFd(item.first);
+        item.second.stmts.Clear();
+        mysql_close(item.second.sql);
+    }
+    if(eventFd_ >= 0) {
+        epoller_->DelFd(eventFd_);
+        close(eventFd_);
+    }
+    if(timerFd_ >= 0) {
+        epoller_->DelTimer(timerFd_);
+    }
+}
+
+bool SqlAsync::Supported() {
+#ifdef MYSQL_WAIT_READ
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool SqlAsync::Init(const char* host, int port,
+                    const char* user, const char* pwd,
+                    const char* dbName, int connSize, bool lazy) {
+    assert(connSize > 0);
+    if(!Supported()) { return false; }
+#ifdef MYSQL_WAIT_READ
+    eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(eventFd_ < 0 || !epoller_->AddFd(eventFd_, EPOLLIN)) {
+        LOG_ERROR("SqlAsync eventfd error!");
+        return false;
+    }
+    timerFd_ = epoller_->AddTimer();
+    if(timerFd_ < 0) {
+        LOG_ERROR("SqlAsync timerfd error!");
+        return false;
+    }
+    host_ = host;
+    port_ = port;
+    user_ = user;
+    pwd_ = pwd;
+    dbName_ = dbName;
+    opening_ = connSize;
+    warming_ = true;
+    if(lazy) {
+        /* 建好的连接由 OnEvent 在主线程里接管 */
+        warmup_ = thread([this, connSize] { Warmup_(connSize); });
+        return true;
+    }
+    Warmup_(connSize);
+    Adopt_();
+    return alive_ > 0;
+#else
+    (void)host; (void)port; (void)user; (void)pwd; (void)dbName; (void)connSize; (void)lazy;
+    return false;
+#endif
+}
+
+void SqlAsync::Warmup_(int connSize) {
+    atomic<int> left(connSize);
+    vector<thread> workers;
+    for(int i = 0; i < min(connSize, WARMUP_THREADS); i++) {
+        workers.emplace_back([this, &left] {
+            while(left.fetch_sub(1) > 0) {
+                MYSQL* sql = Connect_();
+                {
+                    lock_guard<mutex> locker(mtx_);
+                    opening_--;
+                    if(sql) { connected_.push_back(sql); }
+                }
+                /* 失败也要通知：最后一个连接失败后，排队的查询需要主线程来让它们失败返回 */
+                Wake_();
+            }
+            mysql_thread_end();
+        });
+    }
+    for(thread& worker: workers) {
+        worker.join();
+    }
+}
+
+void SqlAsync::Reconnect_() {
+    int backoff = RECONNECT_MIN_MS;
+    unique_lock<mutex> locker(mtx_);
+    while(!closing_) {
+        if(lost_ == 0) {
+            reconnectCond_.wait(locker);
+            continue;
+        }
+        locker.unlock();
+        MYSQL* sql = Connect_();
+        locker.lock();
+        if(sql) {
+            lost_--;
+            connected_.push_back(sql);
+            backoff = RECONNECT_MIN_MS;
+            LOG_INFO("MySql async conn reconnected, %d still lost", lost_);
+            Wake_();
+            continue;
+        }
+        /* 数据库还没恢复，等一会儿再试，析构时立即醒来 */
+        reconnectCond_.wait_for(locker, chrono::milliseconds(backoff), [this] { return closing_; });
+        backoff = min(backoff * 2, RECONNECT_MAX_MS);
+    }
+    locker.unlock();
+    mysql_thread_end();
+}
+
+MYSQL* SqlAsync::Connect_() {
+#ifdef MYSQL_WAIT_READ
+    MYSQL* sql = mysql_init(nullptr);
+    if(!sql) {
+        LOG_ERROR("MySql init error!");
+        return nullptr;
+    }
+    /* 必须在建连之前打开，之后这个连接上才能使用 _start/_cont 接口 */
+    mysql_options(sql, MYSQL_OPT_NONBLOCK, 0);
+    mysql_options(sql, MYSQL_OPT_CONNECT_TIMEOUT, &CONNECT_TIMEOUT_S);
+    if(!mysql_real_connect(sql, host_.c_str(), user_.c_str(), pwd_.c_str(),
+                           dbName_.c_str(), port_, nullptr, 0)) {
+        LOG_ERROR("MySql async connect error: %s", mysql_error(sql));
+        mysql_close(sql);
+        return nullptr;
+    }
+    return sql;
+#else
+    return nullptr;
+#endif
+}
+
+void SqlAsync::Adopt_() {
+    vector<MYSQL*> sqls;
+    {
+        lock_guard<mutex> locker(mtx_);
+        sqls.swap(connected_);
+        warming_ = opening_ > 0;
+    }
+    for(MYSQL* sql: sqls) {
+        int fd = mysql_get_socket(sql);
+        /* 空闲时不关心读写，只在建连后第一次查询之前可能收到一次断开通知。之后查询完成就不再挂回去，
+           空闲期间断开的连接等下一次查询失败时再发现，省掉每个查询一次 epoll_ctl */
+        if(fd < 0 || !epoller_->AddFd(fd, EPOLLONESHOT)) {
+            mysql_close(sql);
+            continue;
+        }
+        Conn& conn = conns_[fd];
+        conn.sql = sql;
+        conn.fd = fd;
+        conn.stage = IDLE;
+        conn.stmt = nullptr;
+        conn.err = 0;
+        idle_.push_back(&conn);
+        alive_++;
+    }
+}
+
+void SqlAsync::Execute(SQL_STMT id, std::vector<std::string> params, Callback cb) {
+    Job job;
+    job.id = id;
+    job.params.params = std::move(params);
+    job.cb = std::move(cb);
+    job.deadline = CoarseClock::NowMs() + QUERY_TIMEOUT_MS;
+    bool wake;
+    {
+        lock_guard<mutex> locker(mtx_);
+        /* 队列原本为空才需要唤醒，主线程取走之前的提交会被同一次唤醒带走 */
+        wake = submitted_.empty() && posted_.empty();
+        submitted_.push_back(std::move(job));
+    }
+    if(wake) { Wake_(); }
+}
+
+void SqlAsync::Post(std::function<void()> task) {
+    bool wake;
+    {
+        lock_guard<mutex> locker(mtx_);
+        wake = submitted_.empty() && posted_.empty();
+        posted_.push_back(std::move(task));
+    }
+    if(wake) { Wake_(); }
+}
+
+void SqlAsync::Wake_() {
+    uint64_t one = 1;
+    ssize_t ret = write(eventFd_, &one, sizeof(one));
+    (void)ret;
+}
+
+void SqlAsync::OnEvent(int fd, uint32_t events) {
+    if(fd == eventFd_) {
+        uint64_t cnt;
+        ssize_t ret = read(eventFd_, &cnt, sizeof(cnt));
+        (void)ret;
+        /* 预热或重连建好的连接 */
+        Adopt_();
+        vector<Job> jobs;
+        vector<function<void()>> tasks;
+        {
+            lock_guard<mutex> locker(mtx_);
+            jobs.swap(submitted_);
+            tasks.swap(posted_);
+        }
+        for(Job& job: jobs) {
+            waiting_.push_back(std::move(job));
+        }
+        for(auto& task: tasks) {
+            task();
+        }
+    }
+    else if(fd == timerFd_) {
+        epoller_->AckTimer(timerFd_);
+        Expire_();
+    }
+    else {
+        auto it = conns_.find(fd);
+        assert(it != conns_.end());
+        Conn* conn = &it->second;
+        if(conn->stage == IDLE) {
+            /* 空闲连接上不该有事件，只可能是服务端断开了连接（wait_timeout、重启） */
+            LOG_WARN("MySql async conn[%d] closed by server", fd);
+            Broken_(conn);
+        }
+        else {
+#ifdef MYSQL_WAIT_READ
+            int ready = 0;
+            if(events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) { ready |= MYSQL_WAIT_READ; }
+            if(events & EPOLLOUT) { ready |= MYSQL_WAIT_WRITE; }
+            if(events & EPOLLPRI) { ready |= MYSQL_WAIT_EXCEPT; }
+            Continue_(conn, ready);
+#endif
+        }
+    }
+    Dispatch_();
+    ArmTimer_();
+}
+
+void SqlAsync::Dispatch_() {
+    if(alive_ == 0 && !warming_) {
+        /* 没有可用连接，排队只会一直等下去，直接失败 */
+        while(!waiting_.empty()) {
+            Job job = std::move(waiting_.front());
+            waiting_.pop_front();
+            job.cb(SqlResult());
+        }
+        return;
+    }
+    while(!idle_.empty() && !waiting_.empty()) {
+        Conn* conn = idle_.back();
+        idle_.pop_back();
+        conn->job = std::move(waiting_.front());
+        waiting_.pop_front();
+        Start_(conn);
+    }
+}
+
+void SqlAsync::Start_(Conn* conn) {
+#ifdef MYSQL_WAIT_READ
+    conn->err = 0;
+    conn->stmt = conn->stmts.Find(conn->job.id);
+    int status;
+    if(conn->stmt) {
+        status = Execute_(conn);
+    }
+    else {
+        /* 语句第一次在这个连接上用到，先 prepare */
+        conn->stmt = mysql_stmt_init(conn->sql);
+        if(!conn->stmt) {
+            Finish_(conn, SqlResult());
+            return;
+        }
+        conn->stage = PREPARE;
+        const char* text = SqlStmtCache::Text(conn->job.id);
+        status = mysql_stmt_prepare_start(&conn->err, conn->stmt, text, strlen(text));
+    }
+    Step_(conn, status);
+#else
+    (void)conn;
+#endif
+}
+
+int SqlAsync::Execute_(Conn* conn) {
+#ifdef MYSQL_WAIT_READ
+    conn->stage = EXECUTE;
+    if(!SqlStmtCache::BindParams(conn->stmt, &conn->job.params)) {
+        conn->err = 1;
+        return 0;
+    }
+    return mysql_stmt_execute_start(&conn->err, conn->stmt);
+#else
+    (void)conn;
+    return 0;
+#endif
+}
+
+void SqlAsync::Continue_(Conn* conn, int ready) {
+#ifdef MYSQL_WAIT_READ
+    int status;
+    if(conn->stage == PREPARE) {
+        status = mysql_stmt_prepare_cont(&conn->err, conn->stmt, ready);
+    } else if(conn->stage == EXECUTE) {
+        status = mysql_stmt_execute_cont(&conn->err, conn->stmt, ready);
+    } else {
+        status = mysql_stmt_store_result_cont(&conn->err, conn->stmt, ready);
+    }
+    Step_(conn, status);
+#else
+    (void)conn; (void)ready;
+#endif
+}
+
+void SqlAsync::Step_(Conn* conn, int status) {
+#ifdef MYSQL_WAIT_READ
+    /* status 为 0 表示当前阶段已经完成，可以直接进入下一阶段，不用回到事件循环 */
+    while(status == 0) {
+        if(conn->err) {
+            Fail_(conn);
+            return;
+        }
+        if(conn->stage == PREPARE) {
+            conn->stmts.Put(conn->job.id, conn->stmt);
+            status = Execute_(conn);
+        }
+        else if(conn->stage == EXECUTE && mysql_stmt_field_count(conn->stmt) > 0) {
+            conn->stage = STORE;
+            status = mysql_stmt_store_result_start(&conn->err, conn->stmt);
+        }
+        else {
+            /* INSERT 之类没有结果集的语句执行完就结束了 */
+            SqlResult result;
+            result.ok = true;
+            if(conn->stage == STORE) {
+                /* store_result 已经把结果全部取回，取行不会再读 socket */
+                SqlStmtCache::FetchFirst(conn->stmt, &result);
+            }
+            Finish_(conn, result);
+            return;
+        }
+    }
+    Wait_(conn, status);
+#else
+    (void)conn; (void)status;
+#endif
+}
+
+void SqlAsync::Wait_(Conn* conn, int status) {
+#ifdef MYSQL_WAIT_READ
+    /* 没有设置 MYSQL_OPT_READ_TIMEOUT，不会单独出现 MYSQL_WAIT_TIMEOUT，超时由 timerfd 按查询的截止时刻处理 */
+    uint32_t events = EPOLLONESHOT;
+    if(status & MYSQL_WAIT_READ) { events |= EPOLLIN; }
+    if(status & MYSQL_WAIT_WRITE) { events |= EPOLLOUT; }
+    if(status & MYSQL_WAIT_EXCEPT) { events |= EPOLLPRI; }
+    epoller_->ModFd(conn->fd, events);
+#else
+    (void)conn; (void)status;
+#endif
+}
+
+void SqlAsync::Finish_(Conn* conn, const SqlResult& result) {
+    Job job = std::move(conn->job);
+    conn->job = Job();
+    conn->stmt = nullptr;
+    conn->stage = IDLE;
+    idle_.push_back(conn);
+    job.cb(result);
+}
+
+void SqlAsync::Fail_(Conn* conn) {
+    unsigned int no = mysql_stmt_errno(conn->stmt);
+    LOG_ERROR("MySql async stmt error: %s", mysql_stmt_error(conn->stmt));
+    if(conn->stage == PREPARE) {
+        mysql_stmt_close(conn->stmt);
+    } else {
+        conn->stmts.Drop(conn->job.id);
+    }
+    conn->stmt = nullptr;
+    if(ServerGone(no)) {
+        Broken_(conn);
+    } else {
+        Finish_(conn, SqlResult());
+    }
+}
+
+void SqlAsync::Broken_(Conn* conn) {
+    int fd = conn->fd;
+    alive_--;
+    epoller_->DelFd(fd);
+    if(conn->stage == IDLE) {
+        idle_.erase(std::find(idle_.begin(), idle_.end(), conn));
+    }
+    else {
+        Job job = std::move(conn->job);
+        conn->job = Job();
+        job.cb(SqlResult());
+    }
+    /*
+     * 连接上可能还有没做完的非阻塞操作（超时），这时唯一允许的调用是 mysql_close
+     * 先 shutdown 保证 close 里的 COM_QUIT 不会等待，语句在连接关闭后只释放内存
+     */
+    shutdown(fd, SHUT_RDWR);
+    mysql_close(conn->sql);
+    if(conn->stage == PREPARE && conn->stmt) { mysql_stmt_close(conn->stmt); }
+    conn->stmts.Clear();
+    conns_.erase(fd);
+    LOG_ERROR("MySql async conn[%d] broken, %d left, reconnecting", fd, alive_);
+    {
+        lock_guard<mutex> locker(mtx_);
+        lost_++;
+        if(!reconnect_.joinable()) { reconnect_ = thread([this] { Reconnect_(); }); }
+    }
+    reconnectCond_.notify_one();
+}
+
+void SqlAsync::Expire_() {
+    int64_t now = CoarseClock::PreciseMs();
+    vector<Conn*> expired;
+    for(auto& item: conns_) {
+        Conn* conn = &item.second;
+        if(conn->stage != IDLE && conn->job.deadline <= now) { expired.push_back(conn); }
+    }
+    for(Conn* conn: expired) {
+        LOG_WARN("MySql async conn[%d] query timeout", conn->fd);
+        Broken_(conn);
+    }
+    /* 排队的查询基本按提交顺序排列，从队头开始检查即可 */
+    while(!waiting_.empty() && waiting_.front().deadline <= now) {
+        Job job = std::move(waiting_.front());
+        waiting_.pop_front();
+        LOG_WARN("MySql async query timeout in queue");
+        job.cb(SqlResult());
+    }
+}
+
+void SqlAsync::ArmTimer_() {
+    int64_t next = -1;
+    for(auto& item: conns_) {
+        const Conn& conn = item.second;
+        if(conn.stage != IDLE && (next < 0 || conn.job.deadline < next)) { next = conn.job.deadline; }
+    }
+    if(!waiting_.empty() && (next < 0 || waiting_.front().deadline < next)) {
+        next = waiting_.front().deadline;
+    }
+    epoller_->ArmTimer(timerFd_, next);
+}
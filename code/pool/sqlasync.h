@@ -0,0 +1,149 @@
+/*
+ * @file sqlasync.h
+ * @brief SqlAsync类（事件循环驱动的非阻塞 MySQL 查询）
+ */
+#ifndef SQLASYNC_H
+#define SQLASYNC_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include "../server/epoller.h"
+#include "../log/log.h"
+#include "sqlstmt.h"
+
+/*
+ * 非阻塞查询：基于 MariaDB 客户端的 mysql_stmt_xxx_start / mysql_stmt_xxx_cont 接口
+ *   1. 任意线程调用 Execute() 把查询放进待处理队列，通过 eventfd 唤醒主线程
+ *   2. 主线程把查询分给空闲连接，调用 _start；需要等待时把连接的 socket 按等待的方向挂到 Epoller 上
+ *      语句在连接上第一次用到时先非阻塞地 prepare，缓存在连接的 SqlStmtCache 里
+ *   3. socket 就绪后主线程调用 OnEvent()，继续 _cont，直到结果取回，在主线程里执行回调
+ * 每个连接同一时刻只有一个查询，在途查询数等于连接数，工作线程不会被数据库阻塞
+ * 建连是阻塞的，由临时线程并行完成，建好的连接通过 eventfd 交给主线程；预热期间的查询排队等第一个连接
+ * 断开的连接（wait_timeout、数据库重启）立即关闭，由重连线程按指数退避重新建立，同样经 eventfd 交回主线程
+ * 每个查询从提交起有一个截止时刻，排队或执行超时都回调失败；执行中超时的连接协议状态未知，按断开处理
+ * 客户端库不提供非阻塞接口（没有 MYSQL_WAIT_READ）时 Supported() 为 false，调用方退回阻塞查询
+ */
+class SqlAsync {
+public:
+    // 回调在主线程（事件循环线程）里执行，不能阻塞
+    typedef std::function<void(const SqlResult&)> Callback;
+
+    explicit SqlAsync(Epoller* epoller);
+    ~SqlAsync();
+
+    static bool Supported();
+
+    // 主线程调用。并行建立 connSize 个非阻塞连接，全部失败返回 false
+    // lazy 为 true 时连接在后台建立，立即返回 true
+    bool Init(const char* host, int port,
+              const char* user, const char* pwd,
+              const char* dbName, int connSize, bool lazy);
+
+    // 任意线程调用：以 params 为参数执行预处理语句 id
+    void Execute(SQL_STMT id, std::vector<std::string> params, Callback cb);
+    // 任意线程调用：在主线程里执行 task（别的线程完成的查库，回调交回主线程）
+    void Post(std::function<void()> task);
+
+    // 主线程调用：fd 是不是本模块的（eventfd、timerfd 或某个连接的 socket）
+    bool Owns(int fd) const { return fd == eventFd_ || fd == timerFd_ || conns_.count(fd) > 0; }
+    // 主线程调用：处理 Epoller 返回的事件
+    void OnEvent(int fd, uint32_t events);
+
+private:
+    enum STAGE {
+        IDLE,       // 空闲，可以接新查询
+        PREPARE,    // mysql_stmt_prepare 进行中（只在语句第一次用到时）
+        EXECUTE,    // mysql_stmt_execute 进行中
+        STORE,      // mysql_stmt_store_result 进行中
+    };
+
+    struct Job {
+        SQL_STMT id;
+        SqlParams params;   // 参数及其绑定，执行完成之前一直有效
+        Callback cb;
+        int64_t deadline = 0;   // 截止时刻（CoarseClock 毫秒），超过后回调失败
+    };
+
+    struct Conn {
+        MYSQL* sql;
+        int fd;
+        STAGE stage;
+        Job job;
+        MYSQL_STMT* stmt;   // 当前在执行的语句
+        int err;            // _start/_cont 的返回值
+        SqlStmtCache stmts;
+    };
+
+    // 建连线程：并行建立 connSize 个连接，放进 connected_
+    void Warmup_(int connSize);
+    // 重连线程：逐个重建断开的连接，失败后按指数退避重试
+    void Reconnect_();
+    MYSQL* Connect_();
+    // 写 eventfd 唤醒主线程
+    void Wake_();
+    // 主线程：接管建连线程建好的连接
+    void Adopt_();
+    // 把待处理队列里的查询分给空闲连接
+    void Dispatch_();
+    void Start_(Conn* conn);
+    // 绑定参数并开始执行
+    int Execute_(Conn* conn);
+    // socket 就绪，ready 为 MYSQL_WAIT_xxx 的组合
+    void Continue_(Conn* conn, int ready);
+    // 根据 _start/_cont 的返回值推进：需要等待则重新挂 Epoller，完成则进入下一阶段
+    void Step_(Conn* conn, int status);
+    void Wait_(Conn* conn, int status);
+    void Finish_(Conn* conn, const SqlResult& result);
+    // 语句执行出错：连接断开则不再使用，否则丢掉语句（下次重新 prepare）并回调失败
+    void Fail_(Conn* conn);
+    // 连接不可用：回调失败，关闭连接并交给重连线程。conn 随之失效
+    void Broken_(Conn* conn);
+    // timerfd 到期：让超过截止时刻的查询失败
+    void Expire_();
+    // 把 timerfd 设定到最早的截止时刻
+    void ArmTimer_();
+
+    Epoller* epoller_;
+    // 工作线程 -> 主线程的唤醒
+    int eventFd_;
+    // 查询截止时刻的定时器
+    int timerFd_;
+
+    // 连接参数，建连线程用
+    std::string host_, user_, pwd_, dbName_;
+    int port_;
+    std::thread warmup_;
+    std::thread reconnect_;
+    std::condition_variable reconnectCond_;
+
+    // 工作线程提交的查询、建连线程建好的连接，主线程取走
+    std::mutex mtx_;
+    std::vector<Job> submitted_;
+    std::vector<std::function<void()>> posted_;
+    std::vector<MYSQL*> connected_;
+    // 还在建立的连接数
+    int opening_;
+    // 等待重连的连接数
+    int lost_;
+    bool closing_;
+
+    // 以下只在主线程访问
+    // 等待空闲连接的查询
+    std::deque<Job> waiting_;
+    // socket fd -> 连接
+    std::unordered_map<int, Conn> conns_;
+    std::vector<Conn*> idle_;
+    // 还没断开的连接数，为 0 且没有正在建立的连接时查询直接失败
+    int alive_;
+    // 主线程看到的“还有连接在建立”
+    bool warming_;
+};
+
+#endif // SQLASYNC_H
@@ -0,0 +1,62 @@
+/*
+ * @file sqlauth.cpp
+ * @brief SqlAuth / SqlAsyncAuth类（MySQL 用户存储）
+ */
+#define LOG_MODULE Log::MOD_POOL   // 本文件的日志属于 pool 模块
+#include "sqlauth.h"
+#include "sqlconnRAII.h"
+using namespace std;
+
+namespace {
+AuthBackend::User ToUser(const SqlResult& res) {
+    AuthBackend::User user;
+    user.ok = res.ok;
+    user.exists = res.hasRow;
+    user.pwd = res.row.size() > 1 ? res.row[1] : "";
+    return user;
+}
+}
+
+void SqlAuth::FindUser(const std::string& name, FindCallback cb) {
+    SqlResult res;
+    {
+        MYSQL* sql;
+        SqlConnRAII conn(&sql, SqlConnPool::Instance());
+        /* 用连接上缓存的预处理语句，参数二进制绑定，不拼 SQL */
+        if(sql && !SqlConnPool::Instance()->Stmts(sql)->Run(sql, STMT_USER_SELECT, {name}, &res)) {
+            res = SqlResult();
+        }
+    }
+    /* 连接先还回去再回调 */
+    cb(ToUser(res));
+}
+
+void SqlAuth::AddUser(const std::string& name, const std::string& pwd, AddCallback cb) {
+    if(batcher_) {
+        batcher_->Add(name, pwd, std::move(cb));
+        return;
+    }
+    bool ok;
+    {
+        MYSQL* sql;
+        SqlConnRAII conn(&sql, SqlConnPool::Instance());
+        SqlResult res;
+        ok = sql && SqlConnPool::Instance()->Stmts(sql)->Run(sql, STMT_USER_INSERT, {name, pwd}, &res);
+    }
+    cb(ok ? ADD_OK : ADD_FAILED);
+}
+
+void SqlAsyncAuth::FindUser(const std::string& name, FindCallback cb) {
+    db_->Execute(STMT_USER_SELECT, {name}, [cb](const SqlResult& res) { cb(ToUser(res)); });
+}
+
+void SqlAsyncAuth::AddUser(const std::string& name, const std::string& pwd, AddCallback cb) {
+    if(batcher_) {
+        SqlAsync* db = db_;
+        batcher_->Add(name, pwd, [db, cb](ADD_RESULT result) {
+            db->Post([cb, result] { cb(result); });
+        });
+        return;
+    }
+    db_->Execute(STMT_USER_INSERT, {name, pwd}, [cb](const SqlResult& res) { cb(res.ok ? ADD_OK : ADD_FAILED); });
+}
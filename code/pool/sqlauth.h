@@ -0,0 +1,44 @@
+/*
+ * @file sqlauth.h
+ * @brief SqlAuth / SqlAsyncAuth类（MySQL 用户存储）
+ */
+#ifndef SQLAUTH_H
+#define SQLAUTH_H
+
+#include "../auth/authbackend.h"
+#include "sqlconnpool.h"
+#include "sqlasync.h"
+#include "sqlbatch.h"
+
+// MySQL 后端：在调用线程里从 SqlConnPool 取连接阻塞查询。batcher 不为空时注册交给它组提交
+class SqlAuth: public AuthBackend {
+public:
+    explicit SqlAuth(SqlBatcher* batcher): batcher_(batcher) {}
+
+    bool Async() const override { return false; }
+    const char* Name() const override { return "mysql"; }
+
+    void FindUser(const std::string& name, FindCallback cb) override;
+    void AddUser(const std::string& name, const std::string& pwd, AddCallback cb) override;
+
+private:
+    SqlBatcher* batcher_;
+};
+
+// MySQL 后端：查询交给 SqlAsync，回调在主线程里执行。batcher 不为空时注册交给它组提交，结果再交回主线程
+class SqlAsyncAuth: public AuthBackend {
+public:
+    SqlAsyncAuth(SqlAsync* db, SqlBatcher* batcher): db_(db), batcher_(batcher) { assert(db_); }
+
+    bool Async() const override { return true; }
+    const char* Name() const override { return "mysql-async"; }
+
+    void FindUser(const std::string& name, FindCallback cb) override;
+    void AddUser(const std::string& name, const std::string& pwd, AddCallback cb) override;
+
+private:
+    SqlAsync* db_;
+    SqlBatcher* batcher_;
+};
+
+#endif // SQLAUTH_H
@@ -0,0 +1,143 @@
+/*
+ * @file sqlbatch.cpp
+ * @brief SqlBatcher类（注册写入的组提交）
+ */
+#define LOG_MODULE Log::MOD_POOL   // 本文件的日志属于 pool 模块
+#include "sqlbatch.h"
+#include <unordered_set>
+#include "sqlconnRAII.h"
+using namespace std;
+
+SqlBatcher::SqlBatcher(SqlConnPool* pool, int windowMs, int maxRows):
+    pool_(pool), windowMs_(windowMs), maxRows_(maxRows), closed_(false), stats_() {
+    assert(pool_ && windowMs_ >= 0 && maxRows_ > 0);
+    LockName(mtx_, "sqlbatch");
+    thread_ = thread([this] { Loop_(); });
+}
+
+SqlBatcher::~SqlBatcher() {
+    {
+        lock_guard<Mutex> locker(mtx_);
+        closed_ = true;
+    }
+    cond_.notify_one();
+    thread_.join();
+}
+
+void SqlBatcher::Add(const std::string& name, const std::string& pwd, Callback cb) {
+    bool wake;
+    {
+        lock_guard<Mutex> locker(mtx_);
+        pending_.push_back(Item{name, pwd, std::move(cb), AuthBackend::ADD_FAILED});
+        /* 第一条开启一个窗口，攒满了提前结束窗口 */
+        wake = pending_.size() == 1 || pending_.size() >= maxRows_;
+    }
+    if(wake) { cond_.notify_one(); }
+}
+
+void SqlBatcher::Loop_() {
+    unique_lock<Mutex> locker(mtx_);
+    while(true) {
+        cond_.wait(locker, [this] { return closed_ || !pending_.empty(); });
+        if(pending_.empty()) { break; }
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(windowMs_);
+        cond_.wait_until(locker, deadline, [this] { return closed_ || pending_.size() >= maxRows_; });
+        vector<Item> items;
+        items.swap(pending_);
+        locker.unlock();
+        Flush_(items);
+        locker.lock();
+    }
+    locker.unlock();
+    mysql_thread_end();
+}
+
+void SqlBatcher::Flush_(std::vector<Item>& items) {
+    /* 同一批里重名的，只有第一个去写 */
+    unordered_set<string> seen;
+    vector<Item*> rows;
+    for(Item& item: items) {
+        if(seen.insert(item.name).second) {
+            rows.push_back(&item);
+        } else {
+            item.result = AuthBackend::ADD_DUPLICATE;
+        }
+    }
+    uint64_t batches = 0;
+    for(size_t i = 0; i < rows.size(); i += maxRows_) {
+        vector<Item*> chunk(rows.begin() + i, rows.begin() + min(rows.size(), i + maxRows_));
+        Commit_(chunk);
+        batches++;
+    }
+    {
+        lock_guard<mutex> locker(statsMtx_);
+        stats_.batches += batches;
+        stats_.rows += items.size();
+        stats_.maxBatch = max<uint64_t>(stats_.maxBatch, items.size());
+        for(Item& item: items) {
+            if(item.result == AuthBackend::ADD_OK) { stats_.inserted++; }
+            else if(item.result == AuthBackend::ADD_DUPLICATE) { stats_.duplicates++; }
+            else { stats_.failed++; }
+        }
+    }
+    for(Item& item: items) {
+        item.cb(item.result);
+    }
+}
+
+void SqlBatcher::Commit_(const std::vector<Item*>& rows) {
+    MYSQL* sql;
+    SqlConnRAII conn(&sql, pool_);
+    if(!sql) { return; }
+    SqlStmtCache* stmts = pool_->Stmts(sql);
+    vector<string> params;
+    for(Item* item: rows) {
+        params.push_back(item->name);
+    }
+    vector<string> existing;
+    if(mysql_query(sql, "START TRANSACTION")
+       || !stmts->RunBatch(sql, BATCH_USER_EXISTS, rows.size(), params, &existing)) {
+        LOG_ERROR("MySql batch select error: %s", mysql_error(sql));
+        mysql_query(sql, "ROLLBACK");
+        return;
+    }
+    unordered_set<string> dup(existing.begin(), existing.end());
+    vector<Item*> fresh;
+    params.clear();
+    for(Item* item: rows) {
+        if(dup.count(item->name)) {
+            item->result = AuthBackend::ADD_DUPLICATE;
+            continue;
+        }
+        fresh.push_back(item);
+        params.push_back(item->name);
+        params.push_back(item->pwd);
+    }
+    if(!fresh.empty() && !stmts->RunBatch(sql, BATCH_USER_INSERT, fresh.size(), params, nullptr)) {
+        mysql_query(sql, "ROLLBACK");
+        if(fresh.size() > 1) {
+            /* 多行 INSERT 里有一行不合法（比如严格模式下用户名超长）整条语句就失败，逐行重试，只让坏的那一行失败 */
+            LOG_WARN("MySql batch insert of %zu rows failed, retrying row by row", fresh.size());
+            for(Item* item: fresh) {
+                SqlResult result;
+                if(stmts->Run(sql, STMT_USER_INSERT, {item->name, item->pwd}, &result)) {
+                    item->result = AuthBackend::ADD_OK;
+                }
+            }
+        }
+        return;
+    }
+    if(mysql_query(sql, "COMMIT")) {
+        LOG_ERROR("MySql batch commit error: %s", mysql_error(sql));
+        mysql_query(sql, "ROLLBACK");
+        return;
+    }
+    for(Item* item: fresh) {
+        item->result = AuthBackend::ADD_OK;
+    }
+}
+
+SqlBatcher::Stats SqlBatcher::GetStats() {
+    lock_guard<mutex> locker(statsMtx_);
+    return stats_;
+}
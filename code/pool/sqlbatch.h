@@ -0,0 +1,77 @@
+/*
+ * @file sqlbatch.h
+ * @brief SqlBatcher类（注册写入的组提交）
+ */
+#ifndef SQLBATCH_H
+#define SQLBATCH_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "../metrics/lockprof.h"
+#include "../auth/authbackend.h"
+#include "sqlconnpool.h"
+
+/*
+ * 注册的组提交：每条 INSERT 单独 autocommit 时，吞吐受限于数据库每秒能做多少次提交（每次一次 fsync）
+ *   1. 任意线程调用 Add() 把注册放进队列
+ *   2. 后台线程在第一条到达后等一个窗口（windowMs，或攒满 maxRows 条），取走整批
+ *   3. 在一个事务里先查出这批用户名里已经存在的，再把其余的用一条多行 INSERT 写入，一次提交
+ *      多行 INSERT 失败时回滚，再逐行单独写入，每个注册拿到自己的结果，一行坏数据不会拖累整批
+ * 同一批里重名的只有第一个写入，其余的和已经存在的一样按“用户名已存在”返回；
+ * 所有写入都经过这一个线程，进程内不会再出现同名用户被并发注册两次
+ * 回调在后台线程里执行，不能阻塞
+ */
+class SqlBatcher {
+public:
+    typedef AuthBackend::AddCallback Callback;
+
+    struct Stats {
+        uint64_t batches;       // 提交的事务数
+        uint64_t rows;          // 收到的注册数
+        uint64_t inserted;
+        uint64_t duplicates;
+        uint64_t failed;
+        uint64_t maxBatch;      // 最大的一批
+    };
+
+    SqlBatcher(SqlConnPool* pool, int windowMs, int maxRows);
+    // 写完队列里剩下的再退出
+    ~SqlBatcher();
+
+    void Add(const std::string& name, const std::string& pwd, Callback cb);
+
+    Stats GetStats();
+
+private:
+    struct Item {
+        std::string name;
+        std::string pwd;
+        Callback cb;
+        AuthBackend::ADD_RESULT result;
+    };
+
+    void Loop_();
+    // 去重、分批提交、回调
+    void Flush_(std::vector<Item>& items);
+    // 一个事务写入 rows，设置每条的结果
+    void Commit_(const std::vector<Item*>& rows);
+
+    SqlConnPool* pool_;
+    int windowMs_;
+    size_t maxRows_;
+
+    Mutex mtx_;
+    CondVar cond_;
+    std::vector<Item> pending_;
+    bool closed_;
+    // 只有后台线程写，单独一把锁，抓取统计时不会和 Add 抢 mtx_
+    std::mutex statsMtx_;
+    Stats stats_;
+    std::thread thread_;
+};
+
+#endif // SQLBATCH_H
@@ -1,13 +1,56 @@
 /*
  * @file sqlconnpool.cpp
  * @brief SqlConnPool类
- */ 
+ */
+#define LOG_MODULE Log::MOD_POOL   // 本文件的日志属于 pool 模块
 #include "sqlconnpool.h"
+#include "../timer/coarseclock.h"
 using namespace std;
 
+namespace {
+// 健康检查间隔，空闲超过这么久的连接会被 ping 一次
+const int HEALTH_INTERVAL_MS = 10000;
+// 取连接时，空闲超过这么久（健康检查可能还没轮到）先 ping 再交出去
+const int VALIDATE_IDLE_MS = 30000;
+// 超出最小容量的连接空闲这么久后关闭
+const int IDLE_CLOSE_MS = 60000;
+// 建连失败后，这段时间内不再因为增长而重试
+const int CONNECT_RETRY_MS = 1000;
+// 建连、读写超时（秒），数据库无响应时查询最终会失败返回，而不是一直阻塞
+const unsigned int CONNECT_TIMEOUT_S = 3;
+const unsigned int IO_TIMEOUT_S = 10;
+// 启动预热时最多同时建立的连接数
+const int WARMUP_THREADS = 8;
+
+// errmsg.h 里的 CR_SERVER_GONE_ERROR / CR_SERVER_LOST
+bool ServerGone(MYSQL* sql) {
+    unsigned int no = mysql_errno(sql);
+    return no == 2006 || no == 2013;
+}
+}
+
 SqlConnPool::SqlConnPool() {
-    useCount_ = 0;
-    freeCount_ = 0;
+    port_ = 0;
+    minConn_ = 0;
+    maxConn_ = 0;
+    acquireTimeoutMs_ = 3000;
+    opening_ = 0;
+    connectFailMs_ = 0;
+    closed_ = true;
+    lazyWarmup_ = false;
+    warming_ = false;
+    stats_ = Stats();
+    LockName(mtx_, "sqlpool");
+    Metrics* metrics = Metrics::Instance();
+    waitUs_ = metrics->Histogram("tws_sql_pool_wait_us", "Time spent waiting for a SQL connection, microseconds");
+    timeouts_ = metrics->Counter("tws_sql_pool_timeouts_total", "SQL connection acquires that timed out");
+    totalGauge_ = metrics->Gauge("tws_sql_pool_conns{state=\"total\"}", "SQL connections in the pool");
+    freeGauge_ = metrics->Gauge("tws_sql_pool_conns{state=\"free\"}", "SQL connections in the pool");
+}
+
+void SqlConnPool::Publish_() {
+    totalGauge_->Set(static_cast<int64_t>(conns_.size()));
+    freeGauge_->Set(static_cast<int64_t>(free_.size()));
 }
 
 SqlConnPool* SqlConnPool::Instance() {
@@ -15,74 +58,301 @@ SqlConnPool* SqlConnPool::Instance() {
     return &connPool;
 }
 
+void SqlConnPool::SetPolicy(int maxSize, int acquireTimeoutMs, bool lazyWarmup) {
+    lock_guard<Mutex> locker(mtx_);
+    maxConn_ = maxSize;
+    acquireTimeoutMs_ = acquireTimeoutMs;
+    lazyWarmup_ = lazyWarmup;
+}
+
 void SqlConnPool::Init(const char* host, int port,
             const char* user,const char* pwd, const char* dbName,
             int connSize = 10) {
     assert(connSize > 0);
-    for (int i = 0; i < connSize; i++) {
-        MYSQL *sql = nullptr;
-        sql = mysql_init(sql);
-        if (!sql) {
-            LOG_ERROR("MySql init error!");
-            assert(sql);
-        }
-        sql = mysql_real_connect(sql, host,
-                                 user, pwd,
-                                 dbName, port, nullptr, 0);
-        if (!sql) {
-            LOG_ERROR("MySql Connect error!");
-        }
-        connQue_.push(sql);
+    /* 多线程使用客户端库之前，先在主线程里完成全局初始化 */
+    mysql_library_init(0, nullptr, nullptr);
+    {
+        lock_guard<Mutex> locker(mtx_);
+        host_ = host;
+        port_ = port;
+        user_ = user;
+        pwd_ = pwd;
+        dbName_ = dbName;
+        minConn_ = connSize;
+        maxConn_ = max(maxConn_, connSize);
+        closed_ = false;
+        /* 预热中的连接先算进 opening_，等待者不会因为池子暂时为空而各自再去建连 */
+        opening_ = connSize;
+        warming_ = true;
+    }
+    if(lazyWarmup_) {
+        /* 后台预热，监听 socket 马上就能建立，静态资源请求不受数据库影响；
+           认证请求在 GetConn 里等第一个连上的连接 */
+        warmup_ = thread([this, connSize] { Warmup_(connSize); });
+    } else {
+        Warmup_(connSize);
     }
-    MAX_CONN_ = connSize;
-    sem_init(&semId_, 0, MAX_CONN_);
+    health_ = thread([this] { HealthCheck_(); });
 }
 
-MYSQL* SqlConnPool::GetConn() {
-    MYSQL *sql = nullptr;
-    if(connQue_.empty()){
-        LOG_WARN("SqlConnPool busy!");
-        return nullptr;
+void SqlConnPool::Warmup_(int connSize) {
+    int64_t start = CoarseClock::PreciseMs();
+    atomic<int> left(connSize);
+    vector<thread> workers;
+    for(int i = 0; i < min(connSize, WARMUP_THREADS); i++) {
+        /* 建连的耗时基本都是网络往返和认证，并行建立，启动时间接近一次建连 */
+        workers.emplace_back([this, &left] {
+            while(left.fetch_sub(1) > 0) {
+                MYSQL* sql = Connect_();
+                lock_guard<Mutex> locker(mtx_);
+                opening_--;
+                if(sql) {
+                    free_.push_back(Add_(sql));
+                    Publish_();
+                    cond_.notify_one();
+                } else {
+                    stats_.connectFails++;
+                    connectFailMs_ = CoarseClock::NowMs();
+                }
+            }
+            mysql_thread_end();
+        });
+    }
+    for(thread& worker: workers) {
+        worker.join();
     }
-    // 如果没有空闲连接，线程会在此处阻塞
-    sem_wait(&semId_);
+    int ready;
     {
-        lock_guard<mutex> locker(mtx_);
-        sql = connQue_.front();
-        connQue_.pop();
-        useCount_++;
-        freeCount_--;
+        lock_guard<Mutex> locker(mtx_);
+        warming_ = false;
+        ready = static_cast<int>(conns_.size());
+    }
+    /* 预热失败的等待者可以自己去建连了 */
+    cond_.notify_all();
+    if(ready < connSize) {
+        /* 没连上的由健康检查线程稍后补齐 */
+        LOG_ERROR("SqlConnPool: %d of %d connections established", ready, connSize);
+    } else {
+        LOG_INFO("SqlConnPool: %d connections established in %lldms", ready,
+                 static_cast<long long>(CoarseClock::PreciseMs() - start));
+    }
+}
+
+MYSQL* SqlConnPool::Connect_() {
+    MYSQL* sql = mysql_init(nullptr);
+    if(!sql) {
+        LOG_ERROR("MySql init error!");
+        return nullptr;
+    }
+    mysql_options(sql, MYSQL_OPT_CONNECT_TIMEOUT, &CONNECT_TIMEOUT_S);
+    mysql_options(sql, MYSQL_OPT_READ_TIMEOUT, &IO_TIMEOUT_S);
+    mysql_options(sql, MYSQL_OPT_WRITE_TIMEOUT, &IO_TIMEOUT_S);
+    if(!mysql_real_connect(sql, host_.c_str(), user_.c_str(), pwd_.c_str(),
+                           dbName_.c_str(), port_, nullptr, 0)) {
+        LOG_WARN_RATELIMIT(1000, "MySql Connect error: %s", mysql_error(sql));
+        mysql_close(sql);
+        return nullptr;
     }
     return sql;
 }
 
+SqlConnPool::Conn* SqlConnPool::Add_(MYSQL* sql) {
+    Conn* conn = new Conn{sql, CoarseClock::NowMs(), unique_ptr<SqlStmtCache>(new SqlStmtCache())};
+    conns_[sql].reset(conn);
+    stats_.connects++;
+    return conn;
+}
+
+void SqlConnPool::Close_(Conn* conn) {
+    /* 语句要在所属连接关闭之前关闭 */
+    conn->stmts->Clear();
+    mysql_close(conn->sql);
+    conns_.erase(conn->sql);
+}
+
+MYSQL* SqlConnPool::GetConn() {
+    unique_lock<Mutex> locker(mtx_);
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(acquireTimeoutMs_);
+    int64_t waitStart = 0;
+    while(!closed_) {
+        if(!free_.empty()) {
+            Conn* conn = free_.back();
+            free_.pop_back();
+            if(CoarseClock::NowMs() - conn->lastUsedMs >= VALIDATE_IDLE_MS) {
+                /* 空闲了很久，可能已经被服务端断开，先确认一下 */
+                locker.unlock();
+                bool alive = mysql_ping(conn->sql) == 0;
+                locker.lock();
+                if(!alive) {
+                    stats_.pingFails++;
+                    Close_(conn);
+                    continue;
+                }
+            }
+            stats_.acquires++;
+            uint64_t us = 0;
+            if(waitStart) {
+                us = CoarseClock::PreciseUs() - waitStart;
+                stats_.waitUsTotal += us;
+                stats_.waitUsMax = max(stats_.waitUsMax, us);
+            }
+            waitUs_->Record(us);
+            Publish_();
+            TWS_PROBE3(sql_acquire, conn->sql, us, 1);
+            return conn->sql;
+        }
+        /* 没有空闲连接：还没到上限就新建一个，建连不持锁。预热期间等预热的连接 */
+        if(!warming_ && Total_() < maxConn_ && CoarseClock::NowMs() - connectFailMs_ >= CONNECT_RETRY_MS) {
+            opening_++;
+            locker.unlock();
+            MYSQL* sql = Connect_();
+            locker.lock();
+            opening_--;
+            if(sql) {
+                free_.push_back(Add_(sql));
+                continue;
+            }
+            stats_.connectFails++;
+            connectFailMs_ = CoarseClock::NowMs();
+        }
+        if(!waitStart) {
+            waitStart = CoarseClock::PreciseUs();
+            stats_.waits++;
+        }
+        if(cond_.wait_until(locker, deadline) == cv_status::timeout && free_.empty()) {
+            stats_.timeouts++;
+            timeouts_->Add();
+            TWS_PROBE3(sql_acquire, static_cast<MYSQL*>(nullptr), CoarseClock::PreciseUs() - waitStart, 0);
+            // 压力下每个请求都会打到这里，限速输出
+            LOG_WARN_RATELIMIT(1000, "SqlConnPool busy! wait %dms timeout", acquireTimeoutMs_);
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
 void SqlConnPool::FreeConn(MYSQL* sql) {
     assert(sql);
-    lock_guard<mutex> locker(mtx_);
-    connQue_.push(sql);
-    // 释放一个信号量，可能唤醒正在等待连接的线程
-    sem_post(&semId_);
-    useCount_--;
-    freeCount_++;
+    lock_guard<Mutex> locker(mtx_);
+    auto it = conns_.find(sql);
+    assert(it != conns_.end());
+    Conn* conn = it->second.get();
+    if(closed_ || ServerGone(sql)) {
+        if(!closed_) {
+            stats_.broken++;
+            LOG_WARN("MySql conn broken: %s", mysql_error(sql));
+        }
+        /* 坏连接直接关掉，等待者可以新建，健康检查线程负责补齐到最小容量 */
+        TWS_PROBE2(sql_release, sql, 1);
+        Close_(conn);
+        Publish_();
+        cond_.notify_one();
+        healthCond_.notify_one();
+        return;
+    }
+    conn->lastUsedMs = CoarseClock::NowMs();
+    free_.push_back(conn);
+    Publish_();
+    TWS_PROBE2(sql_release, sql, 0);
+    // 唤醒一个正在等待连接的线程
+    cond_.notify_one();
+}
+
+void SqlConnPool::HealthCheck_() {
+    unique_lock<Mutex> locker(mtx_);
+    while(!closed_) {
+        healthCond_.wait_for(locker, chrono::milliseconds(HEALTH_INTERVAL_MS));
+        if(closed_) { break; }
+        int64_t now = CoarseClock::NowMs();
+        /* 收缩：超出最小容量、空闲太久的连接关掉 */
+        while(static_cast<int>(conns_.size()) > minConn_ && !free_.empty()
+              && now - free_.front()->lastUsedMs >= IDLE_CLOSE_MS) {
+            Close_(free_.front());
+            free_.pop_front();
+            stats_.idleClosed++;
+        }
+        /* 检查：逐个取出空闲够久的连接在锁外 ping，检查期间其他线程拿不到这一个 */
+        size_t n = free_.size();
+        for(size_t i = 0; i < n && !free_.empty() && !closed_; i++) {
+            Conn* conn = free_.front();
+            if(now - conn->lastUsedMs < HEALTH_INTERVAL_MS) { break; }
+            free_.pop_front();
+            locker.unlock();
+            bool alive = mysql_ping(conn->sql) == 0;
+            locker.lock();
+            if(alive) {
+                /* ping 过的连接算作刚用过，放回表尾 */
+                conn->lastUsedMs = CoarseClock::NowMs();
+                free_.push_back(conn);
+                cond_.notify_one();
+            } else {
+                stats_.pingFails++;
+                LOG_WARN("MySql conn ping failed: %s", mysql_error(conn->sql));
+                Close_(conn);
+            }
+        }
+        /* 补齐：数据库重启后连接数回到最小容量 */
+        while(!closed_ && Total_() < minConn_) {
+            opening_++;
+            locker.unlock();
+            MYSQL* sql = Connect_();
+            locker.lock();
+            opening_--;
+            if(!sql) {
+                stats_.connectFails++;
+                connectFailMs_ = CoarseClock::NowMs();
+                break;
+            }
+            free_.push_back(Add_(sql));
+            cond_.notify_one();
+        }
+        Publish_();
+    }
+    locker.unlock();
+    mysql_thread_end();
 }
 
 void SqlConnPool::ClosePool() {
-    lock_guard<mutex> locker(mtx_);
-    while(!connQue_.empty()) {
-        auto item = connQue_.front();
-        connQue_.pop();
-        mysql_close(item);
+    {
+        lock_guard<Mutex> locker(mtx_);
+        if(closed_ && !health_.joinable()) { return; }
+        closed_ = true;
+    }
+    cond_.notify_all();
+    healthCond_.notify_all();
+    if(warmup_.joinable()) { warmup_.join(); }
+    if(health_.joinable()) { health_.join(); }
+    lock_guard<Mutex> locker(mtx_);
+    /* 使用中的连接在归还时关闭 */
+    for(Conn* conn: free_) {
+        Close_(conn);
     }
+    free_.clear();
+    Publish_();
     // MySQL C API 提供的一个全局资源清理函数
-    mysql_library_end();   
-    MAX_CONN_ = 0;
-    useCount_ = 0;
-    freeCount_ = 0;
+    mysql_library_end();
 }
 
 int SqlConnPool::GetFreeConnCount() {
-    lock_guard<mutex> locker(mtx_);
-    return connQue_.size();
+    lock_guard<Mutex> locker(mtx_);
+    return free_.size();
+}
+
+SqlStmtCache* SqlConnPool::Stmts(MYSQL* sql) {
+    lock_guard<Mutex> locker(mtx_);
+    auto it = conns_.find(sql);
+    assert(it != conns_.end());
+    return it->second->stmts.get();
+}
+
+SqlConnPool::Stats SqlConnPool::GetStats() {
+    lock_guard<Mutex> locker(mtx_);
+    Stats stats = stats_;
+    stats.total = static_cast<int>(conns_.size());
+    stats.free = static_cast<int>(free_.size());
+    stats.minSize = minConn_;
+    stats.maxSize = maxConn_;
+    return stats;
 }
 
 SqlConnPool::~SqlConnPool() {
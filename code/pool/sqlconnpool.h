@@ -1,51 +1,139 @@
 /*
  * @file sqlconnpool.h
  * @brief SqlConnPool类
- */ 
+ */
 #ifndef SQLCONNPOOL_H
 #define SQLCONNPOOL_H
 
 #include <mysql/mysql.h>
 #include <string>
-#include <queue>
+#include <deque>
 #include <mutex>
-#include <semaphore.h>
+#include <condition_variable>
 #include <thread>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
 #include "../log/log.h"
+#include "../metrics/metrics.h"
+#include "../trace/probes.h"
+#include "../metrics/lockprof.h"
+#include "sqlstmt.h"
 
+/*
+ * 弹性连接池：
+ *   启动时并行建立 minSize 个连接（也可以放到后台预热，不阻塞启动），连接不够用时按需增长到 maxSize，空闲太久的多余连接由后台线程关掉
+ *   只有建连成功的连接才会进池；后台线程定期 ping 空闲连接，坏掉的关掉，数量不足 minSize 时补齐
+ *   归还时发现连接已断开（CR_SERVER_GONE_ERROR / CR_SERVER_LOST）直接关掉，不再放回
+ *   取连接最多等待 acquireTimeoutMs，超时返回 nullptr，数据库变慢或重启时工作线程不会被永远卡住
+ */
 class SqlConnPool {
 public:
+    struct Stats {
+        int total;              // 已建立的连接数
+        int free;               // 其中空闲的
+        int minSize;
+        int maxSize;
+        uint64_t acquires;      // 成功取到连接的次数
+        uint64_t waits;         // 其中需要等待（没有空闲连接）的次数
+        uint64_t waitUsTotal;   // 等待总时长，微秒
+        uint64_t waitUsMax;     // 最长一次等待，微秒
+        uint64_t timeouts;      // 等待超时的次数
+        uint64_t connects;      // 建连成功次数（含启动、增长、补齐）
+        uint64_t connectFails;
+        uint64_t pingFails;     // 健康检查发现的坏连接
+        uint64_t broken;        // 归还时发现已断开的连接
+        uint64_t idleClosed;    // 空闲太久被收缩掉的连接
+    };
+
     // 单例模式 (Singleton)
     static SqlConnPool *Instance();
 
+    // 取一个连接，最多等待 acquireTimeoutMs，失败返回 nullptr
     MYSQL *GetConn();
     void FreeConn(MYSQL * conn);
     int GetFreeConnCount();
 
-    // 服务器启动时执行。根据传入的数据库地址、账号密码，循环调用 mysql_real_connect 创建指定数量（connSize）的连接，并推入 connQue_
+    // 连接上的预处理语句缓存，只能由当前持有该连接的线程使用
+    SqlStmtCache* Stmts(MYSQL* sql);
+
+    // 在 Init 之前调用。maxSize 小于 Init 的 connSize 时取 connSize
+    // lazyWarmup 为 true 时 Init 不等连接建好就返回，连接在后台建立
+    void SetPolicy(int maxSize, int acquireTimeoutMs, bool lazyWarmup);
+
+    // 服务器启动时执行。并行建立 connSize 个连接作为池子的最小容量，并启动健康检查线程
     void Init(const char* host, int port,
-              const char* user,const char* pwd, 
+              const char* user,const char* pwd,
               const char* dbName, int connSize);
     // 销毁所有连接
     void ClosePool();
 
+    // 拿 mtx_ 汇总，用于启动日志等低频场景；抓取指标走下面不加锁的 Metrics
+    Stats GetStats();
+
 private:
     // 单例模式 (Singleton)
     SqlConnPool();
     ~SqlConnPool();
 
-    // 连接池最大容量
-    int MAX_CONN_;
-    // 记录当前已使用和空闲的连接数
-    int useCount_;
-    int freeCount_;
+    struct Conn {
+        MYSQL* sql;
+        int64_t lastUsedMs;     // 最后一次归还的时刻（CoarseClock 毫秒）
+        std::unique_ptr<SqlStmtCache> stmts;
+    };
+
+    // 建立一个连接（阻塞，不持锁调用），失败返回 nullptr
+    MYSQL* Connect_();
+    // 以下持有 mtx_ 时调用
+    Conn* Add_(MYSQL* sql);
+    void Close_(Conn* conn);
+    int Total_() const { return static_cast<int>(conns_.size()) + opening_; }
+
+    // 并行建立 connSize 个初始连接，建好一个就放进池子
+    void Warmup_(int connSize);
+    // 健康检查线程
+    void HealthCheck_();
+
+    // 连接参数，补齐和增长时用
+    std::string host_, user_, pwd_, dbName_;
+    int port_;
+
+    // 最小/最大连接数
+    int minConn_;
+    int maxConn_;
+    int acquireTimeoutMs_;
+
+    // 全部已建立的连接（空闲 + 使用中）
+    std::unordered_map<MYSQL*, std::unique_ptr<Conn>> conns_;
+    // 空闲连接：表尾是最近归还的，优先复用；表头最久没用，健康检查和收缩从这里开始
+    std::deque<Conn*> free_;
+    // 正在建立（不持锁）的连接数，算进总数里，防止并发增长超过上限
+    int opening_;
+    // 最近一次建连失败的时刻，数据库挂掉时避免每个等待者都去重试
+    int64_t connectFailMs_;
+    bool closed_;
+    bool lazyWarmup_;
+    // 初始连接还在建立，等待者不自行增长
+    bool warming_;
 
-    // 已经建立好、随时可用的 MySQL 连接指针
-    std::queue<MYSQL *> connQue_;
     // 保证取/放操作是原子性的，防止多个线程拿到同一个连接
-    std::mutex mtx_;
-    // POSIX 信号量，连接池的“计数器”。初始值等于连接总数（如 10）。每取走一个连接，信号量减 1（P操作）；如果减到 0，后续线程会阻塞等待。每归还一个连接，信号量加 1（V操作），并唤醒等待的线程
-    sem_t semId_;
+    Mutex mtx_;
+    // 有连接归还（或者可以增长）时唤醒等待者
+    CondVar cond_;
+    // 健康检查线程的定时等待，关闭时唤醒
+    CondVar healthCond_;
+    std::thread health_;
+    std::thread warmup_;
+
+    Stats stats_;
+
+    // 持有 mtx_ 时调用，把连接数发布到不加锁的指标上
+    void Publish_();
+    MetricHistogram* waitUs_;       // 每次成功取连接的等待时间，不用等的记 0
+    MetricCounter* timeouts_;
+    MetricGauge* totalGauge_;
+    MetricGauge* freeGauge_;
 };
 
 
@@ -0,0 +1,202 @@
+/*
+ * @file sqlstmt.cpp
+ * @brief SqlStmtCache类（每个连接上的预处理语句缓存）
+ */
+#define LOG_MODULE Log::MOD_POOL   // 本文件的日志属于 pool 模块
+#include "sqlstmt.h"
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include "../log/log.h"
+using namespace std;
+
+namespace {
+const char* const STMT_TEXT[STMT_COUNT] = {
+    "SELECT username, password FROM user WHERE username=? LIMIT 1",
+    "INSERT INTO user(username, password) VALUES(?, ?)",
+};
+
+// 结果列的初始缓冲区大小，放不下时再按实际长度单独取
+const size_t COLUMN_BUFFER = 256;
+}
+
+SqlStmtCache::SqlStmtCache() {
+    for(int i = 0; i < STMT_COUNT; i++) {
+        stmts_[i] = nullptr;
+    }
+}
+
+SqlStmtCache::~SqlStmtCache() {
+    Clear();
+}
+
+const char* SqlStmtCache::Text(SQL_STMT id) {
+    assert(id >= 0 && id < STMT_COUNT);
+    return STMT_TEXT[id];
+}
+
+void SqlStmtCache::Put(SQL_STMT id, MYSQL_STMT* stmt) {
+    assert(id >= 0 && id < STMT_COUNT);
+    Drop(id);
+    stmts_[id] = stmt;
+}
+
+void SqlStmtCache::Drop(SQL_STMT id) {
+    assert(id >= 0 && id < STMT_COUNT);
+    if(stmts_[id]) {
+        mysql_stmt_close(stmts_[id]);
+        stmts_[id] = nullptr;
+    }
+}
+
+void SqlStmtCache::Clear() {
+    for(int i = 0; i < STMT_COUNT; i++) {
+        Drop(static_cast<SQL_STMT>(i));
+    }
+    for(auto& item: batch_) {
+        mysql_stmt_close(item.second);
+    }
+    batch_.clear();
+}
+
+bool SqlStmtCache::Run(MYSQL* sql, SQL_STMT id, const std::vector<std::string>& params, SqlResult* result) {
+    assert(sql && result);
+    return Exec_(sql, &stmts_[id], Text(id), params, result, nullptr);
+}
+
+std::string SqlStmtCache::BatchText(SQL_BATCH kind, int rows) {
+    assert(rows > 0);
+    string text;
+    if(kind == BATCH_USER_EXISTS) {
+        text = "SELECT username FROM user WHERE username IN (?";
+        for(int i = 1; i < rows; i++) { text += ", ?"; }
+        text += ")";
+    } else {
+        assert(kind == BATCH_USER_INSERT);
+        text = "INSERT INTO user(username, password) VALUES(?, ?)";
+        for(int i = 1; i < rows; i++) { text += ", (?, ?)"; }
+    }
+    return text;
+}
+
+bool SqlStmtCache::RunBatch(MYSQL* sql, SQL_BATCH kind, int rows,
+                            const std::vector<std::string>& params, std::vector<std::string>* column) {
+    assert(sql && kind >= 0 && kind < BATCH_COUNT);
+    MYSQL_STMT*& stmt = batch_[make_pair(static_cast<int>(kind), rows)];
+    SqlResult result;
+    bool ok = Exec_(sql, &stmt, stmt ? string() : BatchText(kind, rows), params, &result, column);
+    if(!stmt) { batch_.erase(make_pair(static_cast<int>(kind), rows)); }
+    return ok;
+}
+
+bool SqlStmtCache::Exec_(MYSQL* sql, MYSQL_STMT** stmt, const std::string& text,
+                         const std::vector<std::string>& params, SqlResult* result,
+                         std::vector<std::string>* column) {
+    if(!*stmt) {
+        /* 第一次在这个连接上用到，prepare 之后一直留着 */
+        MYSQL_STMT* prepared = mysql_stmt_init(sql);
+        if(!prepared) { return false; }
+        if(mysql_stmt_prepare(prepared, text.data(), text.size())) {
+            LOG_ERROR("MySql prepare error: %s", mysql_stmt_error(prepared));
+            mysql_stmt_close(prepared);
+            return false;
+        }
+        *stmt = prepared;
+    }
+    SqlParams p;
+    p.params = params;
+    if(!BindParams(*stmt, &p) || mysql_stmt_execute(*stmt)
+        || (mysql_stmt_field_count(*stmt) > 0 && mysql_stmt_store_result(*stmt))) {
+        LOG_ERROR("MySql stmt error: %s", mysql_stmt_error(*stmt));
+        mysql_stmt_close(*stmt);
+        *stmt = nullptr;
+        return false;
+    }
+    result->ok = true;
+    if(mysql_stmt_field_count(*stmt) > 0) {
+        if(column) {
+            FetchColumn_(*stmt, column);
+        } else {
+            FetchFirst(*stmt, result);
+        }
+    }
+    return true;
+}
+
+bool SqlStmtCache::BindParams(MYSQL_STMT* stmt, SqlParams* p) {
+    assert(stmt && p);
+    size_t n = p->params.size();
+    if(mysql_stmt_param_count(stmt) != n) { return false; }
+    p->binds.assign(n, MYSQL_BIND());
+    p->lens.resize(n);
+    for(size_t i = 0; i < n; i++) {
+        MYSQL_BIND& bind = p->binds[i];
+        p->lens[i] = p->params[i].size();
+        bind.buffer_type = MYSQL_TYPE_STRING;
+        bind.buffer = const_cast<char*>(p->params[i].data());
+        bind.buffer_length = p->lens[i];
+        bind.length = &p->lens[i];
+    }
+    return n == 0 || mysql_stmt_bind_param(stmt, p->binds.data()) == 0;
+}
+
+void SqlStmtCache::FetchFirst(MYSQL_STMT* stmt, SqlResult* result) {
+    assert(stmt && result);
+    unsigned int n = mysql_stmt_field_count(stmt);
+    vector<MYSQL_BIND> binds(n);
+    vector<vector<char>> bufs(n, vector<char>(COLUMN_BUFFER));
+    vector<unsigned long> lens(n);
+    vector<SqlBool> isNull(n), error(n);
+    for(unsigned int i = 0; i < n; i++) {
+        binds[i].buffer_type = MYSQL_TYPE_STRING;
+        binds[i].buffer = bufs[i].data();
+        binds[i].buffer_length = bufs[i].size();
+        binds[i].length = &lens[i];
+        binds[i].is_null = &isNull[i];
+        binds[i].error = &error[i];
+    }
+    if(n > 0 && mysql_stmt_bind_result(stmt, binds.data()) == 0) {
+        int ret = mysql_stmt_fetch(stmt);
+        if(ret == 0 || ret == MYSQL_DATA_TRUNCATED) {
+            result->hasRow = true;
+            for(unsigned int i = 0; i < n; i++) {
+                if(isNull[i]) {
+                    result->row.push_back("");
+                    continue;
+                }
+                if(lens[i] > bufs[i].size()) {
+                    /* 列比缓冲区长，按实际长度重新取这一列 */
+                    bufs[i].resize(lens[i]);
+                    binds[i].buffer = bufs[i].data();
+                    binds[i].buffer_length = bufs[i].size();
+                    mysql_stmt_fetch_column(stmt, &binds[i], i, 0);
+                }
+                result->row.push_back(string(bufs[i].data(), lens[i]));
+            }
+        }
+    }
+    mysql_stmt_free_result(stmt);
+}
+
+void SqlStmtCache::FetchColumn_(MYSQL_STMT* stmt, std::vector<std::string>* column) {
+    unsigned int n = mysql_stmt_field_count(stmt);
+    /* 只取第一列，其余列绑定到同一块丢弃用的缓冲区 */
+    vector<MYSQL_BIND> binds(n);
+    vector<char> buf(COLUMN_BUFFER), scratch(COLUMN_BUFFER);
+    unsigned long len = 0, scratchLen = 0;
+    SqlBool isNull = 0, scratchNull = 0;
+    for(unsigned int i = 0; i < n; i++) {
+        binds[i].buffer_type = MYSQL_TYPE_STRING;
+        binds[i].buffer = i == 0 ? buf.data() : scratch.data();
+        binds[i].buffer_length = COLUMN_BUFFER;
+        binds[i].length = i == 0 ? &len : &scratchLen;
+        binds[i].is_null = i == 0 ? &isNull : &scratchNull;
+    }
+    if(n > 0 && mysql_stmt_bind_result(stmt, binds.data()) == 0) {
+        int ret;
+        while((ret = mysql_stmt_fetch(stmt)) == 0 || ret == MYSQL_DATA_TRUNCATED) {
+            column->push_back(isNull ? string() : string(buf.data(), min<size_t>(len, buf.size())));
+        }
+    }
+    mysql_stmt_free_result(stmt);
+}
@@ -0,0 +1,98 @@
+/*
+ * @file sqlstmt.h
+ * @brief SqlStmtCache类（每个连接上的预处理语句缓存）
+ */
+#ifndef SQLSTMT_H
+#define SQLSTMT_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <type_traits>
+
+// 服务器用到的全部语句，文本见 sqlstmt.cpp
+enum SQL_STMT {
+    STMT_USER_SELECT = 0,   // 按用户名查密码
+    STMT_USER_INSERT,       // 注册
+    STMT_COUNT,
+};
+
+// 按行数生成的批量语句，用于注册的组提交
+enum SQL_BATCH {
+    BATCH_USER_EXISTS = 0,  // 一组用户名里哪些已经存在：SELECT username ... WHERE username IN (?, ...)
+    BATCH_USER_INSERT,      // 多行插入：INSERT ... VALUES (?, ?), ...
+    BATCH_COUNT,
+};
+
+// 查询结果。登录/注册只关心第一行
+struct SqlResult {
+    bool ok = false;        // 语句成功执行
+    bool hasRow = false;    // 至少返回了一行
+    std::vector<std::string> row;   // 第一行各列，NULL 记为空串
+};
+
+// MYSQL_BIND::is_null 的类型：MariaDB 是 my_bool，MySQL 8 是 bool
+typedef std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type SqlBool;
+
+// 一次执行的参数绑定，缓冲区指向 params 里的字符串，执行完成之前 params 不能改动
+struct SqlParams {
+    std::vector<std::string> params;
+    std::vector<MYSQL_BIND> binds;
+    std::vector<unsigned long> lens;
+};
+
+/*
+ * 预处理语句缓存：语句在连接上第一次用到时才 prepare，之后只发送参数，服务端不再解析 SQL
+ * 参数以二进制方式绑定，不拼接字符串，也就不存在注入
+ * 一个缓存只属于一个连接，由持有该连接的线程使用，不加锁
+ * 执行出错时丢掉对应语句，下次重新 prepare（连接重建后旧的语句句柄在服务端已经不存在）
+ */
+class SqlStmtCache {
+public:
+    SqlStmtCache();
+    ~SqlStmtCache();
+
+    SqlStmtCache(const SqlStmtCache&) = delete;
+    SqlStmtCache& operator=(const SqlStmtCache&) = delete;
+
+    static const char* Text(SQL_STMT id);
+
+    // 已经 prepare 好的语句，没有返回 nullptr
+    MYSQL_STMT* Find(SQL_STMT id) const { return stmts_[id]; }
+    // 放入一个已经 prepare 好的语句
+    void Put(SQL_STMT id, MYSQL_STMT* stmt);
+    // 关闭并丢掉语句
+    void Drop(SQL_STMT id);
+    // 关闭全部语句，必须在 mysql_close 之前调用
+    void Clear();
+
+    // 阻塞执行：必要时先 prepare，结果的第一行写入 result，成功返回 true
+    bool Run(MYSQL* sql, SQL_STMT id, const std::vector<std::string>& params, SqlResult* result);
+
+    static std::string BatchText(SQL_BATCH kind, int rows);
+    // 阻塞执行 rows 行的批量语句，每种行数各自 prepare 一次。有结果集时每行的第一列追加到 column
+    bool RunBatch(MYSQL* sql, SQL_BATCH kind, int rows,
+                  const std::vector<std::string>& params, std::vector<std::string>* column);
+
+    // 以下不做网络 IO，非阻塞调用方也可以直接使用
+    // 按字符串绑定参数
+    static bool BindParams(MYSQL_STMT* stmt, SqlParams* p);
+    // mysql_stmt_store_result 之后取第一行，并释放结果集
+    static void FetchFirst(MYSQL_STMT* stmt, SqlResult* result);
+
+private:
+    // prepare（*stmt 为空时）并执行，出错时关闭语句并把 *stmt 置空
+    static bool Exec_(MYSQL* sql, MYSQL_STMT** stmt, const std::string& text,
+                      const std::vector<std::string>& params, SqlResult* result,
+                      std::vector<std::string>* column);
+    // mysql_stmt_store_result 之后取每一行的第一列，并释放结果集
+    static void FetchColumn_(MYSQL_STMT* stmt, std::vector<std::string>* column);
+
+    MYSQL_STMT* stmts_[STMT_COUNT];
+    // (种类, 行数) -> 批量语句
+    std::map<std::pair<int, int>, MYSQL_STMT*> batch_;
+};
+
+#endif // SQLSTMT_H
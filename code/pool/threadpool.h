@@ -10,19 +10,35 @@
 #include <queue>
 #include <thread>
 #include <functional>
+#include <atomic>
+#include "../timer/coarseclock.h"
+#include "../metrics/metrics.h"
+#include "../trace/probes.h"
+#include "../metrics/lockprof.h"
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t threadCount = 8): pool_(std::make_shared<Pool>()) {
+    // waitUs 不为空时记录每个任务在队列里等了多久（微秒）
+    explicit ThreadPool(size_t threadCount = 8, MetricHistogram* waitUs = nullptr): pool_(std::make_shared<Pool>()) {
             assert(threadCount > 0);
+            pool_->waitUs = waitUs;
+            LockName(pool_->mtx, "threadpool");
             for(size_t i = 0; i < threadCount; i++) {
                 std::thread([pool = pool_] {
-                    std::unique_lock<std::mutex> locker(pool->mtx);
+                    std::unique_lock<Mutex> locker(pool->mtx);
                     while(true) {
                         if(!pool->tasks.empty()) {
                             auto task = std::move(pool->tasks.front());
                             pool->tasks.pop();
+                            size_t depth = pool->tasks.size();
+                            pool->depth.store(depth, std::memory_order_relaxed);
                             locker.unlock();
-                            task();
+                            int64_t waited = 0;
+                            if(pool->waitUs) {
+                                waited = CoarseClock::PreciseUs() - task.enqueueUs;
+                                pool->waitUs->Record(waited);
+                            }
+                            TWS_PROBE2(task_dequeue, depth, waited);
+                            task.run();
                             locker.lock();
                         } 
                         else if(pool->isClosed) break;
@@ -40,7 +56,7 @@ public:
         // 检查智能指针是否有效（非空），std::shared_ptr（以及 std::unique_ptr 等智能指针）重载了 “显式布尔转换运算符”（explicit operator bool）
         if(static_cast<bool>(pool_)) {	
             {
-                std::lock_guard<std::mutex> locker(pool_->mtx);
+                std::lock_guard<Mutex> locker(pool_->mtx);
                 pool_->isClosed = true;
             }
             pool_->cond.notify_all();
@@ -49,19 +65,34 @@ public:
 
     template<class F>
     void AddTask(F&& task) {
+        size_t depth;
         {
-            std::lock_guard<std::mutex> locker(pool_->mtx);
-            pool_->tasks.emplace(std::forward<F>(task));
+            std::lock_guard<Mutex> locker(pool_->mtx);
+            pool_->tasks.push(Task{std::forward<F>(task), pool_->waitUs ? CoarseClock::PreciseUs() : 0});
+            depth = pool_->tasks.size();
+            pool_->depth.store(depth, std::memory_order_relaxed);
         }
+        TWS_PROBE1(task_enqueue, depth);
         pool_->cond.notify_one();
     }
 
+    // 排队中的任务数，不拿锁，读到的是近似值
+    size_t QueueDepth() const {
+        return pool_->depth.load(std::memory_order_relaxed);
+    }
+
 private:
+    struct Task {
+        std::function<void()> run;
+        int64_t enqueueUs;
+    };
     struct Pool {
-        std::mutex mtx;
-        std::condition_variable cond;
-        bool isClosed;
-        std::queue<std::function<void()>> tasks;
+        Mutex mtx;
+        CondVar cond;
+        bool isClosed = false;
+        std::queue<Task> tasks;
+        std::atomic<size_t> depth{0};
+        MetricHistogram* waitUs = nullptr;
     };
     std::shared_ptr<Pool> pool_;
 };
@@ -10,6 +10,9 @@ Epoller::Epoller(int maxEvent):epollFd_(epoll_create(512)), events_(maxEvent){
 }
 
 Epoller::~Epoller() {
+    for(auto& item: timers_) {
+        close(item.first);
+    }
     close(epollFd_);
 }
 
@@ -48,3 +51,47 @@ uint32_t Epoller::GetEvents(size_t i) const {
     assert(i < events_.size() && i >= 0);
     return events_[i].events;
 }
+
+int Epoller::AddTimer() {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(fd < 0) return -1;
+    if(!AddFd(fd, EPOLLIN)) {
+        close(fd);
+        return -1;
+    }
+    timers_[fd] = -1;
+    return fd;
+}
+
+bool Epoller::ArmTimer(int timerFd, int64_t expireMs) {
+    auto it = timers_.find(timerFd);
+    if(it == timers_.end()) return false;
+    if(expireMs < 0) { expireMs = -1; }
+    /* 最早过期时间没有变化，不需要重新设定 */
+    if(it->second == expireMs) return true;
+    struct itimerspec its = {};
+    if(expireMs >= 0) {
+        /* it_value 全 0 表示解除定时器，所以时刻 0 按 1ns 处理 */
+        its.it_value.tv_sec = expireMs / 1000;
+        its.it_value.tv_nsec = (expireMs % 1000) * 1000000;
+        if(expireMs == 0) { its.it_value.tv_nsec = 1; }
+    }
+    if(timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &its, nullptr) < 0) return false;
+    it->second = expireMs;
+    return true;
+}
+
+void Epoller::AckTimer(int timerFd) {
+    uint64_t expirations = 0;
+    ssize_t ret = read(timerFd, &expirations, sizeof(expirations));
+    (void)ret;
+    auto it = timers_.find(timerFd);
+    if(it != timers_.end()) { it->second = -1; }
+}
+
+bool Epoller::DelTimer(int timerFd) {
+    if(timers_.erase(timerFd) == 0) return false;
+    DelFd(timerFd);
+    close(timerFd);
+    return true;
+}
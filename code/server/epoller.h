@@ -6,10 +6,13 @@
 #define EPOLLER_H
 
 #include <sys/epoll.h> //epoll_ctl()
+#include <sys/timerfd.h> // timerfd_create()
 #include <fcntl.h>  // fcntl()
 #include <unistd.h> // close()
 #include <assert.h> // close()
 #include <vector>
+#include <unordered_map>
+#include <stdint.h>
 #include <errno.h>
 
 class Epoller {
@@ -34,6 +37,19 @@ public:
 	// 用于在 Wait 返回后，通过索引 i 获取第 i 个就绪的 Socket 是哪个、触发了什么事件
     int GetEventFd(size_t i) const;
     uint32_t GetEvents(size_t i) const;
+
+    // 定时器：创建一个 timerfd（CLOCK_MONOTONIC）并注册到 epoll，返回其 fd，失败返回 -1
+    // 每组定时器（如每个 reactor 的时间轮）各用一个 timerfd，到期时像普通 fd 一样通过 Wait 返回
+    int AddTimer();
+
+    // 把 timerfd 设定在单调时钟的绝对时刻 expireMs（毫秒）触发，expireMs < 0 表示解除
+    // 与当前设定的时刻相同时直接返回，不做系统调用，所以可以在每轮循环里调用
+    bool ArmTimer(int timerFd, int64_t expireMs);
+
+    // timerfd 触发后读掉到期计数，并把它标记为未设定，下一次 ArmTimer 一定会重新设定
+    void AckTimer(int timerFd);
+
+    bool DelTimer(int timerFd);
         
 private:
     // epoll_create 创建的 epoll 实例的文件描述符（句柄）
@@ -43,6 +59,9 @@ private:
     // 用于存放从内核中返回的就绪事件
     // 当 epoll_wait 发现有 Socket 准备好读或写时，它会将这些 Socket 的信息拷贝到这个 events_ 数组中。使用 std::vector 而不是固定长度数组，是为了方便动态调整最大监听数量 
     std::vector<struct epoll_event> events_;    
+
+    // timerfd -> 当前设定的绝对触发时刻（毫秒），-1 表示未设定
+    std::unordered_map<int, int64_t> timers_;
 };
 
 #endif //EPOLLER_H
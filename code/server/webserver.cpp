@@ -2,30 +2,70 @@
  * @file webserver.cpp
  * @brief WebServer类
  */ 
+#define LOG_MODULE Log::MOD_SERVER   // 本文件的日志属于 server 模块
 #include "webserver.h"
 
 using namespace std;
 
+namespace {
+// SIGUSR2 只置标志，epoll_wait 被信号打断返回后由主循环处理
+volatile sig_atomic_t traceDumpRequested = 0;
+
+void OnTraceSignal(int) {
+    traceDumpRequested = 1;
+}
+}
+
 WebServer::WebServer(
             int port, int trigMode, int timeoutMS, bool OptLinger,
             int sqlPort, const char* sqlUser, const  char* sqlPwd,
             const char* dbName, int connPoolNum, int threadNum,
-            bool openLog, int logLevel, int logQueSize):
-            openLinger_(OptLinger), timeoutMS_(timeoutMS), isClose_(false), port_(port),
-            timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller())
+            bool openLog, int logLevel, int logQueSize, bool lazyTimer,
+            int sqlAsyncNum, bool lazyWarmup,
+            int authBackend, const char* authFile, int sqlBatchMs,
+            const char* metricsPath):
+            openLinger_(OptLinger), timeoutMS_(timeoutMS), maxConn_(InitConnLimit_()), lazyTimer_(lazyTimer), isClose_(false), port_(port), timerFd_(-1),
+            timer_(new TimeWheel()),
+            threadpool_(new ThreadPool(threadNum, Metrics::Instance()->Histogram("tws_threadpool_wait_us",
+                                                  "Time a task waits in the thread pool queue, microseconds"))),
+            epoller_(new Epoller())
     {
     srcDir_ = getcwd(nullptr, 256);
     assert(srcDir_);
     strncat(srcDir_, "/resources/", 16);
     HttpConn::userCount = 0;
     HttpConn::srcDir = srcDir_;
-    SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
+    if(authBackend == AUTH_LOCAL) {
+        /* 本地用户存储，整个服务不依赖数据库 */
+        LocalAuth* local = new LocalAuth();
+        auth_.reset(local);
+        if(!local->Init(authFile)) { isClose_ = true; }
+    } else {
+        SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
+        if(sqlAsyncNum > 0 && SqlAsync::Supported()) {
+            sqlAsync_.reset(new SqlAsync(epoller_.get()));
+            if(!sqlAsync_->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, sqlAsyncNum, lazyWarmup)) {
+                sqlAsync_.reset();
+            }
+        }
+        if(sqlBatchMs > 0) { batcher_.reset(new SqlBatcher(SqlConnPool::Instance(), sqlBatchMs, SQL_BATCH_ROWS)); }
+        if(sqlAsync_) { auth_.reset(new SqlAsyncAuth(sqlAsync_.get(), batcher_.get())); }
+        else { auth_.reset(new SqlAuth(batcher_.get())); }
+    }
+    HttpConn::auth = auth_.get();
+    InitMetrics_(metricsPath);
+    InitTrace_();
 
     InitEventMode_(trigMode);
     if(!InitSocket_()) { isClose_ = true;}
+    if(timeoutMS_ > 0) {
+        timerFd_ = epoller_->AddTimer();
+        if(timerFd_ < 0) { isClose_ = true; }
+    }
 
     if(openLog) {
         Log::Instance()->init(logLevel, "./log", ".log", logQueSize);
+        AccessLog::Init();
         if(isClose_) { LOG_ERROR("========== Server init error!=========="); }
         else {
             LOG_INFO("========== Server init ==========");
@@ -33,9 +73,22 @@ WebServer::WebServer(
             LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
                             (listenEvent_ & EPOLLET ? "ET": "LT"),
                             (connEvent_ & EPOLLET ? "ET": "LT"));
-            LOG_INFO("LogSys level: %d", logLevel);
+            LOG_INFO("Timeout: %dms, LazyTimer: %s", timeoutMS_, lazyTimer_? "true":"false");
+            LOG_INFO("Max connections: %d", maxConn_);
+            LOG_INFO("LogSys level: %d, async: %s", logLevel, logQueSize > 0 ? "true":"false");
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
-            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("Metrics path: %s", metricsPath[0] ? metricsPath : "disabled");
+            LOG_INFO("Auth backend: %s, ThreadPool num: %d", auth_->Name(), threadNum);
+            if(authBackend != AUTH_LOCAL) {
+                SqlConnPool::Stats pool = SqlConnPool::Instance()->GetStats();
+                LOG_INFO("SqlConnPool num: %d/%d (ready %d), warmup: %s",
+                                pool.minSize, pool.maxSize, pool.total, lazyWarmup ? "lazy" : "eager");
+                LOG_INFO("SqlAsync num: %d, %s", sqlAsyncNum,
+                                sqlAsync_ ? "enabled" : (SqlAsync::Supported() ? "disabled" : "unsupported by client library"));
+                LOG_INFO("Register batch: %dms, %d rows", sqlBatchMs, batcher_ ? SQL_BATCH_ROWS : 0);
+            } else {
+                LOG_INFO("LocalAuth file: %s", authFile);
+            }
         }
     }
 }
@@ -44,9 +97,69 @@ WebServer::~WebServer() {
     close(listenFd_);
     isClose_ = true;
     free(srcDir_);
+    /* 队列里剩下的注册要在连接池关闭之前写完 */
+    batcher_.reset();
     SqlConnPool::Instance()->ClosePool();
 }
 
+void WebServer::InitMetrics_(const char* path) {
+    Metrics* metrics = Metrics::Instance();
+    accepts_ = metrics->Counter("tws_accepts_total", "Accepted client connections");
+    timers_ = metrics->Gauge("tws_timers", "Connections with a pending timeout");
+    metrics->GaugeFunc("tws_connections_active", "Open client connections",
+                       [] { return static_cast<double>(HttpConn::userCount.load()); });
+    int maxConn = maxConn_;
+    metrics->GaugeFunc("tws_connections_limit", "Client connections accepted before replying busy",
+                       [maxConn] { return static_cast<double>(maxConn); });
+    ThreadPool* pool = threadpool_.get();
+    metrics->GaugeFunc("tws_threadpool_queue_depth", "Tasks waiting in the thread pool queue",
+                       [pool] { return static_cast<double>(pool->QueueDepth()); });
+    metrics->CounterFunc("tws_log_dropped_total{log=\"app\"}", "Log lines dropped because the queue was full",
+                         [] { return Log::Instance()->GetDropped(); });
+    metrics->CounterFunc("tws_log_dropped_total{log=\"access\"}", "Log lines dropped because the queue was full",
+                         [] { return Log::AccessInstance()->GetDropped(); });
+    /* CredCache 的统计本来就是分片的原子计数 */
+    CredCache* cache = CredCache::Instance();
+    metrics->CounterFunc("tws_credcache_lookups_total{result=\"hit\"}", "Credential cache lookups",
+                         [cache] { return cache->GetStats().hits; });
+    metrics->CounterFunc("tws_credcache_lookups_total{result=\"negative_hit\"}", "Credential cache lookups",
+                         [cache] { return cache->GetStats().negHits; });
+    metrics->CounterFunc("tws_credcache_lookups_total{result=\"miss\"}", "Credential cache lookups",
+                         [cache] { return cache->GetStats().misses; });
+    metrics->CounterFunc("tws_credcache_lookups_total{result=\"coalesced\"}", "Credential cache lookups",
+                         [cache] { return cache->GetStats().coalesced; });
+    if(batcher_) {
+        SqlBatcher* batcher = batcher_.get();
+        metrics->CounterFunc("tws_sql_batch_commits_total", "Register transactions committed by the batcher",
+                             [batcher] { return batcher->GetStats().batches; });
+        metrics->CounterFunc("tws_sql_batch_rows_total", "Registrations handled by the batcher",
+                             [batcher] { return batcher->GetStats().rows; });
+    }
+    if(path && path[0]) {
+        HttpConn::AddPage(path, "text/plain; version=0.0.4", [metrics] { return metrics->Render(); });
+    }
+}
+
+void WebServer::InitTrace_() {
+    TraceRing* ring = TraceRing::Instance();
+    if(!ring->Enabled()) { return; }
+    HttpConn::AddPage("/debug/trace", "application/json", [ring] { return ring->RenderJson(); });
+    HttpConn::AddPage("/debug/trace.chrome", "application/json", [ring] { return ring->RenderChrome(); });
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnTraceSignal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR2, &sa, nullptr);
+}
+
+void WebServer::DumpTrace_() {
+    threadpool_->AddTask([] {
+        string file = TraceRing::Instance()->DumpChrome("./log/trace");
+        if(file.empty()) { LOG_ERROR("Trace dump failed!"); }
+        else { LOG_INFO("Trace dumped to %s", file.c_str()); }
+    });
+}
+
 // 根据配置决定是使用 LT（水平触发） 还是 ET（边缘触发）
 void WebServer::InitEventMode_(int trigMode) {
     listenEvent_ = EPOLLRDHUP;
@@ -74,13 +187,20 @@ void WebServer::InitEventMode_(int trigMode) {
 }
 
 void WebServer::Start() {
-    int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞 */
     if(!isClose_) { LOG_INFO("========== Server start =========="); }
     while(!isClose_) {
         if(timeoutMS_ > 0) {
-            timeMS = timer_->GetNextTick();
+            /* 把 timerfd 设定到时间轮的下一个到期时刻，时刻没变时不会产生系统调用 */
+            epoller_->ArmTimer(timerFd_, timer_->NextExpire());
+        }
+        /* epoll wait timeout == -1 无事件将阻塞，超时由 timerfd 唤醒 */
+        int eventCnt = epoller_->Wait(-1);	// 阻塞监听，唤醒条件：I/O 就绪、timerfd 到期、被信号中断
+        CoarseClock::Update();
+        if(traceDumpRequested) {
+            traceDumpRequested = 0;
+            DumpTrace_();
         }
-        int eventCnt = epoller_->Wait(timeMS);	// 阻塞监听，唤醒条件：I/O 就绪、超时（Timeout）、被信号中断
+        bool timerExpired = false;
         for(int i = 0; i < eventCnt; i++) {
             /* 处理事件 */
             int fd = epoller_->GetEventFd(i);
@@ -88,6 +208,13 @@ void WebServer::Start() {
             if(fd == listenFd_) {
                 DealListen_();
             }
+            else if(fd == timerFd_) {
+                epoller_->AckTimer(timerFd_);
+                timerExpired = true;
+            }
+            else if(sqlAsync_ && sqlAsync_->Owns(fd)) {
+                sqlAsync_->OnEvent(fd, events);
+            }
             else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
                 assert(users_.count(fd) > 0);
                 CloseConn_(&users_[fd]);
@@ -103,6 +230,11 @@ void WebServer::Start() {
                 LOG_ERROR("Unexpected event");
             }
         }
+        /* 先处理本轮的读写事件（惰性模式下会刷新活跃时刻），再处理到期的定时器 */
+        if(timerExpired) {
+            timer_->tick();
+        }
+        timers_->Set(static_cast<int64_t>(timer_->size()));
     }
 }
 
@@ -122,6 +254,18 @@ void WebServer::CloseConn_(HttpConn* client) {
     client->Close();
 }
 
+int WebServer::InitConnLimit_() {
+    struct rlimit rl;
+    if(getrlimit(RLIMIT_NOFILE, &rl) != 0) { return MAX_FD; }
+    if(rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if(rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > static_cast<rlim_t>(INT_MAX)) { return MAX_FD; }
+    return std::max(static_cast<int>(rl.rlim_cur) - FD_RESERVE, 64);
+}
+
 void WebServer::AddClient_(int fd, sockaddr_in addr) {
     assert(fd > 0);
     users_[fd].init(fd, addr);
@@ -129,8 +273,9 @@ void WebServer::AddClient_(int fd, sockaddr_in addr) {
         // std::bind(...): 回调函数（Callback） 的包装器
         // 绑定函数地址：指向 WebServer::CloseConn_ 这个成员函数
         // 绑定对象实例 (this)：告诉程序，当超时发生时，是“我这个当前的 WebServer 对象”去执行关闭操作
-        // 绑定实参 (&users_[fd])：预先封存好参数。当回调被触发时，它会自动把指向这个客户端 HttpConn 对象的指针传给 CloseConn_ 函数
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+        // 绑定实参 (&users_[fd])：预先封存好参数。当回调被触发时，它会自动把指向这个客户端 HttpConn 对象的指针传给 OnTimeout_ 函数
+        users_[fd].Touch(CoarseClock::CachedMs());
+        timer_->add(users_[fd].TimerNode(), timeoutMS_, std::bind(&WebServer::OnTimeout_, this, &users_[fd]));
     }
     epoller_->AddFd(fd, EPOLLIN | connEvent_);
     SetFdNonblock(fd);
@@ -143,9 +288,11 @@ void WebServer::DealListen_() {
     do {
         int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
         if(fd <= 0) { return;}
-        else if(HttpConn::userCount >= MAX_FD) {
+        accepts_->Add();
+        TWS_PROBE2(accept, fd, HttpConn::userCount.load());
+        if(HttpConn::userCount >= maxConn_) {
             SendError_(fd, "Server busy!");
-            LOG_WARN("Clients is full!");
+            LOG_WARN_RATELIMIT(1000, "Clients is full!");
             return;
         }
         AddClient_(fd, addr);
@@ -155,6 +302,7 @@ void WebServer::DealListen_() {
 void WebServer::DealRead_(HttpConn* client) {
     assert(client);
     ExtentTime_(client);
+    client->TraceDispatch();
     threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
 }
 
@@ -166,7 +314,27 @@ void WebServer::DealWrite_(HttpConn* client) {
 
 void WebServer::ExtentTime_(HttpConn* client) {
     assert(client);
-    if(timeoutMS_ > 0) { timer_->adjust(client->GetFd(), timeoutMS_); }
+    if(timeoutMS_ <= 0) { return; }
+    if(lazyTimer_) {
+        /* 只记一个时间戳，真正的截止时间等定时器到期时再算 */
+        client->Touch(CoarseClock::CachedMs());
+    } else {
+        timer_->adjust(client->TimerNode(), timeoutMS_);
+    }
+}
+
+void WebServer::OnTimeout_(HttpConn* client) {
+    assert(client);
+    if(lazyTimer_) {
+        int64_t idle = CoarseClock::NowMs() - client->LastActive();
+        if(idle < timeoutMS_) {
+            /* 超时期间有过读写，按最后活跃时刻重新计算剩余时间 */
+            timer_->add(client->TimerNode(), timeoutMS_ - idle, std::bind(&WebServer::OnTimeout_, this, client));
+            return;
+        }
+    }
+    TWS_PROBE2(timeout, client->GetFd(), lazyTimer_ ? CoarseClock::NowMs() - client->LastActive() : timeoutMS_);
+    CloseConn_(client);
 }
 
 void WebServer::OnRead_(HttpConn* client) {
@@ -184,11 +352,25 @@ void WebServer::OnRead_(HttpConn* client) {
 void WebServer::OnProcess(HttpConn* client) {
     if(client->process()) {
         epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+    } else if(client->IsWaitingDb()) {
+        /* 查库期间连接保持 EPOLLONESHOT 的未激活状态，回调在主线程执行，生成响应再交回线程池 */
+        uint64_t gen = client->Generation();
+        client->VerifyAsync([this, client, gen](bool ok) {
+            if(client->Generation() != gen) { return; }
+            threadpool_->AddTask(std::bind(&WebServer::OnVerified_, this, client, gen, ok));
+        });
     } else {
         epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
     }
 }
 
+void WebServer::OnVerified_(HttpConn* client, uint64_t gen, bool ok) {
+    assert(client);
+    if(client->ResumeAuth(gen, ok)) {
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+    }
+}
+
 void WebServer::OnWrite_(HttpConn* client) {
     assert(client);
     int ret = -1;
@@ -13,14 +13,21 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <signal.h>
+#include <sys/resource.h>  // getrlimit()
+#include <limits.h>
 
 #include "epoller.h"
 #include "../log/log.h"
-#include "../timer/heaptimer.h"
+#include "../timer/timewheel.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/threadpool.h"
 #include "../pool/sqlconnRAII.h"
+#include "../pool/sqlasync.h"
+#include "../pool/sqlauth.h"
+#include "../auth/localauth.h"
 #include "../http/httpconn.h"
+#include "../metrics/metrics.h"
 
 class WebServer {
 public:
@@ -28,9 +35,18 @@ public:
         int port, int trigMode, int timeoutMS, bool OptLinger, 
         int sqlPort, const char* sqlUser, const  char* sqlPwd, 
         const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize);
+        bool openLog, int logLevel, int logQueSize, bool lazyTimer,
+        int sqlAsyncNum, bool lazyWarmup,
+        int authBackend, const char* authFile, int sqlBatchMs,
+        const char* metricsPath);
 
     ~WebServer();
+
+    // 用户存储后端
+    enum AUTH_BACKEND {
+        AUTH_MYSQL = 0,     // MySQL（默认）
+        AUTH_LOCAL,         // 本地文件，不连接数据库
+    };
     
     // 一个死循环，不断调用 epoller_->Wait()。一旦有动集触发，就根据 fd 的类型派发任务
     void Start();
@@ -40,6 +56,15 @@ private:
     bool InitSocket_(); 
     // 根据配置决定是使用 LT（水平触发） 还是 ET（边缘触发）
     void InitEventMode_(int trigMode);
+    // 注册服务器层面的指标，path 不为空时在这个路径上以 Prometheus 文本格式导出全部指标
+    void InitMetrics_(const char* path);
+    // 请求追踪开启时注册 /debug/trace（JSON）和 /debug/trace.chrome（Chrome trace，只对回环地址开放），
+    // 并在收到 SIGUSR2 时把 Chrome trace 写到 ./log/trace 下
+    void InitTrace_();
+    // 主循环发现 SIGUSR2 之后调用，写文件交给线程池，不阻塞事件循环
+    void DumpTrace_();
+    // 连接数上限跟随文件描述符上限：软限制先提到硬限制，再扣掉留给监听、epoll、日志、数据库连接的描述符
+    static int InitConnLimit_();
     void AddClient_(int fd, sockaddr_in addr);
   
     // 处理新连接。接受新客户端，封装成 HttpConn 存入 users_，并挂到 epoller_ 和 timer_ 上
@@ -50,6 +75,8 @@ private:
 
     void SendError_(int fd, const char*info);
     void ExtentTime_(HttpConn* client);
+    // 定时器回调。惰性模式下先检查最后活跃时刻，期间有过读写就重新挂上定时器，否则关闭连接
+    void OnTimeout_(HttpConn* client);
     void CloseConn_(HttpConn* client);
 
     // 调用 HttpConn::read 读取数据，然后进入 OnProcess
@@ -58,13 +85,24 @@ private:
     void OnWrite_(HttpConn* client);
     // 调用 HttpConn::process 进行逻辑解析（状态机解析）
     void OnProcess(HttpConn* client);
+    // 登录/注册的查库结果回来（工作线程），生成响应后开始监听写事件
+    void OnVerified_(HttpConn* client, uint64_t gen, bool ok);
 
+    // 拿不到文件描述符上限（或者不限）时的连接数上限
     static const int MAX_FD = 65536;
+    // 不给客户端连接用的描述符个数
+    static const int FD_RESERVE = 256;
+    // 注册组提交时一个事务最多写入的行数
+    static const int SQL_BATCH_ROWS = 64;
 
     static int SetFdNonblock(int fd);
 
     bool openLinger_;
     int timeoutMS_;  /* 毫秒MS */
+    // 同时打开的客户端连接上限
+    int maxConn_;
+    // 惰性超时：读写事件不再调整定时器，只在连接上记录活跃时刻
+    bool lazyTimer_;
     bool isClose_;
     
     // 网络与状态
@@ -72,6 +110,8 @@ private:
     int port_;
     // 监听套接字，专门负责接待“新客人”
     int listenFd_;
+    // 时间轮对应的 timerfd，只有定时器真正到期时才会被 epoll 唤醒去处理
+    int timerFd_;
     // 静态资源的根目录
     char* srcDir_;
     // 存储监听 Socket 和普通连接 Socket 的 epoll 事件配置（ET 还是 LT）
@@ -79,12 +119,22 @@ private:
     uint32_t connEvent_;
     
     // 核心组件（智能指针管理）
-    // 基于小根堆，负责踢掉那些占着连接不干活的超时客户端
-    std::unique_ptr<HeapTimer> timer_;
+    // 基于分层时间轮，负责踢掉那些占着连接不干活的超时客户端。结点嵌在 HttpConn 里，刷新/删除都是 O(1)
+    std::unique_ptr<TimeWheel> timer_;
     // 负责处理具体的读写解析任务，实现并发
     std::unique_ptr<ThreadPool> threadpool_;
     // 监控所有 Socket 的动静
     std::unique_ptr<Epoller> epoller_;
+    // 非阻塞查库，连接的 socket 挂在 epoller_ 上，由主线程驱动。客户端库不支持时为空
+    std::unique_ptr<SqlAsync> sqlAsync_;
+    // 注册的组提交，为空时每条注册单独写入。回调可能投递到 sqlAsync_，析构在它之前
+    std::unique_ptr<SqlBatcher> batcher_;
+    // 登录/注册使用的用户存储，析构在 sqlAsync_ 之前
+    std::unique_ptr<AuthBackend> auth_;
+
+    // 指标。定时器个数只在主线程可见，每轮事件循环发布一次
+    MetricCounter* accepts_;
+    MetricGauge* timers_;
     
     // 数据容器
     // 记录了当前所有连接的文件描述符（fd）与其对应的 HttpConn 对象。通过 fd 快速定位是哪个客户端在说话
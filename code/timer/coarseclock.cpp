@@ -0,0 +1,31 @@
+/*
+ * @file coarseclock.cpp
+ * @brief CoarseClock类
+ */
+#include "coarseclock.h"
+
+std::atomic<int64_t> CoarseClock::cachedMs_(CoarseClock::NowMs());
+
+const struct tm& CoarseClock::LocalTime(time_t sec) {
+    thread_local time_t cachedSec = -1;
+    thread_local struct tm cachedTm;
+    if(sec != cachedSec) {
+        localtime_r(&sec, &cachedTm);
+        cachedSec = sec;
+    }
+    return cachedTm;
+}
+
+const char* CoarseClock::HttpDate() {
+    thread_local time_t cachedSec = -1;
+    thread_local char cachedDate[32];
+    struct timeval now;
+    WallTime(&now);
+    if(now.tv_sec != cachedSec) {
+        struct tm t;
+        gmtime_r(&now.tv_sec, &t);
+        strftime(cachedDate, sizeof(cachedDate), "%a, %d %b %Y %H:%M:%S GMT", &t);
+        cachedSec = now.tv_sec;
+    }
+    return cachedDate;
+}
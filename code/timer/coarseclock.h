@@ -0,0 +1,80 @@
+/*
+ * @file coarseclock.h
+ * @brief CoarseClock类
+ */
+#ifndef COARSE_CLOCK_H
+#define COARSE_CLOCK_H
+
+#include <time.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <chrono>
+#include <atomic>
+
+/*
+ * 进程共享的粗粒度时钟
+ * CLOCK_MONOTONIC_COARSE / CLOCK_REALTIME_COARSE 直接读取内核在每个时钟中断更新的时间（vDSO，不陷入内核），
+ * 精度是一个 jiffy（1~4ms），对毫秒级的超时、日志时间戳、HTTP Date 头已经足够
+ * 同时满足 chrono 的 Clock 接口，可以直接作为 HeapTimer 的 Clock 使用
+ */
+class CoarseClock {
+public:
+    typedef std::chrono::milliseconds duration;
+    typedef duration::rep rep;
+    typedef duration::period period;
+    typedef std::chrono::time_point<CoarseClock> time_point;
+    static const bool is_steady = true;
+
+    static time_point now() noexcept {
+        return time_point(duration(NowMs()));
+    }
+
+    // 单调时间，毫秒
+    static int64_t NowMs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    // 精确的单调时间，毫秒。只在定时器真正到期时读一次，保证不会因为粗粒度时钟滞后而漏处理已到期的结点
+    static int64_t PreciseMs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    // 精确的单调时间，微秒。用于请求各阶段的耗时统计
+    static int64_t PreciseUs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    // 主循环每轮 epoll_wait 返回后刷新一次，之后本轮的事件处理只读缓存值，连 vDSO 调用都省掉
+    static void Update() {
+        cachedMs_.store(NowMs(), std::memory_order_relaxed);
+    }
+
+    static int64_t CachedMs() {
+        return cachedMs_.load(std::memory_order_relaxed);
+    }
+
+    // 墙上时间，用于日志时间戳
+    static void WallTime(struct timeval* tv) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        tv->tv_sec = ts.tv_sec;
+        tv->tv_usec = ts.tv_nsec / 1000;
+    }
+
+    // 本地时间。每个线程缓存上一次的结果，同一秒内不再调用 localtime_r（glibc 里它要拿全局的时区锁）
+    static const struct tm& LocalTime(time_t sec);
+
+    // HTTP Date 头的值，如 "Sun, 06 Nov 1994 08:49:37 GMT"，同样按线程、按秒缓存
+    static const char* HttpDate();
+
+private:
+    static std::atomic<int64_t> cachedMs_;
+};
+
+#endif //COARSE_CLOCK_H
@@ -13,12 +13,13 @@
 #include <functional> 
 #include <assert.h> 
 #include <chrono>
+#include "coarseclock.h"
 #include "../log/log.h"
 
 // 回调函数包装器。当定时器超时，会调用这个函数（通常是执行 HttpConn::Close）
 typedef std::function<void()> TimeoutCallBack;
-// 高精度时钟及其时间点
-typedef std::chrono::high_resolution_clock Clock;
+// 粗粒度单调时钟及其时间点。超时以毫秒计，不需要高精度时钟，也不受系统改时间影响
+typedef CoarseClock Clock;
 typedef std::chrono::milliseconds MS;
 typedef Clock::time_point TimeStamp;
 
@@ -0,0 +1,222 @@
+/*
+ * @file timewheel.cpp
+ * @brief TimeWheel类（分层时间轮）
+ */
+#include "timewheel.h"
+
+TimeWheel::TimeWheel(): curTick_(NowMs_()), count_(0), level0Count_(0), nextExpire_(UINT64_MAX) {
+    for(int i = 0; i < TVR_SIZE; i++) {
+        InitHead_(&tv1_[i]);
+    }
+    for(int l = 0; l < LEVELS - 1; l++) {
+        for(int i = 0; i < TVN_SIZE; i++) {
+            InitHead_(&tvn_[l][i]);
+        }
+    }
+}
+
+uint64_t TimeWheel::NowMs_() {
+    return CoarseClock::NowMs();
+}
+
+void TimeWheel::Link_(TimeWheelNode* node) {
+    uint64_t expires = node->expires;
+    int64_t idx = static_cast<int64_t>(expires - curTick_);
+    int level = 0;
+    TimeWheelNode* head = nullptr;
+    if(idx < 0) {
+        /* 已经过期的结点放到下一个要处理的槽里 */
+        head = &tv1_[curTick_ & TVR_MASK];
+    }
+    else if(idx < TVR_SIZE) {
+        head = &tv1_[expires & TVR_MASK];
+    }
+    else {
+        /* 超出最大范围的按最大范围处理 */
+        if(idx > 0xffffffffLL) {
+            idx = 0xffffffffLL;
+            expires = curTick_ + idx;
+        }
+        for(level = 1; level < LEVELS; level++) {
+            if(idx < (1LL << (TVR_BITS + level * TVN_BITS))) { break; }
+        }
+        assert(level < LEVELS);
+        int shift = TVR_BITS + (level - 1) * TVN_BITS;
+        head = &tvn_[level - 1][(expires >> shift) & TVN_MASK];
+    }
+    /* 挂到槽位链表尾部 */
+    node->level = level;
+    node->next = head;
+    node->prev = head->prev;
+    head->prev->next = node;
+    head->prev = node;
+    count_++;
+    if(level == 0) { level0Count_++; }
+}
+
+void TimeWheel::Unlink_(TimeWheelNode* node) {
+    assert(node->IsLinked());
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+    count_--;
+    if(node->level == 0) { level0Count_--; }
+    node->level = -1;
+}
+
+void TimeWheel::add(TimeWheelNode* node, int timeout, const TimeoutCallBack& cb) {
+    assert(node && timeout >= 0);
+    if(node->IsLinked()) {
+        Unlink_(node);
+    }
+    if(count_ == 0) {
+        /* 轮上没有结点时指针可能落后很多，直接对齐到当前时刻 */
+        curTick_ = NowMs_();
+    }
+    node->expires = NowMs_() + timeout;
+    node->cb = cb;
+    Link_(node);
+    UpdateNextExpire_(node->expires);
+}
+
+void TimeWheel::adjust(TimeWheelNode* node, int timeout) {
+    assert(node && node->IsLinked());
+    Unlink_(node);
+    node->expires = NowMs_() + timeout;
+    Link_(node);
+    UpdateNextExpire_(node->expires);
+}
+
+void TimeWheel::cancel(TimeWheelNode* node) {
+    assert(node);
+    if(node->IsLinked()) {
+        Unlink_(node);
+    }
+}
+
+int TimeWheel::Cascade_(int level, int index) {
+    /* 先把整条链表摘下来，再逐个按新的差值重新挂到下层 */
+    TimeWheelNode* head = Slot_(level, index);
+    TimeWheelNode* node = head->next;
+    InitHead_(head);
+    while(node != head) {
+        TimeWheelNode* next = node->next;
+        count_--;
+        Link_(node);
+        node = next;
+    }
+    return index;
+}
+
+void TimeWheel::Advance_(uint64_t now) {
+    while(curTick_ <= now) {
+        if(count_ == 0) {
+            curTick_ = now + 1;
+            break;
+        }
+        int index = curTick_ & TVR_MASK;
+        if(level0Count_ == 0 && index != 0) {
+            /* 第 0 层为空，直接跳到下一次 cascade 的刻度 */
+            uint64_t next = (curTick_ | TVR_MASK) + 1;
+            if(next > now) {
+                curTick_ = now + 1;
+                break;
+            }
+            curTick_ = next;
+            index = 0;
+        }
+        if(index == 0) {
+            for(int level = 1; level < LEVELS; level++) {
+                int shift = TVR_BITS + (level - 1) * TVN_BITS;
+                if(Cascade_(level, (curTick_ >> shift) & TVN_MASK) != 0) { break; }
+            }
+        }
+
+        /* 先把当前槽摘到临时链表，并让指针前进一格。回调里重新 add 的结点不会落回正在处理的槽 */
+        TimeWheelNode expired;
+        InitHead_(&expired);
+        TimeWheelNode* head = &tv1_[index];
+        if(!Empty_(head)) {
+            expired.next = head->next;
+            expired.prev = head->prev;
+            expired.next->prev = &expired;
+            expired.prev->next = &expired;
+            InitHead_(head);
+        }
+        curTick_++;
+        while(!Empty_(&expired)) {
+            TimeWheelNode* node = expired.next;
+            Unlink_(node);
+            TimeoutCallBack cb = node->cb;
+            cb();
+        }
+    }
+}
+
+void TimeWheel::tick() {
+    /* 到期处理的频率很低，这里读精确时钟，避免粗粒度时钟滞后导致 timerfd 触发后没有结点到期 */
+    Advance_(CoarseClock::PreciseMs());
+    nextExpire_ = ComputeNextExpire_();
+}
+
+int TimeWheel::GetNextTick() {
+    tick();
+    if(count_ == 0) { return -1; }
+    uint64_t now = NowMs_();
+    if(nextExpire_ <= now) { return 0; }
+    uint64_t res = nextExpire_ - now;
+    return res > 0x7fffffff ? 0x7fffffff : static_cast<int>(res);
+}
+
+uint64_t TimeWheel::ComputeNextExpire_() const {
+    if(count_ == 0) { return UINT64_MAX; }
+    uint64_t next = UINT64_MAX;
+    if(level0Count_ > 0) {
+        for(int i = 0; i < TVR_SIZE; i++) {
+            if(!Empty_(&tv1_[(curTick_ + i) & TVR_MASK])) {
+                next = curTick_ + i;
+                break;
+            }
+        }
+    }
+    if(count_ == level0Count_) { return next; }
+    /*
+     * 上层结点要先 cascade 到下层才会到期，所以还要和各层下一个非空槽的 cascade 时刻取最小值
+     * 第 level 层的槽只在刻度对齐到 2^shift 时处理；结点所在槽的 cascade 时刻不晚于它的过期时间，
+     * 取各层最小值就得到一个不晚于最早过期时间的下界
+     */
+    for(int level = 1; level < LEVELS; level++) {
+        int shift = TVR_BITS + (level - 1) * TVN_BITS;
+        /* 本层第一个尚未处理的 cascade 刻度（curTick_ 恰好对齐时它本身还没处理） */
+        uint64_t base = (curTick_ + (1ULL << shift) - 1) >> shift;
+        if((base << shift) >= next) { break; }   // 更高层的 cascade 刻度只会更晚
+        for(int k = 0; k < TVN_SIZE; k++) {
+            if(!Empty_(&tvn_[level - 1][(base + k) & TVN_MASK])) {
+                next = std::min(next, (base + k) << shift);
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+void TimeWheel::clear() {
+    /* 结点属于外部对象，清空时只需要断开链接 */
+    for(int level = 0; level < LEVELS; level++) {
+        int n = level == 0 ? TVR_SIZE : TVN_SIZE;
+        for(int i = 0; i < n; i++) {
+            TimeWheelNode* head = Slot_(level, i);
+            TimeWheelNode* node = head->next;
+            while(node != head) {
+                TimeWheelNode* next = node->next;
+                node->prev = node->next = nullptr;
+                node->level = -1;
+                node = next;
+            }
+            InitHead_(head);
+        }
+    }
+    count_ = 0;
+    level0Count_ = 0;
+    nextExpire_ = UINT64_MAX;
+}
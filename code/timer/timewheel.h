@@ -0,0 +1,118 @@
+/*
+ * @file timewheel.h
+ * @brief TimeWheel类（分层时间轮）
+ */
+#ifndef TIME_WHEEL_H
+#define TIME_WHEEL_H
+
+#include <stdint.h>
+#include <assert.h>
+#include <functional>
+#include <chrono>
+#include "heaptimer.h"
+
+// 侵入式定时器结点，直接嵌在连接对象（HttpConn）里，不需要额外的内存分配和 id -> 下标的哈希映射
+// 结点在槽位里以双向循环链表组织，所以 add / adjust / cancel 都是 O(1) 的指针操作
+struct TimeWheelNode {
+    TimeWheelNode* prev = nullptr;
+    TimeWheelNode* next = nullptr;
+    // 绝对过期时间（毫秒刻度）
+    uint64_t expires = 0;
+    // 结点当前所在的层，用来维护第 0 层的结点计数
+    int level = -1;
+    TimeoutCallBack cb;
+
+    bool IsLinked() const { return next != nullptr; }
+};
+
+/*
+ * 分层时间轮（参考 Linux 内核早期的 tvec 实现），刻度为 1ms
+ * 第 0 层 256 个槽，覆盖 256ms；第 1~4 层各 64 个槽，依次覆盖 16.4s、17.5min、18.6h、49.7day
+ * 指针每走一格处理第 0 层对应槽位；第 0 层转完一圈时，把上一层当前槽位里的结点重新散列（cascade）到下层
+ */
+class TimeWheel {
+public:
+    TimeWheel();
+
+    ~TimeWheel() { clear(); }
+
+    // 添加定时器。如果结点已经在轮上，则先摘下再重新挂入
+    void add(TimeWheelNode* node, int timeout, const TimeoutCallBack& cb);
+
+    // 刷新过期时间：摘链 + 重新挂链，O(1)
+    void adjust(TimeWheelNode* node, int timeout);
+
+    // 取消定时器，不触发回调
+    void cancel(TimeWheelNode* node);
+
+    void clear();
+
+    // 推进时间轮到当前时刻，触发所有已过期结点的回调
+    void tick();
+
+    // 返回距离下一次需要处理的时刻还有多少毫秒，没有定时器时返回 -1
+    int GetNextTick();
+
+    // 返回下一次需要处理的绝对时刻（CoarseClock 毫秒），没有定时器时返回 -1，O(1)
+    // 这是一个不晚于最早过期时间的下界：tick 之后取第 0 层最早的非空槽和各上层下一次非空 cascade 的最小值，
+    // add 时再和新结点取最小值；cancel/adjust 推迟过期时间时不更新，提前醒来只会空跑一次 tick
+    int64_t NextExpire() const {
+        return count_ == 0 ? -1 : static_cast<int64_t>(nextExpire_);
+    }
+
+    size_t size() const { return count_; }
+
+private:
+    static const int TVR_BITS = 8;
+    static const int TVN_BITS = 6;
+    static const int TVR_SIZE = 1 << TVR_BITS;
+    static const int TVN_SIZE = 1 << TVN_BITS;
+    static const int TVR_MASK = TVR_SIZE - 1;
+    static const int TVN_MASK = TVN_SIZE - 1;
+    static const int LEVELS = 5;
+
+    static uint64_t NowMs_();
+
+    // 根据过期时间与当前指针的差值决定挂到哪一层的哪个槽
+    void Link_(TimeWheelNode* node);
+    void Unlink_(TimeWheelNode* node);
+
+    // 把第 level 层 index 号槽的结点重新散列到下层，返回 index 供上层判断是否继续 cascade
+    int Cascade_(int level, int index);
+
+    // 处理 [curTick_, now] 区间内的所有刻度
+    void Advance_(uint64_t now);
+
+    // 扫描时间轮，计算下一次需要处理的刻度
+    uint64_t ComputeNextExpire_() const;
+
+    void UpdateNextExpire_(uint64_t expires) {
+        if(expires < nextExpire_) { nextExpire_ = expires; }
+    }
+
+    // 第 level 层第 index 个槽的哨兵结点
+    TimeWheelNode* Slot_(int level, int index) {
+        return level == 0 ? &tv1_[index] : &tvn_[level - 1][index];
+    }
+
+    static void InitHead_(TimeWheelNode* head) {
+        head->prev = head->next = head;
+    }
+
+    static bool Empty_(const TimeWheelNode* head) {
+        return head->next == head;
+    }
+
+    // 时间轮指针：下一个待处理的毫秒刻度
+    uint64_t curTick_;
+    // 轮上的结点总数和第 0 层结点数。第 0 层为空时可以整段跳过，避免空转
+    size_t count_;
+    size_t level0Count_;
+    // NextExpire() 的缓存值
+    uint64_t nextExpire_;
+
+    TimeWheelNode tv1_[TVR_SIZE];
+    TimeWheelNode tvn_[LEVELS - 1][TVN_SIZE];
+};
+
+#endif //TIME_WHEEL_H
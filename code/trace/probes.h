@@ -0,0 +1,50 @@
+/*
+ * @file probes.h
+ * @brief USDT 静态探针
+ */
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * 热路径边界上的 USDT 探针，provider 为 tws，可以直接用 perf / bpftrace 挂：
+ *   bpftrace -e 'usdt:./bin/server:tws:parse { @us = hist(arg2); }'
+ *   perf list sdt_tws*   （先 perf buildid-cache --add ./bin/server）
+ * 每个探针只是一条 nop 加 .note.stapsdt 段里的一条说明，没有挂探针时不执行任何额外的指令，
+ * 参数只在寄存器/栈上按原样留给探针读取，不做格式化
+ *
+ * 探针与参数：
+ *   accept(fd, active)                          新连接，active 为当前连接数
+ *   close(fd, requests, lifetime_ms)            连接关闭，requests 为处理过的请求数
+ *   read(fd, bytes, errno)                      一次读事件读完，bytes 为最后一次 read 的返回值
+ *   parse(fd, ok, parse_us)                     一个请求解析完
+ *   process(fd, code, resp_bytes)               响应生成完
+ *   write(fd, bytes, remaining)                 一次写事件写完，bytes 为本次写出的总字节数
+ *   timeout(fd, idle_ms)                        定时器到期，连接被关闭（非惰性超时模式下 idle_ms 就是超时时间）
+ *   task_enqueue(depth)                         线程池入队后的队列长度
+ *   task_dequeue(depth, wait_us)                出队后的队列长度和排队时间（未统计排队时间时为 0）
+ *   sql_acquire(conn, wait_us, ok)              取数据库连接，ok 为 0 表示超时或池已关闭
+ *   sql_release(conn, broken)                   归还数据库连接，broken 为 1 表示连接已断开被关掉
+ *   log_drop(dropped)                           日志队列满丢了一行，dropped 为累计丢弃数
+ *
+ * 需要 systemtap 的 sys/sdt.h（Debian/Ubuntu: systemtap-sdt-dev）。没有这个头文件，
+ * 或者编译时定义了 TWS_NO_USDT（make USDT=0）时，探针宏展开为空
+ */
+#if !defined(TWS_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TWS_USDT 1
+#endif
+#endif
+
+#ifdef TWS_USDT
+#define TWS_PROBE1(name, a) DTRACE_PROBE1(tws, name, a)
+#define TWS_PROBE2(name, a, b) DTRACE_PROBE2(tws, name, a, b)
+#define TWS_PROBE3(name, a, b, c) DTRACE_PROBE3(tws, name, a, b, c)
+#else
+/* sizeof 不求值，只是让只为探针准备的局部变量不产生 unused 警告 */
+#define TWS_PROBE1(name, a) do { (void)sizeof(a); } while(0)
+#define TWS_PROBE2(name, a, b) do { (void)sizeof(a); (void)sizeof(b); } while(0)
+#define TWS_PROBE3(name, a, b, c) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while(0)
+#endif
+
+#endif // PROBES_H
@@ -0,0 +1,232 @@
+/*
+ * @file reqtrace.cpp
+ * @brief ReqTrace / TraceRing 类（请求分阶段追踪）
+ */
+#include "reqtrace.h"
+#include <assert.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+using namespace std;
+
+namespace {
+const char* STAGE_NAME[ReqTrace::STAGES] = {"dispatch", "dequeue", "parse_begin", "parse_end", "response"};
+
+int64_t MonoNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// JSON 字符串转义，路径来自客户端，什么字符都可能有
+void AppendQuoted(string* out, const char* s) {
+    *out += '"';
+    for(; *s; s++) {
+        unsigned char c = *s;
+        if(c == '"' || c == '\\') {
+            *out += '\\';
+            *out += c;
+        } else if(c < 0x20 || c >= 0x7f) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            *out += buf;
+        } else {
+            *out += c;
+        }
+    }
+    *out += '"';
+}
+
+void AppendUs(string* out, double us) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f", us);
+    *out += buf;
+}
+
+// 第一个经过的阶段，作为请求的开始
+uint64_t StartOf(const ReqTrace& t) {
+    for(int i = 0; i < ReqTrace::STAGES; i++) {
+        if(t.stamp[i]) { return t.stamp[i]; }
+    }
+    return t.writeStamp[0];
+}
+
+// Chrome trace 的一个完整事件（ph = X）
+void AppendEvent(string* out, const char* name, const ReqTrace& t, double beginUs, double endUs) {
+    if(out->back() != '[') { *out += ",\n"; }
+    *out += "{\"name\":\"";
+    *out += name;
+    *out += "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + to_string(t.fd) + ",\"ts\":";
+    AppendUs(out, beginUs);
+    *out += ",\"dur\":";
+    AppendUs(out, max(endUs - beginUs, 0.0));
+    *out += ",\"args\":{\"path\":";
+    AppendQuoted(out, t.path);
+    *out += ",\"req\":" + to_string(t.reqIndex) + "}}";
+}
+}
+
+void ReqTrace::Write(size_t bytes) {
+    int i = writes < MAX_WRITES ? writes : MAX_WRITES - 1;
+    writeStamp[i] = TraceTicks();
+    writeBytes[i] += static_cast<uint32_t>(bytes);
+    if(writes < 255) { writes++; }
+}
+
+void ReqTrace::SetPath(const std::string& p) {
+    size_t n = min(p.size(), sizeof(path) - 1);
+    memcpy(path, p.data(), n);
+    path[n] = '\0';
+}
+
+TraceRing::TraceRing(): mask_(0), head_(0), baseTicks_(0), baseNs_(0) {}
+
+TraceRing* TraceRing::Instance() {
+    static TraceRing ring;
+    return &ring;
+}
+
+void TraceRing::Init(size_t capacity) {
+    assert(!slots_);
+    if(capacity == 0) { return; }
+    size_t size = 1;
+    while(size < capacity) { size <<= 1; }
+    slots_.reset(new Slot[size]());
+    baseTicks_ = TraceTicks();
+    baseNs_ = MonoNs();
+    mask_ = size - 1;
+}
+
+void TraceRing::Push(const ReqTrace& trace) {
+    if(!mask_) { return; }
+    uint64_t seq = head_.fetch_add(1, memory_order_relaxed);
+    Slot& slot = slots_[seq & mask_];
+    uint64_t words[WORDS] = {0};
+    memcpy(words, &trace, sizeof(trace));
+    slot.seq.store(seq * 2 + 1, memory_order_relaxed);
+    /* 数据用 release 写、acquire 读：读者看到新数据就一定看到奇数序号。x86 上和 relaxed 一样是普通的 mov */
+    for(size_t i = 0; i < WORDS; i++) {
+        slot.words[i].store(words[i], memory_order_release);
+    }
+    slot.seq.store(seq * 2 + 2, memory_order_release);
+}
+
+std::vector<ReqTrace> TraceRing::Snapshot() const {
+    vector<ReqTrace> traces;
+    if(!mask_) { return traces; }
+    for(size_t s = 0; s <= mask_; s++) {
+        const Slot& slot = slots_[s];
+        uint64_t before = slot.seq.load(memory_order_acquire);
+        if(before == 0 || (before & 1)) { continue; }
+        uint64_t words[WORDS];
+        for(size_t i = 0; i < WORDS; i++) {
+            words[i] = slot.words[i].load(memory_order_acquire);
+        }
+        if(slot.seq.load(memory_order_relaxed) != before) { continue; }
+        ReqTrace trace;
+        memcpy(&trace, words, sizeof(trace));
+        traces.push_back(trace);
+    }
+    sort(traces.begin(), traces.end(), [](const ReqTrace& a, const ReqTrace& b) {
+        return StartOf(a) < StartOf(b);
+    });
+    return traces;
+}
+
+double TraceRing::TicksPerUs_() const {
+    int64_t ns = MonoNs() - baseNs_;
+    if(ns < 10000000) {
+        /* 刚启动，间隔太短换算不准，多等一会儿 */
+        this_thread::sleep_for(chrono::nanoseconds(10000000 - ns));
+        ns = MonoNs() - baseNs_;
+    }
+    return static_cast<double>(TraceTicks() - baseTicks_) * 1000.0 / ns;
+}
+
+double TraceRing::ToUs_(uint64_t ticks, double ticksPerUs) const {
+    return (static_cast<double>(ticks) - static_cast<double>(baseTicks_)) / ticksPerUs;
+}
+
+std::string TraceRing::RenderJson() const {
+    vector<ReqTrace> traces = Snapshot();
+    double ticksPerUs = TicksPerUs_();
+    string out = "{\"ticks_per_us\":";
+    AppendUs(&out, ticksPerUs);
+    out += ",\"requests\":[";
+    for(size_t n = 0; n < traces.size(); n++) {
+        const ReqTrace& t = traces[n];
+        if(n) { out += ","; }
+        out += "\n{\"fd\":" + to_string(t.fd) + ",\"req\":" + to_string(t.reqIndex) + ",\"path\":";
+        AppendQuoted(&out, t.path);
+        out += ",\"code\":" + to_string(t.code) + ",\"bytes\":" + to_string(t.respBytes);
+        out += ",\"aborted\":";
+        out += t.aborted ? "true" : "false";
+        for(int i = 0; i < ReqTrace::STAGES; i++) {
+            if(!t.stamp[i]) { continue; }
+            out += ",\"";
+            out += STAGE_NAME[i];
+            out += "_us\":";
+            AppendUs(&out, ToUs_(t.stamp[i], ticksPerUs));
+        }
+        out += ",\"writes\":" + to_string(t.writes) + ",\"write_us\":[";
+        for(int i = 0; i < min<int>(t.writes, ReqTrace::MAX_WRITES); i++) {
+            if(i) { out += ","; }
+            out += "[";
+            AppendUs(&out, ToUs_(t.writeStamp[i], ticksPerUs));
+            out += "," + to_string(t.writeBytes[i]) + "]";
+        }
+        out += "]}";
+    }
+    out += "]}\n";
+    return out;
+}
+
+std::string TraceRing::RenderChrome() const {
+    static const char* PHASE[ReqTrace::STAGES] = {"queue", "read", "parse", "build", ""};
+    vector<ReqTrace> traces = Snapshot();
+    double ticksPerUs = TicksPerUs_();
+    string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for(const ReqTrace& t: traces) {
+        /* 相邻两个经过的阶段之间是一段，阶段名取前一个 */
+        int prev = -1;
+        for(int i = 0; i < ReqTrace::STAGES; i++) {
+            if(!t.stamp[i]) { continue; }
+            if(prev >= 0) {
+                AppendEvent(&out, PHASE[prev], t, ToUs_(t.stamp[prev], ticksPerUs), ToUs_(t.stamp[i], ticksPerUs));
+            }
+            prev = i;
+        }
+        uint64_t last = prev >= 0 ? t.stamp[prev] : 0;
+        for(int i = 0; i < min<int>(t.writes, ReqTrace::MAX_WRITES); i++) {
+            if(last) {
+                AppendEvent(&out, "write", t, ToUs_(last, ticksPerUs), ToUs_(t.writeStamp[i], ticksPerUs));
+            }
+            last = t.writeStamp[i];
+        }
+        uint64_t start = StartOf(t);
+        if(start && last) {
+            AppendEvent(&out, t.aborted ? "request (aborted)" : "request", t,
+                        ToUs_(start, ticksPerUs), ToUs_(last, ticksPerUs));
+        }
+    }
+    out += "]}\n";
+    return out;
+}
+
+std::string TraceRing::DumpChrome(const char* dir) const {
+    mkdir(dir, 0777);
+    time_t now = time(nullptr);
+    struct tm t;
+    localtime_r(&now, &t);
+    char name[256];
+    snprintf(name, sizeof(name), "%s/trace_%04d%02d%02d_%02d%02d%02d.json", dir,
+             t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+    FILE* fp = fopen(name, "w");
+    if(!fp) { return ""; }
+    string body = RenderChrome();
+    bool ok = fwrite(body.data(), 1, body.size(), fp) == body.size();
+    ok = fclose(fp) == 0 && ok;
+    return ok ? name : "";
+}
@@ -0,0 +1,112 @@
+/*
+ * @file reqtrace.h
+ * @brief ReqTrace / TraceRing 类（请求分阶段追踪）
+ */
+#ifndef REQ_TRACE_H
+#define REQ_TRACE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// 周期计数器：x86 上是 rdtsc（十几个时钟周期，不进内核），其他平台退回 CLOCK_MONOTONIC 纳秒
+inline uint64_t TraceTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/*
+ * 一个请求的追踪记录，嵌在 HttpConn 里，各阶段只写一个周期计数，请求结束时整条拷进 TraceRing
+ * 为 0 的阶段表示没有经过（例如 keep-alive 流水线上的请求不经过派发和出队）
+ */
+struct ReqTrace {
+    enum STAGE {
+        DISPATCH = 0,   // 主线程把读事件交给线程池
+        DEQUEUE,        // 工作线程取到任务，开始读
+        PARSE_BEGIN,
+        PARSE_END,
+        RESPONSE,       // 响应头生成、文件映射完成
+        STAGES,
+    };
+    // 记下的 writev 次数，多出来的合并到最后一次里
+    static const int MAX_WRITES = 6;
+
+    uint64_t stamp[STAGES];
+    uint64_t writeStamp[MAX_WRITES];
+    uint32_t writeBytes[MAX_WRITES];
+    int32_t fd;
+    uint32_t reqIndex;          // 连接上的第几个请求
+    uint32_t respBytes;
+    uint16_t code;
+    uint8_t writes;             // 实际的 writev 次数（封顶 255）
+    uint8_t aborted;            // 响应没写完连接就断了
+    char path[48];              // 截断的请求路径
+
+    void Clear() { memset(this, 0, sizeof(*this)); }
+    void Stamp(STAGE stage) { stamp[stage] = TraceTicks(); }
+    // 只记这个请求第一次经过该阶段的时刻
+    void StampOnce(STAGE stage) { if(stamp[stage] == 0) { stamp[stage] = TraceTicks(); } }
+    void Write(size_t bytes);
+    void SetPath(const std::string& p);
+};
+
+/*
+ * 固定大小的无锁环形缓冲区，保存最近 capacity 个请求的追踪记录，新的覆盖旧的
+ *   写：fetch_add 领一个序号，对应槽位按序号做 seqlock（写前置奇数、写后置偶数），写者之间没有锁
+ *   读：Snapshot 逐槽拷贝，拷贝前后序号不一致（正在被写）的槽位跳过
+ * 槽位里的数据按 8 字节原子字存放，读到的永远是完整的一条
+ * 两个写者同时落到同一个槽位需要环被整圈套过，capacity 远大于并发请求数时不会发生
+ */
+class TraceRing {
+public:
+    static TraceRing* Instance();
+
+    // 服务器启动前调用一次，capacity 取整到 2 的幂，0 关闭追踪
+    void Init(size_t capacity);
+    bool Enabled() const { return mask_ != 0; }
+
+    void Push(const ReqTrace& trace);
+    // 按开始时刻排序的最近若干条
+    std::vector<ReqTrace> Snapshot() const;
+
+    // 每条记录各阶段的时刻（相对 Init 的微秒）
+    std::string RenderJson() const;
+    // Chrome trace event 格式，可以直接在 chrome://tracing 或 Perfetto 里看时间线，每个连接一条泳道
+    std::string RenderChrome() const;
+    // 把 Chrome trace 写到 dir 下带时间戳的文件里，返回文件名，失败返回空串
+    std::string DumpChrome(const char* dir) const;
+
+private:
+    TraceRing();
+
+    static const size_t WORDS = (sizeof(ReqTrace) + 7) / 8;
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        std::atomic<uint64_t> words[WORDS];
+    };
+
+    // 周期计数换算成相对 Init 的微秒
+    double TicksPerUs_() const;
+    double ToUs_(uint64_t ticks, double ticksPerUs) const;
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    std::atomic<uint64_t> head_;
+    // Init 时刻的周期计数与单调时间，用来校准周期计数的频率
+    uint64_t baseTicks_;
+    int64_t baseNs_;
+};
+
+#endif // REQ_TRACE_H
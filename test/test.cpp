@@ -5,7 +5,17 @@
  */ 
 #include "../code/log/log.h"
 #include "../code/pool/threadpool.h"
+#include "../code/timer/timewheel.h"
+#include "../code/auth/credcache.h"
+#include "../code/auth/localauth.h"
+#include "../code/metrics/metrics.h"
+#include "../code/trace/reqtrace.h"
+#include "../code/http/httprequest.h"
 #include <features.h>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <dirent.h>
 
 #if __GLIBC__ == 2 && __GLIBC_MINOR__ < 30
 #include <sys/syscall.h>
@@ -35,12 +45,435 @@ void TestLog() {
     }
 }
 
+void TestLogFilter() {
+    Log* log = Log::Instance();
+    log->init(1, "./testfilter", ".log", 0);
+    /* 模块等级覆盖全局等级，-1 恢复跟随 */
+    assert(!log->IsEnabled(Log::MOD_HTTP, 0));
+    log->SetModuleLevel(Log::MOD_HTTP, 0);
+    assert(log->IsEnabled(Log::MOD_HTTP, 0) && !log->IsEnabled(Log::MOD_POOL, 0));
+    assert(log->SetModuleLevels("pool=3,http=-1") && !log->SetModuleLevels("nosuch=1"));
+    assert(!log->IsEnabled(Log::MOD_HTTP, 0) && !log->IsEnabled(Log::MOD_POOL, 2));
+    assert(log->IsEnabled(Log::MOD_POOL, 3) && log->IsEnabled(Log::MOD_CORE, 2));
+    log->SetModuleLevel(Log::MOD_POOL, -1);
+
+    /* 限速：一个间隔内只放行第一次，之后补报被压掉的条数 */
+    LogRateLimit limit(200);
+    uint32_t suppressed = 0;
+    int allowed = 0;
+    for(int i = 0; i < 1000; i++) {
+        if(limit.Allow(&suppressed)) { allowed++; }
+    }
+    assert(allowed == 1 && suppressed == 0);
+    usleep(250 * 1000);
+    assert(limit.Allow(&suppressed) && suppressed == 999);
+    for(int i = 0; i < 10; i++) {
+        LOG_WARN_RATELIMIT(1000, "rate limited %d", i);
+    }
+}
+
+// 统计目录下以 suffix 结尾的文件数
+static int CountFiles(const char* dir, const std::string& suffix) {
+    int cnt = 0;
+    DIR* d = opendir(dir);
+    if(!d) { return 0; }
+    struct dirent* ent;
+    while((ent = readdir(d)) != nullptr) {
+        std::string name(ent->d_name);
+        if(name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            cnt++;
+        }
+    }
+    closedir(d);
+    return cnt;
+}
+
+void TestLogRotate() {
+    /* 64KB 翻滚一次，写约 500KB：后台线程翻滚，旧文件被压缩，最多保留 4 个 */
+    Log* log = Log::Instance();
+    log->SetRotatePolicy(64 * 1024, 86400);
+    log->SetRetention(true, 4, 0);
+    log->init(0, "./testrotate", ".log", 1024);
+    for(int i = 0; i < 5000; i++) {
+        LOG_INFO("%s %d ==================================================", "rotate", i);
+        if(i % 500 == 0) { usleep(50 * 1000); }
+    }
+    for(int i = 0; i < 40 && (CountFiles("./testrotate", ".gz") == 0 ||
+                                CountFiles("./testrotate", ".log") + CountFiles("./testrotate", ".gz") > 4); i++) {
+        usleep(50 * 1000);
+    }
+    assert(CountFiles("./testrotate", ".log") >= 1);
+    assert(CountFiles("./testrotate", ".gz") >= 1);
+    assert(CountFiles("./testrotate", ".log") + CountFiles("./testrotate", ".gz") <= 4);
+    log->SetRotatePolicy(32 * 1024 * 1024, 86400);
+    log->SetRetention(true, 0, 0);
+}
+
+void TestBinaryLog() {
+    /* 二进制模式写入，再用 LogCodec 解码，每一行都应与 snprintf 的结果一致 */
+    const int N = 3000;
+    const char* name = "binary";
+    time_t now = time(nullptr);
+    struct tm t;
+    localtime_r(&now, &t);
+    char fileName[64];
+    snprintf(fileName, sizeof(fileName), "./testbinary/%04d_%02d_%02d.blog",
+                t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+    remove(fileName);
+    Log::Instance()->SetFormat(Log::FORMAT_BINARY);
+    Log::Instance()->init(0, "./testbinary", ".log", 1024);
+    assert(Log::Instance()->IsDeferred());
+    for(int i = 0; i < N; i++) {
+        LOG_INFO("%s %d %u %5.2f %-4s|%x %lld %c %% %x %u %d %hd", name, i, i * 3u, i / 7.0, "ab", i,
+                    static_cast<long long>(i) << 33, 'a' + i % 26, -i - 1, -i - 1, 3000000000u + i, 70000 + i);
+    }
+    /* 重新 init 会先把环里的记录写进旧文件 */
+    Log::Instance()->SetFormat(Log::FORMAT_TEXT);
+    Log::Instance()->init(0, "./testbinary", ".log", 0);
+
+    FILE* fp = fopen(fileName, "rb");
+    assert(fp);
+    std::string data;
+    char chunk[4096];
+    size_t n;
+    while((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) { data.append(chunk, n); }
+    fclose(fp);
+    assert(data.compare(0, LogFormat::MAGIC_LEN, LogFormat::MAGIC) == 0);
+
+    std::vector<std::string> fmts;
+    size_t off = LogFormat::MAGIC_LEN;
+    int lines = 0;
+    while(off < data.size()) {
+        size_t len = LogCodec::RecordLen(data.data() + off, data.size() - off);
+        assert(len > 0 && len <= data.size() - off);
+        std::string text;
+        assert(LogCodec::DecodeRecord(data.data() + off, len, &fmts, &text));
+        off += len;
+        if(text.empty()) { continue; }  // 格式串定义
+
+        char expect[256];
+        /* 后四个参数的宽度与格式串不一致（负的 int 按 %x/%u、大于 INT_MAX 的 unsigned 按 %d、%hd 截断） */
+        snprintf(expect, sizeof(expect), "%s %d %u %5.2f %-4s|%x %lld %c %% %x %u %d %hd\n", name, lines, lines * 3u,
+                    lines / 7.0, "ab", lines, static_cast<long long>(lines) << 33, 'a' + lines % 26,
+                    -lines - 1, -lines - 1, 3000000000u + lines, 70000 + lines);
+        size_t pos = text.find("[info] : ");
+        assert(pos != std::string::npos && text.substr(pos + 9) == expect);
+        lines++;
+    }
+    assert(lines == N);
+}
+
+void TestTimeWheel() {
+    Log::Instance()->init(0, "./testtimer", ".log", 0);
+    TimeWheel timer;
+    const int N = 2000;
+    std::vector<TimeWheelNode> nodes(N);
+    std::vector<int64_t> deadline(N);
+    int fired = 0, early = 0;
+    for(int i = 0; i < N; i++) {
+        /* 覆盖第 0 层（<256ms）和第 1 层（>=256ms）两种挂链位置 */
+        int timeout = (i * 7) % 1200;
+        deadline[i] = CoarseClock::NowMs() + timeout;
+        timer.add(&nodes[i], timeout, [&, i] {
+            fired++;
+            /* tick 读的是精确时钟，到期判断也用精确时钟 */
+            if(CoarseClock::PreciseMs() < deadline[i]) { early++; }
+        });
+    }
+    /* 取消一半结点，并把另一部分刷新到更晚的时刻 */
+    for(int i = 0; i < N; i += 2) { timer.cancel(&nodes[i]); }
+    for(int i = 1; i < N; i += 4) {
+        deadline[i] = CoarseClock::NowMs() + 300;
+        timer.adjust(&nodes[i], 300);
+    }
+    assert(timer.size() == N / 2);
+    while(timer.size() > 0) {
+        int next = timer.GetNextTick();
+        if(next > 0) { usleep(next * 1000); }
+    }
+    assert(fired == N / 2 && early == 0);
+    LOG_INFO("TimeWheel fired:%d early:%d", fired, early);
+
+    /*
+     * 只按 NextExpire() 唤醒（和服务器的 timerfd 一样），第 1、2 层的结点也要在截止时刻 1 个刻度内触发
+     * 迟到按“触发它的那次唤醒被安排在哪个时刻”计算，不算进程调度带来的抖动
+     * X：第 1 层，在 256ms 边界 B 处 cascade；Y 到期时挂一个第 0 层的 Z（B 之后才到期），此时第 0 层非空，
+     *    下一次唤醒仍然要落在 B 而不是 Z
+     * W：第 2 层；A 到期时挂一个更晚的第 1 层结点 V，下一次唤醒要落在 W 的 cascade 时刻而不是 V 的
+     */
+    enum { X, Y, Z, W, A, V, M };
+    std::vector<TimeWheelNode> sched(M);
+    int64_t wakeAt = 0, maxLate = 0;
+    fired = 0;
+    std::function<void(int, int64_t)> addAt = [&](int i, int64_t when) {
+        deadline[i] = when;
+        timer.add(&sched[i], static_cast<int>(when - CoarseClock::NowMs()), [&, i] {
+            fired++;
+            maxLate = std::max(maxLate, wakeAt - deadline[i]);
+            if(i == Y) { addAt(Z, deadline[X] + 90); }
+            if(i == A) { addAt(V, CoarseClock::NowMs() + 16000); }
+        });
+    };
+    int64_t start = CoarseClock::NowMs();
+    int64_t boundary = ((start >> 8) + 2) << 8;
+    addAt(X, boundary + 10);
+    addAt(Y, boundary - 60);
+    addAt(W, start + 16500);
+    addAt(A, start + 1000);
+    while(timer.size() > 0) {
+        wakeAt = timer.NextExpire();
+        int64_t now = CoarseClock::PreciseMs();
+        if(wakeAt > now) { usleep((wakeAt - now) * 1000); }
+        while(CoarseClock::PreciseMs() < wakeAt) { usleep(100); }
+        timer.tick();
+    }
+    assert(fired == M && maxLate <= 1);
+    LOG_INFO("TimeWheel scheduled fired:%d maxLate:%lldms", fired, static_cast<long long>(maxLate));
+}
+
+void TestCredCache() {
+    CredCache* cache = CredCache::Instance();
+    cache->Init(64, 1000, 50);
+    CredCache::Stats base = cache->GetStats();
+    int loads = 0, called = 0;
+    CredCache::UserInfo got[2];
+    /* 同名的两个并发未命中只查一次库 */
+    for(int i = 0; i < 2; i++) {
+        cache->Lookup("alice", [&got, &called, i](const CredCache::UserInfo& info) { got[i] = info; called++; },
+                      [&loads] { loads++; });
+    }
+    assert(loads == 1 && called == 0);
+    cache->Fill("alice", true, true, "secret");
+    assert(called == 2 && got[0].ok && got[1].exists);
+    assert(cache->Match(got[1], "secret") && !cache->Match(got[1], "Secret"));
+    /* 命中：不再查库 */
+    cache->Lookup("alice", [&](const CredCache::UserInfo& info) { got[0] = info; }, [&loads] { loads++; });
+    assert(loads == 1 && cache->Match(got[0], "secret"));
+
+    /* 负缓存，过期后重新查库 */
+    cache->Lookup("bob", [](const CredCache::UserInfo&) {}, [&loads] { loads++; });
+    cache->Fill("bob", true, false, "");
+    cache->Lookup("bob", [&](const CredCache::UserInfo& info) { got[0] = info; }, [&loads] { loads++; });
+    assert(loads == 2 && got[0].ok && !got[0].exists);
+    usleep(80 * 1000);
+    cache->Lookup("bob", [](const CredCache::UserInfo&) {}, [&loads] { loads++; });
+    assert(loads == 3);
+    /* 查库期间注册：结果照常交给等待者，但不写缓存 */
+    cache->Invalidate("bob");
+    cache->Fill("bob", true, false, "");
+    cache->Lookup("bob", [](const CredCache::UserInfo&) {}, [&loads] { loads++; });
+    assert(loads == 4);
+    cache->Fill("bob", false, false, "");
+
+    CredCache::Stats stats = cache->GetStats();
+    assert(stats.misses - base.misses == 4 && stats.coalesced - base.coalesced == 1);
+    assert(stats.hits - base.hits == 1 && stats.negHits - base.negHits == 1);
+
+    /* 容量：每片 1 条 */
+    cache->Init(16, 1000, 1000);
+    for(int i = 0; i < 200; i++) {
+        std::string name = "user" + std::to_string(i);
+        cache->Lookup(name, [](const CredCache::UserInfo&) {}, [] {});
+        cache->Fill(name, true, true, "pwd");
+    }
+    stats = cache->GetStats();
+    assert(stats.size <= 16 && stats.evictions - base.evictions >= 200 - 16);
+}
+
+void TestLocalAuth() {
+    const char* path = "./testauth.db";
+    remove(path);
+    AuthBackend::User user;
+    AuthBackend::ADD_RESULT added = AuthBackend::ADD_FAILED;
+    {
+        LocalAuth store;
+        assert(store.Init(path));
+        store.AddUser("alice", "secret", [&added](AuthBackend::ADD_RESULT r) { added = r; });
+        assert(added == AuthBackend::ADD_OK);
+        /* 重复注册失败 */
+        store.AddUser("alice", "other", [&added](AuthBackend::ADD_RESULT r) { added = r; });
+        assert(added == AuthBackend::ADD_DUPLICATE);
+        store.AddUser("b&b\n", "", [&added](AuthBackend::ADD_RESULT r) { added = r; });
+        assert(added == AuthBackend::ADD_OK && store.Size() == 2);
+        store.FindUser("alice", [&user](const AuthBackend::User& u) { user = u; });
+        assert(user.ok && user.exists && user.pwd == "secret");
+        store.FindUser("carol", [&user](const AuthBackend::User& u) { user = u; });
+        assert(user.ok && !user.exists);
+    }
+    /* 末尾追加半条记录，模拟写到一半崩溃：重放时截掉，之前的记录都在 */
+    FILE* fp = fopen(path, "a");
+    fwrite("\x01\x02\x03\x04\x05\x00\x00\x00", 1, 8, fp);
+    fclose(fp);
+    LocalAuth store;
+    assert(store.Init(path) && store.Size() == 2);
+    store.FindUser("b&b\n", [&user](const AuthBackend::User& u) { user = u; });
+    assert(user.exists && user.pwd == "");
+    store.AddUser("carol", "pwd", [&added](AuthBackend::ADD_RESULT r) { added = r; });
+    assert(added == AuthBackend::ADD_OK);
+    LocalAuth reopened;
+    assert(reopened.Init(path) && reopened.Size() == 3);
+    reopened.FindUser("carol", [&user](const AuthBackend::User& u) { user = u; });
+    assert(user.exists && user.pwd == "pwd");
+
+    /* 中间的记录坏了一个字节：拒绝启动，文件原样保留 */
+    struct stat before;
+    assert(stat(path, &before) == 0);
+    fp = fopen(path, "r+b");
+    fseek(fp, 8 + 12 + 2, SEEK_SET);   // 第一条记录 name 的第三个字节
+    fputc('X', fp);
+    fclose(fp);
+    LocalAuth corrupted;
+    assert(!corrupted.Init(path));
+    struct stat after;
+    assert(stat(path, &after) == 0 && after.st_size == before.st_size);
+
+    /* 中间记录的长度字段坏了（声明的长度超出文件末尾）：同样拒绝启动，不能当作写到一半截掉后面的用户 */
+    fp = fopen(path, "r+b");
+    fseek(fp, 8 + 4 + 2, SEEK_SET);    // 第一条记录 nameLen 的第三个字节，0 -> 0x01，长度变成约 64K
+    fputc(0x01, fp);
+    fseek(fp, 8 + 12 + 2, SEEK_SET);   // 把上面坏掉的 name 字节改回来，只留长度字段这一处损坏
+    fputc('i', fp);
+    fclose(fp);
+    LocalAuth badLength;
+    assert(!badLength.Init(path));
+    assert(stat(path, &after) == 0 && after.st_size == before.st_size);
+    remove(path);
+}
+
+void TestMetrics() {
+    Metrics* metrics = Metrics::Instance();
+    /* 多个线程落在不同分片上，合起来不丢 */
+    MetricCounter* counter = metrics->Counter("test_ops_total", "ops");
+    MetricHistogram* hist = metrics->Histogram("test_latency_us{op=\"get\"}", "latency");
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; t++) {
+        threads.emplace_back([counter, hist] {
+            for(int i = 1; i <= 1000; i++) {
+                counter->Add();
+                hist->Record(i);
+            }
+        });
+    }
+    for(std::thread& t: threads) { t.join(); }
+    assert(counter->Value() == 4000);
+    MetricHistogram::Snapshot snap = hist->Snap();
+    assert(snap.count == 4000 && snap.sum == 4 * 500500);
+    /* 分位数的相对误差不超过 1/16 */
+    assert(std::abs(static_cast<double>(snap.Quantile(0.5)) - 500) <= 500 / 16.0);
+    assert(std::abs(static_cast<double>(snap.Quantile(0.99)) - 990) <= 990 / 16.0);
+    /* 桶的边界首尾相接 */
+    for(int b = 0; b + 1 < MetricHistogram::BUCKETS; b++) {
+        assert(MetricHistogram::BucketLow(b) + MetricHistogram::BucketWidth(b) == MetricHistogram::BucketLow(b + 1));
+        assert(MetricHistogram::BucketOf(MetricHistogram::BucketLow(b)) == b);
+    }
+    assert(MetricHistogram::BucketOf(~0ull) == MetricHistogram::BUCKETS - 1);
+
+    metrics->GaugeFunc("test_depth", "depth", [] { return 7.0; });
+    std::string text = metrics->Render();
+    assert(text.find("# TYPE test_ops_total counter\ntest_ops_total 4000\n") != std::string::npos);
+    assert(text.find("# TYPE test_latency_us histogram\n") != std::string::npos);
+    /* 累积计数：0~15 每个值一个桶；最大值 1000 落在 [992,1023]，之后的桶不输出 */
+    assert(text.find("test_latency_us_bucket{op=\"get\",le=\"0\"} 0\n") != std::string::npos);
+    assert(text.find("test_latency_us_bucket{op=\"get\",le=\"15\"} 60\n") != std::string::npos);
+    assert(text.find("test_latency_us_bucket{op=\"get\",le=\"1023\"} 4000\n") != std::string::npos);
+    assert(text.find("test_latency_us_bucket{op=\"get\",le=\"1055\"}") == std::string::npos);
+    /* 导出固定的 4 的幂边界，细桶（le="1"、le="511"）不导出 */
+    assert(text.find("test_latency_us_bucket{op=\"get\",le=\"1\"}") == std::string::npos);
+    assert(text.find("test_latency_us_bucket{op=\"get\",le=\"511\"}") == std::string::npos);
+    assert(text.find("test_latency_us_bucket{op=\"get\",le=\"1099511627775\"} 4000\n") != std::string::npos);
+    size_t bucketLines = 0;
+    for(size_t pos = 0; (pos = text.find("test_latency_us_bucket{op=\"get\"", pos)) != std::string::npos; pos++) {
+        bucketLines++;
+    }
+    assert(bucketLines == 22);
+    assert(text.find("test_latency_us_bucket{op=\"get\",le=\"+Inf\"} 4000\n") != std::string::npos);
+    assert(text.find("test_latency_us_count{op=\"get\"} 4000\n") != std::string::npos);
+    assert(text.find("test_depth 7\n") != std::string::npos);
+}
+
+void TestTraceRing() {
+    TraceRing* ring = TraceRing::Instance();
+    assert(!ring->Enabled() && ring->Snapshot().empty());
+    ring->Init(6);  // 取整到 8
+    /* 并发写入，环被套过几圈，只留下完整的最近 8 条 */
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; t++) {
+        threads.emplace_back([ring, t] {
+            for(int i = 0; i < 1000; i++) {
+                ReqTrace trace;
+                trace.Clear();
+                trace.fd = t;
+                trace.reqIndex = i;
+                trace.Stamp(ReqTrace::DISPATCH);
+                trace.Stamp(ReqTrace::RESPONSE);
+                trace.Write(100);
+                ring->Push(trace);
+            }
+        });
+    }
+    for(std::thread& t: threads) { t.join(); }
+    std::vector<ReqTrace> traces = ring->Snapshot();
+    assert(traces.size() == 8);
+    for(size_t i = 0; i < traces.size(); i++) {
+        assert(traces[i].writes == 1 && traces[i].writeBytes[0] == 100);
+        assert(i == 0 || traces[i - 1].stamp[ReqTrace::DISPATCH] <= traces[i].stamp[ReqTrace::DISPATCH]);
+    }
+    /* 超过 MAX_WRITES 次的写合并到最后一次，路径截断并转义 */
+    ReqTrace trace;
+    trace.Clear();
+    trace.fd = 99;
+    for(int i = 0; i < 10; i++) { trace.Write(10); }
+    assert(trace.writes == 10 && trace.writeBytes[ReqTrace::MAX_WRITES - 1] == 50);
+    trace.SetPath("/a\"b" + std::string(100, 'x'));
+    assert(strlen(trace.path) == sizeof(trace.path) - 1);
+    ring->Push(trace);
+    std::string json = ring->RenderJson();
+    assert(json.find("\"fd\":99,\"req\":0,\"path\":\"/a\\\"bxxx") != std::string::npos);
+    assert(json.find("\"writes\":10,") != std::string::npos);
+    assert(ring->RenderChrome().find("\"name\":\"write\",\"ph\":\"X\",\"pid\":1,\"tid\":99") != std::string::npos);
+}
+
 void ThreadLogTask(int i, int cnt) {
     for(int j = 0; j < 10000; j++ ){
         LOG_BASE(i,"PID:[%04d]======= %05d ========= ", gettid(), cnt++);
     }
 }
 
+void TestHttpPipeline() {
+    /* 同一个缓冲区里的两个 GET 和一个带请求体的 POST，每次 parse 只取走一个请求 */
+    Buffer buff;
+    buff.Append("GET /index.html HTTP/1.1\r\nHost: a\r\nConnection: keep-alive\r\n\r\n"
+                "GET /picture HTTP/1.1\r\nConnection: keep-alive\r\n\r\n"
+                "POST /login HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+                "Content-Length: 23\r\n\r\nusername=ab&password=cd"
+                "GET / HTTP/1.1\r\n\r\n");
+    HttpRequest request;
+    assert(request.parse(buff));
+    assert(request.path() == "/index.html" && request.IsKeepAlive());
+    request.Init();
+    assert(request.parse(buff));
+    assert(request.path() == "/picture.html");
+    request.Init();
+    assert(request.parse(buff));
+    assert(request.path() == "/login.html" && request.GetPost("password") == "cd");
+    request.Init();
+    assert(request.parse(buff));
+    assert(request.path() == "/index.html" && buff.ReadableBytes() == 0);
+
+    /* 请求体分两次到达：头部和空行先到，请求体不全时停在 BODY，不取走缓冲区里的数据 */
+    request.Init();
+    buff.Append("POST /login HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+                "Content-Length: 23\r\n\r\nusername=ab");
+    assert(request.parse(buff) && request.BodyPending());
+    assert(buff.ReadableBytes() == 11);
+    buff.Append("&password=cdGET / HTTP/1.1\r\n\r\n");
+    assert(request.parse(buff) && !request.BodyPending());
+    assert(request.path() == "/login.html" && request.GetPost("password") == "cd");
+    request.Init();
+    assert(request.parse(buff));
+    assert(request.path() == "/index.html" && buff.ReadableBytes() == 0);
+}
+
 void TestThreadPool() {
     Log::Instance()->init(0, "./testThreadpool", ".log", 5000);
     ThreadPool threadpool(6);
@@ -52,5 +485,14 @@ void TestThreadPool() {
 
 int main() {
     TestLog();
+    TestLogFilter();
+    TestLogRotate();
+    TestBinaryLog();
+    TestTimeWheel();
+    TestCredCache();
+    TestLocalAuth();
+    TestMetrics();
+    TestTraceRing();
+    TestHttpPipeline();
     TestThreadPool();
 }
\ No newline at end of file
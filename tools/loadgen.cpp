@@ -0,0 +1,786 @@
+/*
+ * @file loadgen.cpp
+ * @brief 多线程 epoll 压测工具：HTTP/1.1 keep-alive、流水线、开环/闭环，延迟分位数（开环不受协调遗漏影响）
+ *
+ * 用法：loadgen [选项]
+ *   -a addr     服务器地址，只允许回环地址（127.0.0.0/8 或 localhost），默认 127.0.0.1
+ *   -p port     端口，默认 1316
+ *   -c conns    连接总数，默认 64
+ *   -t threads  线程数，每个线程一个 epoll，连接平均分给各线程，默认 2
+ *   -d sec      统计时长（秒），默认 10
+ *   -w sec      预热时长（秒），这段时间的请求不计入结果，默认 1
+ *   -P depth    每个连接最多同时在途的请求数（流水线深度），默认 1
+ *   -R rate     开环模式：按固定速率（总请求数/秒）发送，0 为闭环（收到响应立即发下一个），默认 0
+ *   -E us       闭环模式下按 HdrHistogram 的做法修正协调遗漏时使用的期望请求间隔（微秒），0 不修正，默认 0
+ *   -k 0|1      是否 keep-alive，0 时每个请求一个新连接（webbench 的方式），默认 1
+ *   -m mix      请求组合，逗号分隔的 目标=权重，目标是路径或 login / register，
+ *               例如 "/index.html=80,/picture=10,/nope=5,login=4,register=1"，默认 "/index.html=1"
+ *   -u user:pwd login 用的账号，默认 bench:bench（register 用 lg<pid>_<线程>_<序号> 生成不重复的用户名）
+ *   -T ms       响应超时，超时的连接关闭重连，在途请求记为错误，默认 5000
+ *   -I n        另外打开 n 个不发请求的空闲连接，全部建好之后才开始预热和统计，用来测大量空闲连接下的延迟
+ *   -s n        源地址个数：连接轮流绑定 127.0.0.1 ~ 127.0.0.n，绕开单个源地址只有约 2.8 万个临时端口的限制，
+ *               默认按连接总数（含空闲连接）每 25000 个一个地址
+ *   -j          输出一个 JSON 对象（默认输出文本）
+ *
+ * 延迟：
+ *   开环模式下每个连接有自己的发送计划，请求的延迟从“计划发送时刻”算起，服务器变慢时排在后面的请求会
+ *   被延后发送，这段等待也计入延迟，所以结果本身就修正了协调遗漏（coordinated omission）；
+ *   同时给出从实际发送时刻算起的服务时间
+ *   闭环模式下发送节奏由服务器决定，输出的是原始延迟，会低估慢请求的影响；要得到不受协调遗漏影响的数字请用 -R。
+ *   给了 -E 时另外按 HdrHistogram 的做法，以这个期望间隔补上慢请求期间“本该发出”的那些请求，给出修正后的分位数。
+ *   期望间隔必须来自负载本身的设定（例如想模拟的客户端发送间隔），不能取测出来的平均延迟：
+ *   平均延迟被慢请求拉高，用它修正等于拿结果去修正结果
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include "../code/metrics/metrics.h"
+
+static int64_t NowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+struct Options {
+    std::string addr = "127.0.0.1";
+    int port = 1316;
+    int conns = 64;
+    int threads = 2;
+    double duration = 10;
+    double warmup = 1;
+    int depth = 1;
+    double rate = 0;
+    bool keepAlive = true;
+    std::string mix = "/index.html=1";
+    std::string user = "bench";
+    std::string pwd = "bench";
+    int timeoutMs = 5000;
+    bool json = false;
+    int idle = 0;
+    int sources = 0;
+    uint64_t expectedUs = 0;
+};
+
+/* 请求组合：启动时把每种请求的报文拼好，发送时按权重挑一个直接追加，register 每次换一个用户名 */
+class Workload {
+public:
+    enum KIND { GET, LOGIN, REGISTER };
+
+    bool Init(const Options& opt) {
+        host_ = opt.addr + ":" + std::to_string(opt.port);
+        conn_ = opt.keepAlive ? "keep-alive" : "close";
+        user_ = opt.user;
+        pwd_ = opt.pwd;
+        total_ = 0;
+        size_t pos = 0;
+        while(pos <= opt.mix.size()) {
+            size_t end = opt.mix.find(',', pos);
+            if(end == std::string::npos) { end = opt.mix.size(); }
+            std::string item = opt.mix.substr(pos, end - pos);
+            pos = end + 1;
+            if(item.empty()) { continue; }
+            Entry e;
+            size_t eq = item.find('=');
+            e.name = item.substr(0, eq);
+            e.weight = eq == std::string::npos ? 1 : atoi(item.c_str() + eq + 1);
+            if(e.weight <= 0) { fprintf(stderr, "bad weight in mix: %s\n", item.c_str()); return false; }
+            if(e.name == "login") { e.kind = LOGIN; }
+            else if(e.name == "register") { e.kind = REGISTER; }
+            else if(e.name[0] == '/') {
+                e.kind = GET;
+                e.raw = "GET " + e.name + " HTTP/1.1\r\nHost: " + host_ + "\r\nConnection: " + conn_ + "\r\n\r\n";
+            } else {
+                fprintf(stderr, "bad mix target: %s (a path, login or register)\n", e.name.c_str());
+                return false;
+            }
+            if(e.kind == LOGIN) {
+                e.raw = Post_("/login", "username=" + user_ + "&password=" + pwd_);
+            }
+            total_ += e.weight;
+            e.upTo = total_;
+            entries_.push_back(e);
+        }
+        return !entries_.empty();
+    }
+
+    int Pick(uint64_t r) const {
+        int x = static_cast<int>(r % total_);
+        for(size_t i = 0; i < entries_.size(); i++) {
+            if(x < entries_[i].upTo) { return i; }
+        }
+        return entries_.size() - 1;
+    }
+
+    // 把第 idx 种请求追加到 out，seq 用来生成不重复的注册用户名
+    void Build(int idx, int thread, uint64_t seq, std::string* out) const {
+        const Entry& e = entries_[idx];
+        if(e.kind != REGISTER) {
+            out->append(e.raw);
+            return;
+        }
+        std::string name = "lg" + std::to_string(getpid()) + "_" + std::to_string(thread) + "_" + std::to_string(seq);
+        out->append(Post_("/register", "username=" + name + "&password=" + pwd_));
+    }
+
+    size_t Size() const { return entries_.size(); }
+    const std::string& Name(int idx) const { return entries_[idx].name; }
+
+private:
+    struct Entry {
+        std::string name;
+        KIND kind;
+        int weight;
+        int upTo;           // 累计权重
+        std::string raw;
+    };
+
+    std::string Post_(const char* path, const std::string& body) const {
+        return std::string("POST ") + path + " HTTP/1.1\r\nHost: " + host_ + "\r\nConnection: " + conn_ +
+               "\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: " +
+               std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+
+    std::vector<Entry> entries_;
+    int total_;
+    std::string host_, conn_, user_, pwd_;
+};
+
+// 各线程共享：运行标志、统计开始时刻、两个直方图（按线程分片，记录时没有锁）
+struct Shared {
+    std::atomic<bool> stop{false};
+    std::atomic<int64_t> measureFrom{INT64_MAX};
+    std::atomic<int> idleUp{0};     // 已经建立的空闲连接数
+    MetricHistogram latency;    // 从计划发送时刻算起，微秒
+    MetricHistogram service;    // 从实际发送时刻算起，微秒
+};
+
+struct Stats {
+    uint64_t requests = 0;
+    uint64_t bytes = 0;
+    uint64_t codes[6] = {0};        // 按状态码的百位
+    uint64_t connects = 0;
+    uint64_t connectErrors = 0;
+    uint64_t timeouts = 0;
+    uint64_t closed = 0;            // 在途请求还没有响应，连接就被对端关闭
+    uint64_t maxLatency = 0;
+    uint64_t idleLost = 0;          // 被服务器关掉的空闲连接
+    std::vector<uint64_t> perEntry;
+};
+
+class Worker {
+public:
+    Worker(const Options& opt, const Workload& load, const sockaddr_in& addr, Shared* shared,
+           int id, int firstConn, int conns, int firstIdle, int idle):
+        opt_(opt), load_(load), addr_(addr), shared_(shared), id_(id), seq_(0),
+        rng_(0x9E3779B97F4A7C15ull * (id + 1)), conns_(conns), idle_(idle), nextIdle_(0), idleConnecting_(0) {
+        stats_.perEntry.assign(load.Size(), 0);
+        openLoop_ = opt.rate > 0;
+        interval_ = openLoop_ ? opt.conns * 1e6 / opt.rate : 0;
+        depth_ = opt.keepAlive ? opt.depth : 1;
+        // 开环时各连接的发送计划错开，避免所有连接在同一时刻发送
+        int64_t now = NowUs();
+        for(int i = 0; i < conns; i++) {
+            conns_[i].nextUs = now + interval_ * (firstConn + i) / opt.conns;
+            conns_[i].src = (firstConn + i) % opt.sources;
+        }
+        for(int i = 0; i < idle; i++) {
+            idle_[i].idle = true;
+            idle_[i].src = (opt.conns + firstIdle + i) % opt.sources;
+        }
+    }
+
+    void Run() {
+        epollFd_ = epoll_create1(0);
+        int64_t now = NowUs();
+        for(auto& c: conns_) { Connect_(c, now); }
+        epoll_event events[256];
+        int64_t lastScan = now;
+        while(!shared_->stop.load(std::memory_order_relaxed)) {
+            now = NowUs();
+            OpenIdle_(now);
+            int timeout = nextIdle_ < idle_.size() ? 1 : 100;
+            if(openLoop_) {
+                int64_t next = INT64_MAX;
+                for(auto& c: conns_) {
+                    Fill_(c, now);
+                    if(c.fd >= 0 && !c.connecting && static_cast<int>(c.inflight.size()) < depth_) {
+                        next = std::min(next, static_cast<int64_t>(c.nextUs));
+                    }
+                }
+                /* 不到 1ms 就该发下一个时不睡，避免 epoll_wait 的毫秒精度把发送推迟 */
+                if(next != INT64_MAX) { timeout = next - now < 1000 ? 0 : static_cast<int>((next - now) / 1000); }
+                timeout = std::min(timeout, 100);
+            }
+            int n = epoll_wait(epollFd_, events, 256, timeout);
+            now = NowUs();
+            for(int i = 0; i < n; i++) {
+                Conn* c = static_cast<Conn*>(events[i].data.ptr);
+                OnEvent_(*c, events[i].events, now);
+            }
+            if(now - lastScan >= 100000) {
+                lastScan = now;
+                Scan_(now);
+            }
+        }
+        for(auto& c: conns_) { Close_(c); }
+        for(auto& c: idle_) { Close_(c); }
+        close(epollFd_);
+    }
+
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    struct Inflight {
+        int64_t intendedUs;
+        int64_t sentUs;
+        int entry;
+    };
+
+    struct Conn {
+        int fd = -1;
+        bool connecting = false;
+        int64_t retryUs = 0;            // 连接失败后下一次重试的时刻
+        std::string out;
+        size_t outOff = 0;
+        std::string in;
+        size_t inOff = 0;
+        std::deque<Inflight> inflight;
+        double nextUs = 0;              // 开环：下一个请求的计划发送时刻
+        // 正在接收的响应
+        size_t bodyLeft = 0;
+        size_t respBytes = 0;
+        int code = 0;
+        bool closeAfter = false;
+        bool inBody = false;
+        bool idle = false;              // 空闲连接：建好之后不发请求，只检测是否被关闭
+        bool lost = false;              // 空闲连接被服务器关掉了，不再重连
+        int src = 0;                    // 绑定的源地址序号
+    };
+
+    // 逐步打开空闲连接，同时在握手中的不超过 256 个，免得瞬间占满服务器的 accept 队列
+    void OpenIdle_(int64_t now) {
+        while(nextIdle_ < idle_.size() && idleConnecting_ < 256) {
+            Connect_(idle_[nextIdle_++], now);
+        }
+    }
+
+    void Connect_(Conn& c, int64_t now) {
+        c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(c.fd < 0) {
+            stats_.connectErrors++;
+            c.retryUs = now + 100000;
+            return;
+        }
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if(opt_.sources > 1 && !BindSource_(c)) {
+            stats_.connectErrors++;
+            close(c.fd);
+            c.fd = -1;
+            c.retryUs = now + 100000;
+            return;
+        }
+        int ret = connect(c.fd, reinterpret_cast<const sockaddr*>(&addr_), sizeof(addr_));
+        if(ret < 0 && errno != EINPROGRESS) {
+            stats_.connectErrors++;
+            close(c.fd);
+            c.fd = -1;
+            c.retryUs = now + 100000;
+            return;
+        }
+        c.connecting = ret < 0;
+        if(c.idle && c.connecting) { idleConnecting_++; }
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = &c;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, c.fd, &ev);
+        if(!c.connecting) { OnConnected_(c, now); }
+    }
+
+    // 绑定 127.0.0.(src+1)，端口留到 connect 时按四元组选，同一个本地端口可以连不同的目的地址
+    bool BindSource_(Conn& c) {
+#ifdef IP_BIND_ADDRESS_NO_PORT
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+#endif
+        sockaddr_in local;
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl((127u << 24) + 1 + c.src);
+        return bind(c.fd, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) == 0;
+    }
+
+    void OnConnected_(Conn& c, int64_t now) {
+        c.connecting = false;
+        if(c.idle) {
+            shared_->idleUp.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        stats_.connects++;
+        Fill_(c, now);
+    }
+
+    // 关闭连接，还没收到响应的请求记为错误
+    void Close_(Conn& c) {
+        if(c.fd >= 0) {
+            close(c.fd);
+            c.fd = -1;
+        }
+        c.connecting = false;
+        c.out.clear();
+        c.outOff = 0;
+        c.in.clear();
+        c.inOff = 0;
+        c.inflight.clear();
+        c.inBody = false;
+        c.bodyLeft = 0;
+    }
+
+    void Reconnect_(Conn& c, int64_t now) {
+        Close_(c);
+        if(!shared_->stop.load(std::memory_order_relaxed)) { Connect_(c, now); }
+    }
+
+    // 把在途请求补到流水线深度；开环时只发已经到计划时刻的请求
+    void Fill_(Conn& c, int64_t now) {
+        if(c.fd < 0 || c.connecting) { return; }
+        bool added = false;
+        while(static_cast<int>(c.inflight.size()) < depth_) {
+            int64_t intended = now;
+            if(openLoop_) {
+                if(c.nextUs > now) { break; }
+                intended = static_cast<int64_t>(c.nextUs);
+                c.nextUs += interval_;
+            }
+            int entry = load_.Pick(Next_());
+            load_.Build(entry, id_, seq_++, &c.out);
+            c.inflight.push_back({ intended, now, entry });
+            added = true;
+        }
+        if(added) { Flush_(c, now); }
+    }
+
+    void Flush_(Conn& c, int64_t now) {
+        while(c.outOff < c.out.size()) {
+            ssize_t n = write(c.fd, c.out.data() + c.outOff, c.out.size() - c.outOff);
+            if(n < 0) {
+                if(errno == EAGAIN) { return; }
+                Fail_(c, now);
+                return;
+            }
+            c.outOff += n;
+        }
+        c.out.clear();
+        c.outOff = 0;
+    }
+
+    void OnEvent_(Conn& c, uint32_t events, int64_t now) {
+        if(c.fd < 0) { return; }
+        if(c.connecting) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if(c.idle) { idleConnecting_--; }
+            if(err != 0) {
+                stats_.connectErrors++;
+                Close_(c);
+                c.retryUs = now + 100000;
+                return;
+            }
+            OnConnected_(c, now);
+            if(c.fd < 0) { return; }
+        }
+        if(c.idle) {
+            if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) { CheckIdle_(c); }
+            return;
+        }
+        if(events & EPOLLOUT) { Flush_(c, now); }
+        if(c.fd >= 0 && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) { Read_(c, now); }
+    }
+
+    void Read_(Conn& c, int64_t now) {
+        char buf[64 * 1024];
+        while(true) {
+            ssize_t n = read(c.fd, buf, sizeof(buf));
+            if(n > 0) {
+                c.in.append(buf, n);
+                if(!Parse_(c, now)) { return; }
+                continue;
+            }
+            if(n < 0 && errno == EAGAIN) { return; }
+            /* 对端关闭或出错 */
+            Fail_(c, now);
+            return;
+        }
+    }
+
+    // 空闲连接上有读事件：服务器关闭了连接（超时或者满了），记下来，不重连
+    void CheckIdle_(Conn& c) {
+        char buf[512];
+        ssize_t n = read(c.fd, buf, sizeof(buf));
+        if(n < 0 && errno == EAGAIN) { return; }
+        stats_.idleLost++;
+        Close_(c);
+        c.lost = true;
+    }
+
+    // 连接异常断开：在途请求记为错误，重连
+    void Fail_(Conn& c, int64_t now) {
+        if(!c.inflight.empty()) { stats_.closed++; }
+        Reconnect_(c, now);
+    }
+
+    /* 解析收到的响应，返回 false 表示连接已经被关闭重连 */
+    bool Parse_(Conn& c, int64_t now) {
+        while(true) {
+            if(c.inBody) {
+                size_t take = std::min(c.bodyLeft, c.in.size() - c.inOff);
+                c.inOff += take;
+                c.bodyLeft -= take;
+                if(c.bodyLeft > 0) { break; }
+                c.inBody = false;
+                if(!Complete_(c, now)) { return false; }
+                continue;
+            }
+            if(c.inOff == c.in.size()) { break; }
+            size_t end = c.in.find("\r\n\r\n", c.inOff);
+            if(end == std::string::npos) { break; }
+            if(c.inflight.empty() || c.in.compare(c.inOff, 7, "HTTP/1.") != 0) {
+                /* 没有发过请求却收到了数据，或者不是响应：按协议错误断开 */
+                Fail_(c, now);
+                return false;
+            }
+            c.code = atoi(c.in.c_str() + c.inOff + 9);
+            std::string head = c.in.substr(c.inOff, end - c.inOff);
+            c.bodyLeft = 0;
+            c.closeAfter = false;
+            size_t line = 0;
+            while((line = head.find("\r\n", line)) != std::string::npos) {
+                line += 2;
+                const char* h = head.c_str() + line;
+                if(strncasecmp(h, "Content-Length:", 15) == 0) { c.bodyLeft = strtoul(h + 15, nullptr, 10); }
+                else if(strncasecmp(h, "Connection:", 11) == 0) { c.closeAfter = strncasecmp(h + 11, " close", 6) == 0; }
+            }
+            c.respBytes = end + 4 - c.inOff + c.bodyLeft;
+            c.inOff = end + 4;
+            c.inBody = true;
+        }
+        /* 已经处理过的数据丢掉；大文件的响应体边收边丢，不会整个攒在内存里 */
+        if(c.inOff > 0) {
+            c.in.erase(0, c.inOff);
+            c.inOff = 0;
+        }
+        return true;
+    }
+
+    // 一个响应收完：记录延迟，补发请求；服务器要求关闭时重连
+    bool Complete_(Conn& c, int64_t now) {
+        Inflight req = c.inflight.front();
+        c.inflight.pop_front();
+        if(now >= shared_->measureFrom.load(std::memory_order_relaxed)) {
+            uint64_t latency = now - req.intendedUs;
+            shared_->latency.Record(latency);
+            shared_->service.Record(now - req.sentUs);
+            stats_.maxLatency = std::max(stats_.maxLatency, latency);
+            stats_.requests++;
+            stats_.bytes += c.respBytes;
+            stats_.codes[std::min(c.code / 100, 5)]++;
+            stats_.perEntry[req.entry]++;
+        }
+        if(c.closeAfter) {
+            if(!c.inflight.empty()) { stats_.closed++; }
+            Reconnect_(c, now);
+            return false;
+        }
+        if(!openLoop_) { Fill_(c, now); }
+        return c.fd >= 0;
+    }
+
+    // 每 100ms 一次：超时的连接重连，连接失败的按时重试
+    void Scan_(int64_t now) {
+        int64_t timeoutUs = static_cast<int64_t>(opt_.timeoutMs) * 1000;
+        for(auto& c: conns_) {
+            if(c.fd < 0) {
+                if(now >= c.retryUs) { Connect_(c, now); }
+                continue;
+            }
+            if(!c.inflight.empty() && now - c.inflight.front().sentUs > timeoutUs) {
+                stats_.timeouts++;
+                Reconnect_(c, now);
+            }
+        }
+        for(size_t i = 0; i < nextIdle_; i++) {
+            Conn& c = idle_[i];
+            if(c.fd < 0 && !c.lost && now >= c.retryUs) { Connect_(c, now); }
+        }
+    }
+
+    uint64_t Next_() {
+        rng_ ^= rng_ << 13;
+        rng_ ^= rng_ >> 7;
+        rng_ ^= rng_ << 17;
+        return rng_;
+    }
+
+    const Options& opt_;
+    const Workload& load_;
+    sockaddr_in addr_;
+    Shared* shared_;
+    int id_;
+    uint64_t seq_;
+    uint64_t rng_;
+    bool openLoop_;
+    double interval_;       // 开环：每个连接的请求间隔，微秒
+    int depth_;
+    int epollFd_;
+    // Conn 的地址注册在 epoll 里，构造后不再改变大小
+    std::vector<Conn> conns_;
+    std::vector<Conn> idle_;
+    size_t nextIdle_;           // 下一个要打开的空闲连接
+    int idleConnecting_;        // 握手中的空闲连接数
+    Stats stats_;
+};
+
+/*
+ * HdrHistogram 的 copyCorrectedForCoordinatedOmission：每个大于期望间隔的值 v，
+ * 补上 v - interval, v - 2*interval, ... 直到不小于 interval 的若干个值
+ */
+static MetricHistogram::Snapshot Corrected(const MetricHistogram::Snapshot& raw, uint64_t interval) {
+    MetricHistogram::Snapshot res = raw;
+    if(interval == 0) { return res; }
+    for(int b = 0; b < MetricHistogram::BUCKETS; b++) {
+        uint64_t cnt = raw.buckets[b];
+        if(cnt == 0) { continue; }
+        uint64_t v = MetricHistogram::BucketLow(b) + MetricHistogram::BucketWidth(b) / 2;
+        if(v < 2 * interval) { continue; }
+        for(uint64_t missing = v - interval; missing >= interval; missing -= interval) {
+            res.buckets[MetricHistogram::BucketOf(missing)] += cnt;
+            res.count += cnt;
+            res.sum += missing * cnt;
+        }
+    }
+    return res;
+}
+
+static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+static const char* QUANTILE_NAMES[] = { "p50", "p90", "p99", "p999" };
+
+static std::string LatencyJson(const MetricHistogram::Snapshot& s) {
+    std::string res = "{";
+    for(int i = 0; i < 4; i++) {
+        res += std::string("\"") + QUANTILE_NAMES[i] + "\":" + std::to_string(s.Quantile(QUANTILES[i])) + ",";
+    }
+    char mean[32];
+    snprintf(mean, sizeof(mean), "%.1f", s.count ? static_cast<double>(s.sum) / s.count : 0.0);
+    return res + "\"mean\":" + mean + ",\"count\":" + std::to_string(s.count) + "}";
+}
+
+static void PrintLatency(const char* label, const MetricHistogram::Snapshot& s) {
+    printf("  %-14s", label);
+    for(int i = 0; i < 4; i++) { printf(" %s %-9llu", QUANTILE_NAMES[i], (unsigned long long)s.Quantile(QUANTILES[i])); }
+    printf(" mean %.1f\n", s.count ? static_cast<double>(s.sum) / s.count : 0.0);
+}
+
+static void Usage(const char* prog) {
+    fprintf(stderr, "usage: %s [-a addr] [-p port] [-c conns] [-t threads] [-d sec] [-w sec] [-P depth]\n"
+                    "          [-R rate] [-E expectedUs] [-k 0|1] [-m mix] [-u user:pwd] [-T timeoutMs] [-I idle] [-s sources] [-j]\n", prog);
+}
+
+// 只允许压本机：地址必须落在 127.0.0.0/8
+static bool ResolveLoopback(const std::string& host, int port, sockaddr_in* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    const char* ip = host == "localhost" ? "127.0.0.1" : host.c_str();
+    if(inet_pton(AF_INET, ip, &addr->sin_addr) != 1) { return false; }
+    return (ntohl(addr->sin_addr.s_addr) >> 24) == 127;
+}
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    int o;
+    while((o = getopt(argc, argv, "a:p:c:t:d:w:P:R:E:k:m:u:T:I:s:j")) != -1) {
+        switch(o) {
+        case 'a': opt.addr = optarg; break;
+        case 'p': opt.port = atoi(optarg); break;
+        case 'c': opt.conns = atoi(optarg); break;
+        case 't': opt.threads = atoi(optarg); break;
+        case 'd': opt.duration = atof(optarg); break;
+        case 'w': opt.warmup = atof(optarg); break;
+        case 'P': opt.depth = atoi(optarg); break;
+        case 'R': opt.rate = atof(optarg); break;
+        case 'E': opt.expectedUs = strtoull(optarg, nullptr, 10); break;
+        case 'k': opt.keepAlive = atoi(optarg) != 0; break;
+        case 'm': opt.mix = optarg; break;
+        case 'u': {
+            std::string s = optarg;
+            size_t colon = s.find(':');
+            opt.user = s.substr(0, colon);
+            opt.pwd = colon == std::string::npos ? "" : s.substr(colon + 1);
+            break;
+        }
+        case 'T': opt.timeoutMs = atoi(optarg); break;
+        case 'I': opt.idle = atoi(optarg); break;
+        case 's': opt.sources = atoi(optarg); break;
+        case 'j': opt.json = true; break;
+        default: Usage(argv[0]); return 2;
+        }
+    }
+    if(opt.conns <= 0 || opt.threads <= 0 || opt.depth <= 0 || opt.duration <= 0 || opt.warmup < 0 || opt.rate < 0 ||
+            opt.idle < 0 || opt.sources < 0 || opt.sources > 254) {
+        Usage(argv[0]);
+        return 2;
+    }
+    opt.threads = std::min(opt.threads, opt.conns);
+    if(opt.sources == 0) { opt.sources = std::min(254, 1 + (opt.conns + opt.idle) / 25000); }
+    sockaddr_in addr;
+    if(!ResolveLoopback(opt.addr, opt.port, &addr)) {
+        fprintf(stderr, "%s: only loopback addresses (127.0.0.0/8, localhost) are allowed\n", opt.addr.c_str());
+        return 2;
+    }
+    Workload load;
+    if(!load.Init(opt)) { return 2; }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::unique_ptr<Shared> shared(new Shared());
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    int first = 0, firstIdle = 0;
+    for(int i = 0; i < opt.threads; i++) {
+        int n = opt.conns / opt.threads + (i < opt.conns % opt.threads ? 1 : 0);
+        int idle = opt.idle / opt.threads + (i < opt.idle % opt.threads ? 1 : 0);
+        workers.emplace_back(new Worker(opt, load, addr, shared.get(), i, first, n, firstIdle, idle));
+        first += n;
+        firstIdle += idle;
+    }
+    for(auto& w: workers) {
+        Worker* worker = w.get();
+        threads.emplace_back([worker] { worker->Run(); });
+    }
+    /* 先等空闲连接全部建好；10 秒没有进展就不再等（多半是文件描述符或者服务器连接数到上限了） */
+    int64_t idleStart = NowUs();
+    int lastUp = 0;
+    int64_t lastProgress = idleStart;
+    while(shared->idleUp.load() < opt.idle) {
+        usleep(10000);
+        int up = shared->idleUp.load();
+        if(up != lastUp) {
+            lastUp = up;
+            lastProgress = NowUs();
+        } else if(NowUs() - lastProgress > 10000000) {
+            fprintf(stderr, "idle connections stalled at %d/%d\n", up, opt.idle);
+            break;
+        }
+    }
+    double idleSec = (NowUs() - idleStart) / 1e6;
+    int idleUp = shared->idleUp.load();
+    usleep(static_cast<useconds_t>(opt.warmup * 1e6));
+    int64_t start = NowUs();
+    shared->measureFrom.store(start);
+    usleep(static_cast<useconds_t>(opt.duration * 1e6));
+    shared->stop.store(true);
+    int64_t elapsedUs = NowUs() - start;
+    for(auto& t: threads) { t.join(); }
+
+    Stats total;
+    total.perEntry.assign(load.Size(), 0);
+    for(auto& w: workers) {
+        const Stats& s = w->GetStats();
+        total.requests += s.requests;
+        total.bytes += s.bytes;
+        for(int i = 0; i < 6; i++) { total.codes[i] += s.codes[i]; }
+        total.connects += s.connects;
+        total.connectErrors += s.connectErrors;
+        total.timeouts += s.timeouts;
+        total.closed += s.closed;
+        total.maxLatency = std::max(total.maxLatency, s.maxLatency);
+        total.idleLost += s.idleLost;
+        for(size_t i = 0; i < load.Size(); i++) { total.perEntry[i] += s.perEntry[i]; }
+    }
+    double sec = elapsedUs / 1e6;
+    double rps = total.requests / sec;
+    MetricHistogram::Snapshot latency = shared->latency.Snap();
+    MetricHistogram::Snapshot service = shared->service.Snap();
+    /* 开环的 latency 已经从计划时刻算起；闭环只在给了 -E 时另外给出修正后的分位数，latency 始终是测到的原始值 */
+    uint64_t interval = opt.rate > 0 ? 0 : opt.expectedUs;
+    MetricHistogram::Snapshot corrected = Corrected(latency, interval);
+    uint64_t errors = total.connectErrors + total.timeouts + total.closed;
+
+    if(opt.json) {
+        printf("{\"target\":\"%s:%d\",\"mode\":\"%s\",\"connections\":%d,\"threads\":%d,\"depth\":%d,"
+               "\"rate\":%.0f,\"keepalive\":%s,\"mix\":\"%s\",\"duration_s\":%.3f,\"warmup_s\":%.3f,",
+               opt.addr.c_str(), opt.port, opt.rate > 0 ? "open" : "closed", opt.conns, opt.threads,
+               opt.keepAlive ? opt.depth : 1, opt.rate, opt.keepAlive ? "true" : "false", opt.mix.c_str(), sec, opt.warmup);
+        printf("\"requests\":%llu,\"rps\":%.1f,\"bytes\":%llu,\"bytes_per_s\":%.0f,",
+               (unsigned long long)total.requests, rps, (unsigned long long)total.bytes, total.bytes / sec);
+        printf("\"codes\":{\"1xx\":%llu,\"2xx\":%llu,\"3xx\":%llu,\"4xx\":%llu,\"5xx\":%llu},",
+               (unsigned long long)total.codes[1], (unsigned long long)total.codes[2], (unsigned long long)total.codes[3],
+               (unsigned long long)total.codes[4], (unsigned long long)total.codes[5]);
+        printf("\"connects\":%llu,\"errors\":{\"total\":%llu,\"connect\":%llu,\"timeout\":%llu,\"closed\":%llu},",
+               (unsigned long long)total.connects, (unsigned long long)errors, (unsigned long long)total.connectErrors,
+               (unsigned long long)total.timeouts, (unsigned long long)total.closed);
+        printf("\"idle\":{\"requested\":%d,\"established\":%d,\"lost\":%llu,\"open_s\":%.3f,\"connect_rate\":%.0f,\"sources\":%d},",
+               opt.idle, idleUp, (unsigned long long)total.idleLost, idleSec, idleSec > 0 ? idleUp / idleSec : 0.0, opt.sources);
+        printf("\"per_target\":{");
+        for(size_t i = 0; i < load.Size(); i++) {
+            printf("%s\"%s\":%llu", i ? "," : "", load.Name(i).c_str(), (unsigned long long)total.perEntry[i]);
+        }
+        printf("},\"latency_us\":%s,\"service_us\":%s,", LatencyJson(latency).c_str(), LatencyJson(service).c_str());
+        if(interval > 0) {
+            printf("\"corrected_us\":%s,\"corrected_interval_us\":%llu,",
+                   LatencyJson(corrected).c_str(), (unsigned long long)interval);
+        }
+        printf("\"max_latency_us\":%llu}\n", (unsigned long long)total.maxLatency);
+        return 0;
+    }
+    printf("loadgen %s:%d  %s  conns=%d threads=%d depth=%d%s  %.1fs (+%.1fs warmup)\n",
+           opt.addr.c_str(), opt.port, opt.rate > 0 ? "open-loop" : "closed-loop", opt.conns, opt.threads,
+           opt.keepAlive ? opt.depth : 1, opt.keepAlive ? "  keep-alive" : "  close", sec, opt.warmup);
+    if(opt.rate > 0) { printf("  target rate    %.0f req/s\n", opt.rate); }
+    printf("  requests       %llu  %.1f req/s  %.2f MB/s\n",
+           (unsigned long long)total.requests, rps, total.bytes / sec / (1 << 20));
+    printf("  codes          2xx %llu  3xx %llu  4xx %llu  5xx %llu\n",
+           (unsigned long long)total.codes[2], (unsigned long long)total.codes[3],
+           (unsigned long long)total.codes[4], (unsigned long long)total.codes[5]);
+    printf("  connects       %llu  errors %llu (connect %llu, timeout %llu, closed %llu)\n",
+           (unsigned long long)total.connects, (unsigned long long)errors, (unsigned long long)total.connectErrors,
+           (unsigned long long)total.timeouts, (unsigned long long)total.closed);
+    if(opt.idle > 0) {
+        printf("  idle           %d/%d established in %.2fs (%.0f conn/s, %d source addresses), %llu lost\n",
+               idleUp, opt.idle, idleSec, idleSec > 0 ? idleUp / idleSec : 0.0, opt.sources,
+               (unsigned long long)total.idleLost);
+    }
+    for(size_t i = 0; i < load.Size(); i++) {
+        printf("  %-14s %llu\n", load.Name(i).c_str(), (unsigned long long)total.perEntry[i]);
+    }
+    printf("latency (us, %s)\n", opt.rate > 0 ? "from intended send time" :
+           "closed-loop, understates stalls; use -R for open-loop numbers");
+    PrintLatency("latency", latency);
+    PrintLatency("service", service);
+    if(interval > 0) {
+        PrintLatency(("corrected@" + std::to_string(interval)).c_str(), corrected);
+    }
+    printf("  max            %llu\n", (unsigned long long)total.maxLatency);
+    return 0;
+}
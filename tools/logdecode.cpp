@@ -0,0 +1,64 @@
+/*
+ * @file logdecode.cpp
+ * @brief 二进制日志（.blog）离线解码工具，输出与文本日志相同的格式
+ *
+ * 用法：logdecode file.blog [file2.blog ...]    不带参数时从标准输入读取
+ */
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../code/log/logcodec.h"
+
+static int Decode(FILE* in, const char* name) {
+    char magic[LogFormat::MAGIC_LEN];
+    if(fread(magic, 1, sizeof(magic), in) != sizeof(magic) ||
+            memcmp(magic, LogFormat::MAGIC, LogFormat::MAGIC_LEN) != 0) {
+        fprintf(stderr, "%s: not a binary log file\n", name);
+        return 1;
+    }
+
+    std::vector<std::string> fmts;
+    std::string pending, out;
+    char chunk[64 * 1024];
+    size_t bad = 0;
+    size_t n;
+    while((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        pending.append(chunk, n);
+        size_t off = 0;
+        while(true) {
+            size_t len = LogCodec::RecordLen(pending.data() + off, pending.size() - off);
+            if(len == 0 || len > pending.size() - off) { break; }
+            if(!LogCodec::DecodeRecord(pending.data() + off, len, &fmts, &out)) { bad++; }
+            off += len;
+        }
+        pending.erase(0, off);
+        fwrite(out.data(), 1, out.size(), stdout);
+        out.clear();
+    }
+    if(!pending.empty()) {
+        fprintf(stderr, "%s: %zu trailing bytes (truncated record)\n", name, pending.size());
+    }
+    if(bad) {
+        fprintf(stderr, "%s: %zu undecodable records\n", name, bad);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        return Decode(stdin, "<stdin>");
+    }
+    int ret = 0;
+    for(int i = 1; i < argc; i++) {
+        FILE* in = fopen(argv[i], "rb");
+        if(!in) {
+            perror(argv[i]);
+            ret = 1;
+            continue;
+        }
+        ret |= Decode(in, argv[i]);
+        fclose(in);
+    }
+    return ret;
+}